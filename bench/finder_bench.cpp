@@ -0,0 +1,58 @@
+// Time FuzzyFinder takes per keystroke while a query is typed.
+// usage: finder_bench [query]  (500k paths are made up in the shape of a
+// source tree)
+#include "../src/fuzzy_finder.h"
+#include "../src/u8String.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+
+static std::vector<std::string> makePaths(size_t count) {
+  std::mt19937 rng(42);
+  static const char *parts[] = {"src",    "include", "lib",   "test",
+                                "core",   "util",    "net",   "render",
+                                "parser", "Config",  "state", "buffer",
+                                "io",     "linux",   "sched", "driver"};
+  static const char *extensions[] = {".cc", ".h", ".cpp", ".py", ".md"};
+  std::vector<std::string> paths;
+  while (paths.size() < count) {
+    std::string path;
+    size_t depth = 1 + rng() % 6;
+    for (size_t i = 0; i < depth; i++)
+      path += std::string(parts[rng() % 16]) + "/";
+    path += parts[rng() % 16];
+    path += "_" + std::to_string(rng() % 1000);
+    path += extensions[rng() % 5];
+    paths.push_back(path);
+  }
+  return paths;
+}
+
+int main(int argc, char **argv) {
+  std::u16string typed = create(argc > 1 ? argv[1] : "linux/sched");
+  std::vector<std::string> paths = makePaths(500 * 1000);
+  ThreadPool pool;
+  FuzzyFinder finder(pool);
+  // the masks are made while the list is crawled, not when typing starts
+  finder.update(paths, 0, u"");
+  std::u16string query;
+  double worst = 0;
+  for (char16_t c : typed) {
+    query += c;
+    auto start = std::chrono::steady_clock::now();
+    finder.update(paths, 0, query);
+    std::chrono::duration<double, std::milli> took =
+        std::chrono::steady_clock::now() - start;
+    if (took.count() > worst)
+      worst = took.count();
+    std::cout << convert_str(query) << ": " << took.count() << " ms, "
+              << finder.count() << " matches, best "
+              << (finder.ranked().size()
+                      ? paths[finder.ranked()[0].index]
+                      : std::string("none"))
+              << "\n";
+  }
+  std::cout << "slowest keystroke: " << worst << " ms on " << pool.size()
+            << " threads\n";
+}
@@ -0,0 +1,74 @@
+// Throughput of FileScanner on raw bytes and of ProjectGrep over a tree.
+// usage: grep_bench [directory] [term]  (64 MiB of text are made up for the
+// scanner, the tree is only searched when a directory is given)
+#include "../src/file_scanner.h"
+#include "../src/project_grep.h"
+#include "../src/u8String.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+static std::string makeText(size_t size) {
+  std::mt19937 rng(42);
+  static const char *words[] = {"lorem", "ipsum", "dolor", "sit",  "amet",
+                                "Error", "value", "index", "line", "search"};
+  std::string text;
+  while (text.size() < size) {
+    size_t count = rng() % 16;
+    for (size_t i = 0; i < count; i++) {
+      text += words[rng() % 10];
+      text += ' ';
+    }
+    text += '\n';
+  }
+  return text;
+}
+
+static void scan(const char *name, const std::string &text,
+                 const std::u16string &term, SearchOptions options) {
+  FileScanner scanner(term, options);
+  double best = 0;
+  size_t matches = 0;
+  for (int round = 0; round < 5; round++) {
+    matches = 0;
+    auto start = std::chrono::steady_clock::now();
+    scanner.scan(text.data(), text.size(),
+                 [&](size_t, const std::u16string &, size_t, size_t) {
+                   matches++;
+                   return true;
+                 });
+    std::chrono::duration<double> took =
+        std::chrono::steady_clock::now() - start;
+    double rate = text.size() / took.count() / 1e9;
+    if (rate > best)
+      best = rate;
+  }
+  std::cout << name << ": " << best << " GB/s (" << matches << " matches)\n";
+}
+
+int main(int argc, char **argv) {
+  std::u16string term = create(argc > 2 ? argv[2] : "Error");
+  std::string text = makeText(64 * 1024 * 1024);
+  SearchOptions options;
+  scan("bytes", text, u"valuex", options);
+  options.ignoreCase = true;
+  scan("bytes, ignore case", text, u"VALUEX", options);
+  options.ignoreCase = false;
+  options.regex = true;
+  scan("decoded lines, regex", text, u"valuex", options);
+  if (argc < 2)
+    return 0;
+  options.regex = false;
+  auto start = std::chrono::steady_clock::now();
+  ProjectGrep grep(argv[1], term, options, nullptr);
+  std::vector<GrepMatch> matches;
+  while (!grep.take(matches))
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  std::chrono::duration<double> took =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "tree: " << took.count() * 1000 << " ms, "
+            << grep.filesSearched() << " files, " << matches.size()
+            << " matches\n";
+}
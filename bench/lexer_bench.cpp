@@ -0,0 +1,344 @@
+// Throughput of the compiled lexer against the rules it was made from.
+// usage: lexer_bench [file]  (without a file 64 MiB of C++ are made up, the
+// language goes by the extension of the file)
+// Both first color lines of every language made up from its own words and
+// delimiters, and the text in the language measured, and the bench fails
+// on the first line they color differently or leave in another state.
+#include "../src/languages.h"
+#include "../src/lexer.h"
+#include "../src/u8String.h"
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// the lexer Highlighter used before languages were compiled
+class RuleLexer {
+  LanguageExpanded _language;
+  std::unordered_set<std::u16string_view> _keyWords;
+  std::unordered_set<std::u16string_view> _specialWords;
+
+  static bool startsWith(const std::u16string &line, size_t column,
+                         const std::u16string &what) {
+    return what.length() && line.compare(column, what.length(), what) == 0;
+  }
+  static bool isNonChar(char16_t c) {
+    static const std::u16string whitespace = u" \t\n[]{}();:.,*-+/";
+    return whitespace.find(c) != std::u16string::npos;
+  }
+  static bool isNumber(char16_t c) { return c >= '0' && c <= '9'; }
+  static bool isNumberEnd(char16_t c, bool hexa) {
+    if (hexa && ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')))
+      return false;
+    return !isNumber(c) && c != '.' && c != 'x';
+  }
+  bool isQuote(char16_t c) const {
+    return _language.stringCharacters.find(c) != std::u16string::npos;
+  }
+  bool opensComment(const std::u16string &line, size_t column) const {
+    return startsWith(line, column, _language.singleLineComment) ||
+           startsWith(line, column, _language.multiLineComment.first);
+  }
+  size_t closeString(const std::u16string &line, size_t from,
+                     Lexer::State &state) const {
+    for (size_t i = from; i < line.length(); i++) {
+      if (_language.escapeChar && line[i] == _language.escapeChar) {
+        i++;
+        continue;
+      }
+      if (line[i] == state.quote) {
+        state = {Lexer::NONE, 0};
+        return i + 1;
+      }
+    }
+    return line.length();
+  }
+  size_t closeComment(const std::u16string &line, size_t from,
+                      Lexer::State &state) const {
+    size_t end = line.find(_language.multiLineComment.second, from);
+    if (end == std::u16string::npos)
+      return line.length();
+    state = {Lexer::NONE, 0};
+    return end + _language.multiLineComment.second.length();
+  }
+
+public:
+  explicit RuleLexer(const LanguageExpanded &language) : _language(language) {
+    _keyWords.insert(_language.keyWords.begin(), _language.keyWords.end());
+    _specialWords.insert(_language.specialWords.begin(),
+                         _language.specialWords.end());
+  }
+
+  Lexer::State lex(const std::u16string &line, Lexer::State state,
+                   std::vector<ColorSpan> *spans) const {
+    size_t length = line.length();
+    auto mark = [&](size_t column, ColorKind kind) {
+      if (!spans || column >= length)
+        return;
+      if (spans->size() && spans->back().column == column)
+        spans->pop_back();
+      ColorKind before = spans->size() ? spans->back().kind : COLOR_DEFAULT;
+      if (kind != before)
+        spans->push_back({(uint32_t)column, kind});
+    };
+    size_t i = 0;
+    if (state.mode == Lexer::COMMENT) {
+      mark(0, COLOR_COMMENT);
+      i = closeComment(line, 0, state);
+      mark(i, COLOR_DEFAULT);
+    } else if (state.mode == Lexer::STRING) {
+      mark(0, COLOR_STRING);
+      i = closeString(line, 0, state);
+      mark(i, COLOR_DEFAULT);
+    }
+    while (i < length) {
+      char16_t c = line[i];
+      if (startsWith(line, i, _language.singleLineComment)) {
+        mark(i, COLOR_COMMENT);
+        break;
+      }
+      if (startsWith(line, i, _language.multiLineComment.first)) {
+        mark(i, COLOR_COMMENT);
+        state = {Lexer::COMMENT, 0};
+        i = closeComment(line, i + _language.multiLineComment.first.length(),
+                         state);
+        mark(i, COLOR_DEFAULT);
+        continue;
+      }
+      if (isQuote(c)) {
+        mark(i, COLOR_STRING);
+        state = {Lexer::STRING, c};
+        i = closeString(line, i + 1, state);
+        mark(i, COLOR_DEFAULT);
+        continue;
+      }
+      if (isNonChar(c) || (i > 0 && !isNonChar(line[i - 1]))) {
+        i++;
+        continue;
+      }
+      size_t end = i + 1;
+      if (isNumber(c)) {
+        bool hexa = c == '0' && end < length &&
+                    (line[end] == 'x' || line[end] == 'X');
+        while (end < length && !isNumberEnd(line[end], hexa))
+          end++;
+        mark(i, COLOR_NUMBER);
+        mark(end, COLOR_DEFAULT);
+        i = end;
+        continue;
+      }
+      while (end < length && !isNonChar(line[end]) && !isQuote(line[end]) &&
+             !opensComment(line, end))
+        end++;
+      if (end == length || isNonChar(line[end])) {
+        std::u16string_view word(line.data() + i, end - i);
+        ColorKind kind = _keyWords.count(word)       ? COLOR_KEYWORD
+                         : _specialWords.count(word) ? COLOR_SPECIAL
+                                                     : COLOR_DEFAULT;
+        mark(i, kind);
+        mark(end, COLOR_DEFAULT);
+      }
+      i = end;
+    }
+    return state;
+  }
+};
+
+static LanguageExpanded expand(const Language &language) {
+  LanguageExpanded expanded;
+  expanded.modeName = create(language.modeName);
+  for (auto &word : language.keyWords)
+    expanded.keyWords.push_back(create(word));
+  for (auto &word : language.specialWords)
+    expanded.specialWords.push_back(create(word));
+  expanded.singleLineComment = create(language.singleLineComment);
+  expanded.multiLineComment = {create(language.multiLineComment.first),
+                               create(language.multiLineComment.second)};
+  expanded.stringCharacters = create(language.stringCharacters);
+  expanded.escapeChar = (char16_t)language.escapeChar;
+  return expanded;
+}
+
+static std::string makeText(size_t size) {
+  std::mt19937 rng(42);
+  static const char *lines[] = {
+      "#include <vector>",
+      "static const size_t LIMIT = 0x1000;",
+      "  for (size_t i = 0; i < items.size(); i++) {",
+      "    if (items[i].name == \"done\" && !waiting)",
+      "      return false; // nothing left to do here",
+      "  /* the cache is kept across calls, a miss",
+      "     costs a lookup in the map */",
+      "  std::string label = 'x' + std::to_string(count * 2.5);",
+      "  auto *entry = table.find(key, \"\\\"quoted\\\"\");",
+      "}",
+      "",
+      "class Renderer : public Drawable {",
+      "  double scale = 1.0e-3;",
+      "  while (next != nullptr && next->weight > 17)",
+      "    next = next->parent; /* up */ next++;",
+      "    switch (kind) { case KIND_A: break; default: continue; }"};
+  std::string text;
+  text.reserve(size);
+  while (text.size() < size) {
+    text += lines[rng() % (sizeof(lines) / sizeof(lines[0]))];
+    text += '\n';
+  }
+  return text;
+}
+
+// lines of the words, delimiters and quotes of language, mixed up with
+// separators and numbers
+static std::vector<std::u16string>
+makeLines(const LanguageExpanded &language, size_t count) {
+  std::mt19937 rng(7);
+  std::vector<std::u16string> pieces = {
+      u" ", u"  ", u"\t", u"(", u")", u".", u",", u"-", u"*", u"/",
+      u"x", u"name", u"0x1F", u"42", u"3.5e2", u"\u00e9t\u00e9", u"\u4e2d"};
+  for (auto *words : {&language.keyWords, &language.specialWords})
+    pieces.insert(pieces.end(), words->begin(), words->end());
+  for (auto *delimiter :
+       {&language.singleLineComment, &language.multiLineComment.first,
+        &language.multiLineComment.second}) {
+    if (delimiter->length())
+      pieces.push_back(*delimiter);
+  }
+  for (char16_t quote : language.stringCharacters) {
+    pieces.push_back(std::u16string(1, quote));
+    if (language.escapeChar)
+      pieces.push_back(std::u16string{language.escapeChar, quote});
+  }
+  if (language.escapeChar)
+    pieces.push_back(std::u16string(1, language.escapeChar));
+  std::vector<std::u16string> lines(count);
+  for (auto &line : lines) {
+    for (size_t i = rng() % 16; i > 0; i--)
+      line += pieces[rng() % pieces.size()];
+  }
+  return lines;
+}
+
+static bool sameSpans(const std::vector<ColorSpan> &a,
+                      const std::vector<ColorSpan> &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].column != b[i].column || a[i].kind != b[i].kind)
+      return false;
+  }
+  return true;
+}
+
+// runs both lexers over lines, false and the line told at the first
+// difference
+static bool check(const std::string &name,
+                  const std::vector<std::u16string> &lines,
+                  const RuleLexer &rules, const Lexer &lexer) {
+  Lexer::State expected = {Lexer::NONE, 0};
+  Lexer::State state = expected;
+  std::vector<ColorSpan> expectedSpans, spans;
+  for (size_t i = 0; i < lines.size(); i++) {
+    expectedSpans.clear();
+    spans.clear();
+    expected = rules.lex(lines[i], expected, &expectedSpans);
+    state = lexer.lex(lines[i], state, &spans);
+    if (expected == state && sameSpans(expectedSpans, spans))
+      continue;
+    std::cerr << name << ": the lexers differ on line " << i + 1 << ": "
+              << convert_str(lines[i]) << "\n";
+    return false;
+  }
+  return true;
+}
+
+static void run(const char *name, size_t bytes, int rounds,
+                const std::function<size_t()> &fn) {
+  double best = 0;
+  size_t result = 0;
+  for (int i = 0; i < rounds; i++) {
+    auto start = std::chrono::steady_clock::now();
+    result = fn();
+    std::chrono::duration<double> took =
+        std::chrono::steady_clock::now() - start;
+    double rate = bytes / took.count() / 1e6;
+    if (rate > best)
+      best = rate;
+  }
+  std::cout << name << ": " << best << " MB/s (check " << result << ")\n";
+}
+
+int main(int argc, char **argv) {
+  std::string text;
+  const Language *language = has_language("cpp");
+  if (argc >= 2) {
+    std::ifstream stream(argv[1], std::ios::binary);
+    if (!stream) {
+      std::cerr << "failed to open " << argv[1] << "\n";
+      return 1;
+    }
+    std::stringstream buffer;
+    buffer << stream.rdbuf();
+    text = buffer.str();
+    std::string path = argv[1];
+    size_t dot = path.rfind('.');
+    if (dot != std::string::npos && has_language(path.substr(dot + 1)))
+      language = has_language(path.substr(dot + 1));
+  } else {
+    text = makeText(64 * 1024 * 1024);
+  }
+  std::vector<std::u16string> lines;
+  for (size_t start = 0; start <= text.size();) {
+    size_t end = text.find('\n', start);
+    if (end == std::string::npos)
+      end = text.size();
+    lines.push_back(create(text.substr(start, end - start)));
+    start = end + 1;
+  }
+  for (size_t i = 0; i < getLanguageCount(); i++) {
+    LanguageExpanded expanded = expand(getLanguage(i));
+    if (!check(getLanguage(i).modeName, makeLines(expanded, 100000),
+               RuleLexer(expanded), Lexer(expanded)))
+      return 1;
+  }
+  LanguageExpanded expanded = expand(*language);
+  auto compileStart = std::chrono::steady_clock::now();
+  Lexer lexer(expanded);
+  std::chrono::duration<double, std::milli> compiled =
+      std::chrono::steady_clock::now() - compileStart;
+  RuleLexer rules(expanded);
+  if (!check(language->modeName, lines, rules, lexer))
+    return 1;
+  std::cout << language->modeName << ", " << lines.size() << " lines, "
+            << text.size() / 1e6 << " MB, compiled in " << compiled.count()
+            << " ms\n";
+  std::vector<ColorSpan> spans;
+  auto states = [&](auto &lexer) {
+    Lexer::State state = {Lexer::NONE, 0};
+    size_t open = 0;
+    for (auto &line : lines) {
+      state = lexer.lex(line, state, nullptr);
+      open += state.mode != Lexer::NONE;
+    }
+    return open;
+  };
+  auto colors = [&](auto &lexer) {
+    Lexer::State state = {Lexer::NONE, 0};
+    size_t count = 0;
+    for (auto &line : lines) {
+      spans.clear();
+      state = lexer.lex(line, state, &spans);
+      count += spans.size();
+    }
+    return count;
+  };
+  run("rules, states", text.size(), 3, [&] { return states(rules); });
+  run("table, states", text.size(), 3, [&] { return states(lexer); });
+  run("rules, colors", text.size(), 3, [&] { return colors(rules); });
+  run("table, colors", text.size(), 3, [&] { return colors(lexer); });
+}
@@ -0,0 +1,102 @@
+// Throughput of the line index builder against the previous splitter.
+// usage: line_index_bench [file]  (without a file 256 MiB of text are made up)
+#include "../src/line_index.h"
+#include "../src/mapped_file.h"
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// the splitter Document used before the line index existed
+static std::vector<std::string> splitNewLine(const std::string &base) {
+  std::stringstream stream;
+  stream.str("");
+  stream.clear();
+  std::vector<std::string> final;
+  for (auto c = base.begin(); c != base.end(); c++) {
+    const char e = *c;
+    if (e == '\n') {
+      final.push_back(stream.str());
+      stream.str("");
+      stream.clear();
+    } else {
+      stream << e;
+    }
+  }
+  final.push_back(stream.str());
+  return final;
+}
+
+static std::string makeText(size_t size) {
+  std::mt19937 rng(42);
+  std::string text;
+  text.reserve(size);
+  while (text.size() < size) {
+    size_t length = rng() % 120;
+    for (size_t i = 0; i < length; i++)
+      text += (char)('a' + rng() % 26);
+    text += rng() % 8 ? "\n" : "\r\n";
+  }
+  return text;
+}
+
+static void run(const char *name, size_t bytes, int rounds,
+                const std::function<size_t()> &fn) {
+  double best = 0;
+  size_t lines = 0;
+  for (int i = 0; i < rounds; i++) {
+    auto start = std::chrono::steady_clock::now();
+    lines = fn();
+    std::chrono::duration<double> took =
+        std::chrono::steady_clock::now() - start;
+    double rate = bytes / took.count() / 1e9;
+    if (rate > best)
+      best = rate;
+  }
+  std::cout << name << ": " << best << " GB/s (" << lines << " lines)\n";
+}
+
+int main(int argc, char **argv) {
+  std::string owned;
+  std::shared_ptr<MappedFile> mapped;
+  const char *data;
+  size_t size;
+  if (argc >= 2) {
+    mapped = MappedFile::open(argv[1]);
+    if (!mapped) {
+      std::cerr << "failed to map " << argv[1] << "\n";
+      return 1;
+    }
+    data = mapped->data();
+    size = mapped->size();
+  } else {
+    owned = makeText(256 * 1024 * 1024);
+    data = owned.data();
+    size = owned.size();
+  }
+  std::cout << "input: " << size / (1024.0 * 1024.0) << " MiB\n";
+
+  std::string copy(data, size);
+  run("splitNewLine (old)", size, 1,
+      [&]() { return splitNewLine(copy).size(); });
+  run("memchr", size, 5, [&]() {
+    size_t count = 1;
+    const char *current = data;
+    const char *end = data + size;
+    while (
+        (current = (const char *)memchr(current, '\n', end - current))) {
+      current++;
+      count++;
+    }
+    return count;
+  });
+  run("LineIndex::build, 1 thread", size, 5,
+      [&]() { return LineIndex::build(data, size, 1).size(); });
+  run("LineIndex::build, all threads", size, 5,
+      [&]() { return LineIndex::build(data, size).size(); });
+  return 0;
+}
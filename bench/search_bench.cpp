@@ -0,0 +1,188 @@
+// Throughput of TextSearch and RegexSearch against the searches Document
+// used before them.
+// usage: search_bench [needle] [pattern]  (100 MiB of text are made up, and
+// searched once more from a file as Document loads one)
+#include "../src/regex_search.h"
+#include "../src/text_search.h"
+#include "../src/u8String.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+static std::vector<std::u16string> makeLines(size_t size) {
+  std::mt19937 rng(42);
+  static const char *words[] = {"lorem", "ipsum", "dolor", "sit",  "amet",
+                                "Error", "value", "index", "line", "search"};
+  std::vector<std::u16string> lines;
+  size_t total = 0;
+  while (total < size) {
+    std::u16string line;
+    size_t count = rng() % 16;
+    for (size_t i = 0; i < count; i++) {
+      line += create(words[rng() % 10]);
+      line += u' ';
+    }
+    total += line.length() + 1;
+    lines.push_back(std::move(line));
+  }
+  return lines;
+}
+
+static void run(const char *name, size_t bytes, int rounds,
+                const std::function<size_t()> &fn) {
+  double best = 0;
+  size_t matches = 0;
+  for (int i = 0; i < rounds; i++) {
+    auto start = std::chrono::steady_clock::now();
+    matches = fn();
+    std::chrono::duration<double> took =
+        std::chrono::steady_clock::now() - start;
+    double rate = bytes / took.count() / 1e9;
+    if (rate > best)
+      best = rate;
+  }
+  std::cout << name << ": " << best << " GB/s (" << matches << " matches)\n";
+}
+
+static size_t countAll(const LineBuffer &buffer, const TextSearch &search) {
+  size_t count = 0;
+  size_t line = 0;
+  size_t column = 0;
+  while (search.find(buffer, line, column)) {
+    count++;
+    column++;
+  }
+  return count;
+}
+
+// the walk TextSearch made before spans were searched whole, a line at a
+// time
+static size_t countByLine(const LineBuffer &buffer, const TextSearch &search) {
+  size_t count = 0;
+  buffer.forEach([&](size_t, const std::u16string &line) {
+    for (size_t at = search.find(line.data(), line.length(), 0);
+         at != std::u16string::npos;
+         at = search.find(line.data(), line.length(), at + 1))
+      count++;
+    return true;
+  });
+  return count;
+}
+
+static size_t countAll(const LineBuffer &buffer, RegexSearch search) {
+  size_t count = 0;
+  size_t line = 0;
+  size_t column = 0;
+  RegexMatch match;
+  while (search.find(buffer, line, column, buffer.size(), match)) {
+    count++;
+    column = match.end() > match.start() ? match.end() : match.end() + 1;
+  }
+  return count;
+}
+
+int main(int argc, char **argv) {
+  std::u16string needle = create(argc >= 2 ? argv[1] : "Error value");
+  std::string pattern = argc >= 3 ? argv[2] : "Error +(v\\w*)";
+  auto lines = makeLines(100 * 1024 * 1024);
+  size_t bytes = 0;
+  for (auto &line : lines)
+    bytes += (line.length() + 1) * sizeof(char16_t);
+  LineBuffer buffer;
+  buffer.assign(lines);
+  std::cout << "input: " << bytes / (1024.0 * 1024.0) << " MiB of UTF-16, "
+            << lines.size() << " lines\n";
+
+  // the loop Document::search ran before, a copy and a find per line
+  run("copy + std::u16string::find (old)", bytes, 3, [&]() {
+    size_t count = 0;
+    for (size_t x = 0; x < lines.size(); x++) {
+      auto line = lines[x];
+      for (size_t at = line.find(needle); at != std::u16string::npos;
+           at = line.find(needle, at + 1))
+        count++;
+    }
+    return count;
+  });
+  run("lowercase copy + find, ignoring case (old)", bytes, 3, [&]() {
+    std::u16string folded = needle;
+    for (auto &c : folded)
+      c = TextSearch::fold(c);
+    size_t count = 0;
+    for (size_t x = 0; x < lines.size(); x++) {
+      auto line = lines[x];
+      for (auto &c : line)
+        c = TextSearch::fold(c);
+      for (size_t at = line.find(folded); at != std::u16string::npos;
+           at = line.find(folded, at + 1))
+        count++;
+    }
+    return count;
+  });
+  run("TextSearch", bytes, 3,
+      [&]() { return countAll(buffer, TextSearch(needle)); });
+  SearchOptions options;
+  options.ignoreCase = true;
+  run("TextSearch, ignoring case", bytes, 3,
+      [&]() { return countAll(buffer, TextSearch(needle, options)); });
+  options.wholeWord = true;
+  run("TextSearch, ignoring case, whole words", bytes, 3,
+      [&]() { return countAll(buffer, TextSearch(needle, options)); });
+  run("TextSearch, across lines", bytes, 3, [&]() {
+    return countAll(buffer, TextSearch(u"search \nlorem", SearchOptions()));
+  });
+
+  // lines of a file stay in untouched spans of the mapping
+  const char *path = "search_bench.txt";
+  {
+    std::ofstream file(path, std::ios::binary);
+    for (size_t i = 0; i < lines.size(); i++)
+      file << convert_str(lines[i]) << (i + 1 < lines.size() ? "\n" : "");
+  }
+  LineBuffer mapped;
+  mapped.assign(LineSource::open(path));
+  run("line by line over a file (before)", bytes, 3,
+      [&]() { return countByLine(mapped, TextSearch(needle)); });
+  run("TextSearch over a file", bytes, 3,
+      [&]() { return countAll(mapped, TextSearch(needle)); });
+  options = SearchOptions();
+  options.ignoreCase = true;
+  run("TextSearch over a file, ignoring case", bytes, 3,
+      [&]() { return countAll(mapped, TextSearch(needle, options)); });
+  mapped.clear();
+  std::remove(path);
+
+  // std::regex is only given the first tenth, it would take minutes
+  std::vector<std::string> utf8;
+  size_t utf8Bytes = 0;
+  for (size_t i = 0; i < lines.size() / 10; i++) {
+    utf8.push_back(convert_str(lines[i]));
+    utf8Bytes += (lines[i].length() + 1) * sizeof(char16_t);
+  }
+  run("std::regex on UTF-8 lines, a tenth", utf8Bytes, 1, [&]() {
+    std::regex regex(pattern);
+    size_t count = 0;
+    for (auto &line : utf8)
+      count += std::distance(
+          std::sregex_iterator(line.begin(), line.end(), regex),
+          std::sregex_iterator());
+    return count;
+  });
+  run("RegexSearch", bytes, 3,
+      [&]() { return countAll(buffer, RegexSearch(create(pattern))); });
+  options = SearchOptions();
+  options.ignoreCase = true;
+  run("RegexSearch, ignoring case", bytes, 3, [&]() {
+    return countAll(buffer, RegexSearch(create(pattern), options));
+  });
+  run("RegexSearch, no literal prefix", bytes, 3, [&]() {
+    return countAll(buffer, RegexSearch(u"(Error|index) +v\\w*"));
+  });
+  return 0;
+}
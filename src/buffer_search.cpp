@@ -0,0 +1,101 @@
+#include "buffer_search.h"
+#include <algorithm>
+
+// a search stops once it found this many
+static const size_t MAX_MATCHES = 64 * 1024;
+// the cancel flag is read every this many lines
+static const size_t LINES_PER_CHECK = 256;
+// characters of the line kept before a match and in total
+static const size_t PREVIEW_BEFORE = 24;
+static const size_t PREVIEW_LENGTH = 96;
+
+BufferSearch::BufferSearch(
+    ThreadPool &pool, std::vector<std::shared_ptr<const LineSnapshot>> buffers,
+    const std::u16string &term, SearchOptions options,
+    std::function<void()> notify)
+    : _shared(std::make_shared<Shared>()) {
+  _shared->buffers = std::move(buffers);
+  _shared->notify = std::move(notify);
+  if (options.regex)
+    _shared->regex = std::make_unique<RegexSearch>(term, options);
+  else
+    _shared->literal = std::make_unique<TextSearch>(term, options);
+  for (size_t b = 0; b < _shared->buffers.size(); b++) {
+    for (size_t p = 0; p < _shared->buffers[b]->parts().size(); p++) {
+      _shared->tasks.emplace_back();
+      _shared->tasks.back().buffer = b;
+      _shared->tasks.back().part = p;
+    }
+  }
+  // the tasks hold on to the shared state, it outlives this object if need be
+  std::shared_ptr<Shared> shared = _shared;
+  for (auto &task : _shared->tasks)
+    pool.submit([shared, &task] { run(*shared, task); });
+}
+
+BufferSearch::~BufferSearch() { _shared->cancel = true; }
+
+std::u16string matchPreview(const std::u16string &line, size_t column) {
+  size_t start = column > PREVIEW_BEFORE ? column - PREVIEW_BEFORE : 0;
+  while (start < column && (line[start] == u' ' || line[start] == u'\t'))
+    start++;
+  return line.substr(start, PREVIEW_LENGTH);
+}
+
+void BufferSearch::run(Shared &shared, Task &task) {
+  // the DFA cache of a regex is not shared between threads
+  std::unique_ptr<RegexSearch> regex;
+  if (shared.regex)
+    regex = std::make_unique<RegexSearch>(*shared.regex);
+  RegexMatch match;
+  auto &part = shared.buffers[task.buffer]->parts()[task.part];
+  part.forEach([&](size_t index, const std::u16string &line) {
+    if (index % LINES_PER_CHECK == 0 && shared.cancel)
+      return false;
+    task.lines = index + 1;
+    size_t from = 0;
+    while (from <= line.length()) {
+      size_t start, end;
+      if (regex) {
+        if (!regex->find(line.data(), line.length(), from, match))
+          break;
+        start = match.start();
+        end = match.end();
+      } else {
+        start = shared.literal->find(line.data(), line.length(), from);
+        if (start == std::u16string::npos)
+          break;
+        end = start + shared.literal->length();
+      }
+      if (shared.found++ >= MAX_MATCHES) {
+        task.truncated = true;
+        return false;
+      }
+      task.matches.push_back(
+          {task.buffer, index, start, end - start, matchPreview(line, start)});
+      from = end > start ? end : end + 1;
+    }
+    return true;
+  });
+  task.done.store(true, std::memory_order_release);
+  if (shared.notify)
+    shared.notify();
+}
+
+bool BufferSearch::take(std::vector<BufferMatch> &out) {
+  auto &tasks = _shared->tasks;
+  while (!isDone() && tasks[_taken].done.load(std::memory_order_acquire)) {
+    Task &task = tasks[_taken];
+    if (_taken && tasks[_taken - 1].buffer != task.buffer)
+      _firstLine = 0;
+    for (auto &match : task.matches) {
+      out.push_back(std::move(match));
+      out.back().line += _firstLine;
+    }
+    task.matches = std::vector<BufferMatch>();
+    _firstLine += task.lines;
+    _full = task.truncated;
+    _taken++;
+  }
+  return isDone();
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "line_snapshot.h"
+#include "regex_search.h"
+#include "text_search.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct BufferMatch {
+  // index of the snapshot the match is in
+  size_t buffer;
+  size_t line;
+  size_t column;
+  size_t length;
+  // the line around the match, cut to a few dozen characters
+  std::u16string preview;
+};
+
+// the part of line around a match at column that a list of results shows
+std::u16string matchPreview(const std::u16string &line, size_t column);
+
+/*
+  Searches many buffers at once on a thread pool. Each buffer is read from a
+  LineSnapshot, so they can be edited while the search runs and the results
+  are positions in the lines as they were when it started. Every part of a
+  snapshot is a task of its own, take() hands the results of finished tasks
+  over in buffer and line order, so the list of results only grows at its
+  end while the search goes on.
+  Matches do not overlap and never span lines, an empty match moves on by a
+  character. The term has to be a valid regex or a non empty single line
+  literal. Destroying the search cancels what is left of it, running tasks
+  stop at their next check and nothing waits for them.
+*/
+class BufferSearch {
+  struct Task {
+    size_t buffer;
+    size_t part;
+    // lines relative to the part
+    std::vector<BufferMatch> matches;
+    size_t lines = 0;
+    bool truncated = false;
+    std::atomic<bool> done{false};
+  };
+  struct Shared {
+    std::vector<std::shared_ptr<const LineSnapshot>> buffers;
+    std::unique_ptr<TextSearch> literal;
+    std::unique_ptr<RegexSearch> regex;
+    std::deque<Task> tasks;
+    std::atomic<bool> cancel{false};
+    std::atomic<size_t> found{0};
+    std::function<void()> notify;
+  };
+
+  std::shared_ptr<Shared> _shared;
+  // tasks handed over by take() and where the next one starts in its buffer
+  size_t _taken = 0;
+  size_t _firstLine = 0;
+  bool _full = false;
+
+public:
+  // notify is called from the pool whenever a task finished
+  BufferSearch(ThreadPool &pool,
+               std::vector<std::shared_ptr<const LineSnapshot>> buffers,
+               const std::u16string &term, SearchOptions options,
+               std::function<void()> notify);
+  BufferSearch(const BufferSearch &) = delete;
+  BufferSearch &operator=(const BufferSearch &) = delete;
+  ~BufferSearch();
+
+  // Appends the matches found since the last call that all earlier ones are
+  // known for, true once there is nothing left to come.
+  bool take(std::vector<BufferMatch> &out);
+  bool isDone() const { return _full || _taken == _shared->tasks.size(); }
+  // too many matches to keep, the search stopped early
+  bool isFull() const { return _full; }
+
+private:
+  static void run(Shared &shared, Task &task);
+};
@@ -0,0 +1,144 @@
+#include "bulk_replace.h"
+#include "regex_search.h"
+#include <algorithm>
+#include <iterator>
+#include <thread>
+
+// ranges smaller than this are searched on the calling thread
+static const size_t LINES_PER_THREAD = 64 * 1024;
+
+// what with replace, every match has the same length
+struct LiteralMatcher {
+  const TextSearch &search;
+  const std::u16string &what;
+  const std::u16string &replace;
+
+  bool find(const std::u16string &line, size_t from, size_t &start,
+            size_t &end) {
+    start = search.find(line.data(), line.length(), from);
+    end = start + what.length();
+    return start != std::u16string::npos;
+  }
+  void append(std::u16string &text, const std::u16string &) {
+    text += replace;
+  }
+  // the lengths are known without keeping them per match
+  void record(Replacements &, size_t, size_t) {}
+};
+
+// a copy of the regex per thread, its DFA cache is not shared
+struct RegexMatcher {
+  RegexSearch search;
+  const std::u16string &replace;
+  RegexMatch match;
+
+  bool find(const std::u16string &line, size_t from, size_t &start,
+            size_t &end) {
+    if (!search.find(line.data(), line.length(), from, match))
+      return false;
+    start = match.start();
+    end = match.end();
+    return true;
+  }
+  void append(std::u16string &text, const std::u16string &line) {
+    text += search.expand(replace, line.data(), match);
+  }
+  void record(Replacements &out, size_t length, size_t replaced) {
+    out.lengths.push_back(length);
+    out.replacedLengths.push_back(replaced);
+  }
+};
+
+template <typename Matcher>
+static void searchRange(const LineBuffer &lines, size_t from, size_t to,
+                        size_t firstColumn, Matcher matcher,
+                        Replacements &out) {
+  lines.forEach(from, to, [&](size_t index, const std::u16string &line) {
+    size_t start = index == from ? firstColumn : 0;
+    size_t where, end;
+    if (start > line.length() || !matcher.find(line, start, where, end))
+      return true;
+    std::u16string text;
+    text.reserve(line.length());
+    size_t copied = 0;
+    uint32_t count = 0;
+    do {
+      out.columns.push_back(where);
+      count++;
+      text.append(line, copied, where - copied);
+      size_t before = text.length();
+      matcher.append(text, line);
+      matcher.record(out, end - where, text.length() - before);
+      copied = end;
+      // an empty match moves on by a character, it would be found again
+      start = end > where ? end : end + 1;
+    } while (start <= line.length() && matcher.find(line, start, where, end));
+    text.append(line, copied, std::u16string::npos);
+    out.lines.emplace_back(index, std::move(text));
+    out.counts.push_back(count);
+    return true;
+  });
+}
+
+template <typename Matcher>
+static Replacements searchAll(const LineBuffer &lines, size_t from, size_t to,
+                              size_t firstColumn, const Matcher &matcher) {
+  Replacements result;
+  size_t count = to - from;
+  size_t threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+  threads =
+      std::min(threads, (count + LINES_PER_THREAD - 1) / LINES_PER_THREAD);
+  if (threads <= 1) {
+    searchRange(lines, from, to, firstColumn, matcher, result);
+    return result;
+  }
+  // every chunk collects its own rewrites, they are joined in line order
+  std::vector<Replacements> chunks(threads);
+  std::vector<std::thread> workers;
+  size_t step = (count + threads - 1) / threads;
+  for (size_t i = 0; i < threads; i++) {
+    size_t start = from + i * step;
+    size_t end = std::min(to, start + step);
+    workers.emplace_back([&, i, start, end]() {
+      searchRange(lines, start, end, start == from ? firstColumn : 0, matcher,
+                  chunks[i]);
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+  for (auto &chunk : chunks) {
+    std::move(chunk.lines.begin(), chunk.lines.end(),
+              std::back_inserter(result.lines));
+    result.counts.insert(result.counts.end(), chunk.counts.begin(),
+                         chunk.counts.end());
+    result.columns.insert(result.columns.end(), chunk.columns.begin(),
+                          chunk.columns.end());
+    result.lengths.insert(result.lengths.end(), chunk.lengths.begin(),
+                          chunk.lengths.end());
+    result.replacedLengths.insert(result.replacedLengths.end(),
+                                  chunk.replacedLengths.begin(),
+                                  chunk.replacedLengths.end());
+  }
+  return result;
+}
+
+Replacements findReplacements(const LineBuffer &lines, size_t from, size_t to,
+                              size_t firstColumn, const std::u16string &what,
+                              const std::u16string &replace,
+                              SearchOptions options) {
+  if (what.empty() || from >= to)
+    return Replacements();
+  if (options.regex) {
+    RegexSearch search(what, options);
+    if (!search.isValid())
+      return Replacements();
+    return searchAll(lines, from, to, firstColumn,
+                     RegexMatcher{search, replace, RegexMatch()});
+  }
+  TextSearch search(what, options);
+  // a replacement stays on its line
+  if (search.isMultiLine())
+    return Replacements();
+  return searchAll(lines, from, to, firstColumn,
+                   LiteralMatcher{search, what, replace});
+}
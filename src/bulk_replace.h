@@ -0,0 +1,30 @@
+#pragma once
+#include "line_buffer.h"
+#include "text_search.h"
+#include <string>
+#include <vector>
+
+struct Replacements {
+  // the lines that change in order, with every match replaced
+  std::vector<std::pair<size_t, std::u16string>> lines;
+  // matches on each of those lines
+  std::vector<uint32_t> counts;
+  // where the matches start in the original lines, all lines back to back
+  std::vector<size_t> columns;
+  // for a regex, how long each match was and its replacement is, in the
+  // same order as columns, a literal always replaces what with replace
+  std::vector<size_t> lengths;
+  std::vector<size_t> replacedLengths;
+};
+
+/*
+  Finds every non-overlapping match of what in lines [from, to), the first
+  line searched from column firstColumn on, and builds the lines with every
+  match replaced. Large ranges are split into chunks searched on their own
+  threads, the buffer is only read. A regex replacement can refer to groups
+  as RegexSearch::expand describes, matches never span lines.
+*/
+Replacements findReplacements(const LineBuffer &lines, size_t from, size_t to,
+                              size_t firstColumn, const std::u16string &what,
+                              const std::u16string &replace,
+                              SearchOptions options = SearchOptions());
@@ -0,0 +1,205 @@
+#include "change_monitor.h"
+#include <filesystem>
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+ChangeMonitor::ChangeMonitor(std::function<void()> notify)
+    : _notify(notify) {
+#ifdef __linux__
+  if (_watcher.isValid() && pipe(_wake) == 0)
+    _thread = std::thread(&ChangeMonitor::run, this);
+#endif
+}
+
+ChangeMonitor::~ChangeMonitor() {
+#ifdef __linux__
+  if (_thread.joinable()) {
+    ssize_t written = ::write(_wake[1], "x", 1);
+    (void)written;
+    _thread.join();
+  }
+  if (_wake[0] >= 0) {
+    close(_wake[0]);
+    close(_wake[1]);
+  }
+#endif
+}
+
+void ChangeMonitor::setFiles(const std::vector<std::string> &files) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  bool gone = false;
+  for (auto &entry : _directories)
+    gone |= entry.second.watch < 0;
+  // the directories that could not be watched may be there by now
+  if (!isActive() || (files == _files && !gone))
+    return;
+  _files = files;
+  std::unordered_map<std::string, Directory> directories;
+  for (auto &file : files) {
+    auto path = std::filesystem::absolute(file).lexically_normal();
+    auto &directory = directories[path.parent_path().generic_string()];
+    directory.entries[path.filename().string()].push_back(file);
+  }
+  for (auto &entry : directories) {
+    auto known = _directories.find(entry.first);
+    if (known != _directories.end() && known->second.watch >= 0) {
+      entry.second.watch = known->second.watch;
+      continue;
+    }
+    entry.second.watch = _watcher.add(
+        entry.first,
+        FileWatcher::MODIFIED | FileWatcher::ENTRIES | FileWatcher::GONE);
+    if (entry.second.watch >= 0)
+      _watches[entry.second.watch] = entry.first;
+  }
+  for (auto &entry : _directories) {
+    if (entry.second.watch < 0 || directories.count(entry.first))
+      continue;
+    _watcher.remove(entry.second.watch);
+    _watches.erase(entry.second.watch);
+  }
+  _directories = std::move(directories);
+  dropParents();
+  for (auto &entry : _directories) {
+    if (entry.second.watch < 0)
+      waitFor(entry.first);
+  }
+}
+
+void ChangeMonitor::waitFor(const std::string &path) {
+  std::string parent =
+      std::filesystem::path(path).parent_path().generic_string();
+  // the entries of a watched directory are reported already
+  auto known = _directories.find(parent);
+  if (known != _directories.end() && known->second.watch >= 0)
+    return;
+  int watch = _watcher.add(parent, FileWatcher::ENTRIES | FileWatcher::GONE);
+  if (watch >= 0)
+    _parents[watch] = parent;
+}
+
+bool ChangeMonitor::rewatch(const std::string &path) {
+  auto directory = _directories.find(path);
+  if (directory == _directories.end() || directory->second.watch >= 0)
+    return false;
+  int watch = _watcher.add(
+      path, FileWatcher::MODIFIED | FileWatcher::ENTRIES | FileWatcher::GONE);
+  if (watch < 0)
+    return false;
+  directory->second.watch = watch;
+  _watches[watch] = path;
+  // its files may have come back with it
+  changeAll(directory->second);
+  return true;
+}
+
+void ChangeMonitor::dropParentsIfDone() {
+  for (auto &entry : _directories) {
+    if (entry.second.watch < 0)
+      return;
+  }
+  dropParents();
+}
+
+void ChangeMonitor::dropParents() {
+  for (auto &parent : _parents) {
+    // watching a directory of files in the meantime took the watch over
+    if (!_watches.count(parent.first))
+      _watcher.remove(parent.first);
+  }
+  _parents.clear();
+}
+
+bool ChangeMonitor::take(std::vector<std::string> &changed) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _signalled = false;
+  if (_changed.empty())
+    return false;
+  changed.assign(_changed.begin(), _changed.end());
+  _changed.clear();
+  return true;
+}
+
+void ChangeMonitor::changeAll(const Directory &directory) {
+  for (auto &entry : directory.entries)
+    _changed.insert(entry.second.begin(), entry.second.end());
+}
+
+void ChangeMonitor::handle(const std::vector<WatchEvent> &events) {
+  bool wake;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto &event : events) {
+      if (event.watch < 0) {
+        for (auto &entry : _directories)
+          changeAll(entry.second);
+        continue;
+      }
+      auto parent = _parents.find(event.watch);
+      auto watched = _watches.find(event.watch);
+      const std::string *path = watched != _watches.end() ? &watched->second
+                                : parent != _parents.end() ? &parent->second
+                                                           : nullptr;
+      if (!path)
+        continue;
+      if (!event.name.empty() &&
+          rewatch((std::filesystem::path(*path) / event.name)
+                      .generic_string())) {
+        dropParentsIfDone();
+        continue;
+      }
+      if (watched == _watches.end()) {
+        // a parent gone too is left to the next setFiles
+        if (event.name.empty() && (event.events & FileWatcher::GONE))
+          _parents.erase(parent);
+        continue;
+      }
+      auto &directory = _directories[watched->second];
+      if (event.name.empty()) {
+        // the directory itself went away and its files with it
+        if (event.events & FileWatcher::GONE) {
+          std::string gone = watched->second;
+          changeAll(directory);
+          directory.watch = -1;
+          _watches.erase(watched);
+          waitFor(gone);
+          // it may have been created again before the parent was watched
+          if (rewatch(gone))
+            dropParentsIfDone();
+        }
+        continue;
+      }
+      auto entry = directory.entries.find(event.name);
+      if (entry != directory.entries.end())
+        _changed.insert(entry->second.begin(), entry->second.end());
+    }
+    wake = !_changed.empty() && !_signalled;
+    if (wake)
+      _signalled = true;
+  }
+  if (wake && _notify)
+    _notify();
+}
+
+void ChangeMonitor::run() {
+#ifdef __linux__
+  std::vector<WatchEvent> events;
+  while (true) {
+    struct pollfd fds[2] = {{_watcher.fd(), POLLIN, 0},
+                            {_wake[0], POLLIN, 0}};
+    if (::poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (fds[1].revents)
+      break;
+    events.clear();
+    if (_watcher.read(events))
+      handle(events);
+  }
+#endif
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "file_watcher.h"
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+  Tells which of a set of files changed on disk without anyone looking at
+  them. A worker thread waits on inotify and calls notify when changes
+  are waiting to be taken. The directories holding the files are watched
+  rather than the files, so a file replaced by a rename on save is seen
+  too. A directory that goes away is watched again once it is back, its
+  parent tells when that is. A change may also be the editor's own save,
+  callers compare what they know about the file before acting on one.
+  Without inotify isActive() is false and callers have to look at the
+  files themselves.
+*/
+class ChangeMonitor {
+  struct Directory {
+    // -1 while the directory can't be watched
+    int watch;
+    // the paths given for every entry of the directory
+    std::unordered_map<std::string, std::vector<std::string>> entries;
+  };
+
+  FileWatcher _watcher;
+  std::function<void()> _notify;
+  std::thread _thread;
+#ifdef __linux__
+  int _wake[2] = {-1, -1};
+#endif
+
+  std::mutex _mutex;
+  std::vector<std::string> _files;
+  std::unordered_map<std::string, Directory> _directories;
+  std::unordered_map<int, std::string> _watches;
+  // the parents watched only to see gone directories come back, by watch
+  std::unordered_map<int, std::string> _parents;
+  std::unordered_set<std::string> _changed;
+  bool _signalled = false;
+
+public:
+  ChangeMonitor(std::function<void()> notify);
+  ChangeMonitor(const ChangeMonitor &) = delete;
+  ChangeMonitor &operator=(const ChangeMonitor &) = delete;
+  ~ChangeMonitor();
+
+  bool isActive() const { return _thread.joinable(); }
+  // the files to report changes of from now on, replacing the ones before
+  void setFiles(const std::vector<std::string> &files);
+  // Moves the files changed since the last call into changed, as they were
+  // given to setFiles.
+  bool take(std::vector<std::string> &changed);
+
+private:
+  void run();
+  void handle(const std::vector<WatchEvent> &events);
+  void changeAll(const Directory &directory);
+  // watches the parent of a gone directory for it to be created again
+  void waitFor(const std::string &path);
+  // watches path again if it is a gone directory, true if it was
+  bool rewatch(const std::string &path);
+  void dropParents();
+  // drops them once no directory is gone any more
+  void dropParentsIfDone();
+};
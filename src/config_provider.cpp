@@ -1,5 +1,6 @@
 #include "config_provider.h"
 #include "utils.h"
+#include <algorithm>
 #include <iostream>
 
 Provider::Provider() {
@@ -29,53 +30,7 @@ Provider::Provider() {
 }
 
 std::string Provider::getBranchName(std::string path) {
-  std::string asPath =
-      std::filesystem::path(path).parent_path().generic_string();
-  const char *as_cstr = asPath.c_str();
-  std::string branch = "";
-#ifdef _WIN32
-  std::string command = "cd " + asPath + " && git branch";
-  FILE *pipe = _popen(command.c_str(), "r");
-  if (pipe == NULL)
-    return branch;
-  char buffer[1024];
-  while (fgets(buffer, sizeof buffer, pipe) != NULL) {
-    branch += buffer;
-  }
-  _pclose(pipe);
-#else
-  int fd[2], pid;
-  pipe(fd);
-  pid = fork();
-  if (pid == 0) {
-    close(1);
-    dup(fd[1]);
-    close(0);
-    close(2);
-    close(fd[0]);
-    close(fd[1]);
-    const char *args[] = {"git", "branch", nullptr};
-    chdir(as_cstr);
-    execvp("git", static_cast<char *const *>((void *)args));
-    exit(errno);
-  } else {
-    close(fd[1]);
-    while (true) {
-      char buffer[1024];
-      int received = read(fd[0], buffer, 1024);
-      if (received == 0)
-        break;
-      branch += std::string(buffer, received);
-    }
-    close(fd[0]);
-    kill(pid, SIGTERM);
-    wait(&pid);
-  }
-#endif
-  if (!branch.length())
-    return branch;
-  std::string finalBranch = branch.substr(branch.find("* ") + 2);
-  return finalBranch.substr(0, finalBranch.find("\n"));
+  return branches.branchOf(path);
 }
 
 std::string Provider::getCwdFormatted() {
@@ -123,6 +78,17 @@ bool Provider::getBoolOrDefault(json o, const std::string entry, bool def) {
   return (bool)e;
 }
 
+size_t Provider::getSizeOrDefault(json o, const std::string entry,
+                                  size_t def) {
+  if (!o.contains(entry))
+    return def;
+  json e = o[entry];
+  if (!e.is_number_unsigned())
+    return def;
+
+  return (size_t)e;
+}
+
 std::string Provider::getPathOrDefault(json o, const std::string entry,
                                        std::string def) {
   if (!o.contains(entry))
@@ -207,6 +173,8 @@ void Provider::parseConfig(json *configRoot) {
                                              colors.highlight_color);
     colors.selection_color = getVecOrDefault(configColors, "selection_color",
                                              colors.selection_color);
+    colors.search_match_color = getVecOrDefault(
+        configColors, "search_match_color", colors.search_match_color);
     colors.number_color =
         getVecOrDefault(configColors, "number_color", colors.number_color);
     colors.status_color =
@@ -219,6 +187,13 @@ void Provider::parseConfig(json *configRoot) {
   fontPath = getPathOrDefault(*configRoot, "font_face", fontPath);
   allowTransparency =
       getBoolOrDefault(*configRoot, "window_transparency", allowTransparency);
+  syncOnSave = getBoolOrDefault(*configRoot, "fsync_on_save", syncOnSave);
+  followMaxLines =
+      getSizeOrDefault(*configRoot, "follow_max_lines", followMaxLines);
+  pagedThresholdMb =
+      getSizeOrDefault(*configRoot, "paged_threshold_mb", pagedThresholdMb);
+  undoMemoryMb = getSizeOrDefault(*configRoot, "undo_memory_mb", undoMemoryMb);
+  trigramIndex = getBoolOrDefault(*configRoot, "trigram_index", trigramIndex);
 }
 
 json Provider::vecToJson(Vec4f value) {
@@ -243,17 +218,32 @@ void Provider::writeConfig() {
   cColors["background_color"] = vecToJson(colors.background_color);
   cColors["highlight_color"] = vecToJson(colors.highlight_color);
   cColors["selection_color"] = vecToJson(colors.selection_color);
+  cColors["search_match_color"] = vecToJson(colors.search_match_color);
   cColors["number_color"] = vecToJson(colors.number_color);
   cColors["status_color"] = vecToJson(colors.status_color);
   cColors["line_number_color"] = vecToJson(colors.line_number_color);
   cColors["minibuffer_color"] = vecToJson(colors.minibuffer_color);
   config["font_face"] = fontPath;
   config["window_transparency"] = allowTransparency;
+  config["fsync_on_save"] = syncOnSave;
+  config["follow_max_lines"] = followMaxLines;
+  config["paged_threshold_mb"] = pagedThresholdMb;
+  config["undo_memory_mb"] = undoMemoryMb;
+  config["trigram_index"] = trigramIndex;
   config["colors"] = cColors;
   const std::string contents = config.dump(2);
   string_to_file(configPath, contents);
 }
 
+std::string Provider::getIndexFolder() {
+  std::filesystem::path *homeDir = getHomeFolder();
+  if (!homeDir)
+    return "";
+  std::string folder = (*homeDir / ".ledit" / "index").generic_string();
+  delete homeDir;
+  return folder;
+}
+
 std::string Provider::getLast() {
   if (!folderEntries.size())
     return "";
@@ -261,9 +251,10 @@ std::string Provider::getLast() {
 }
 
 std::string Provider::getFileToOpen(std::string path, bool reverse) {
-  if (!std::filesystem::exists(path) || !std::filesystem::is_directory(path))
+  auto listing = directories.get(path);
+  if (!listing || listing->empty())
     return "";
-  if (lastProvidedFolder == path) {
+  if (lastProvidedFolder == path && listing == folderListing) {
     offset += reverse ? -1 : 1;
 
     if (offset == folderEntries.size())
@@ -272,12 +263,28 @@ std::string Provider::getFileToOpen(std::string path, bool reverse) {
       offset = folderEntries.size() - 1;
     return folderEntries[offset];
   }
+  // a folder that changed meanwhile goes on next to the entry shown last
+  std::string last = lastProvidedFolder == path ? getLast() : "";
   folderEntries.clear();
-  for (auto const &dir_entry : std::filesystem::directory_iterator{path}) {
-    folderEntries.push_back(dir_entry.path().string());
-  }
+  for (auto const &entry : *listing)
+    folderEntries.push_back(
+        (std::filesystem::path(path) / entry.name).string());
   offset = 0;
+  if (last.length()) {
+    auto next =
+        std::lower_bound(folderEntries.begin(), folderEntries.end(), last);
+    offset = next - folderEntries.begin();
+    if (next != folderEntries.end() && *next == last)
+      offset += reverse ? -1 : 1;
+    else if (reverse)
+      offset--;
+    if (offset >= (int)folderEntries.size())
+      offset = 0;
+    else if (offset < 0)
+      offset = folderEntries.size() - 1;
+  }
   lastProvidedFolder = path;
+  folderListing = listing;
   return folderEntries[offset];
 }
 
@@ -4,6 +4,8 @@
 #include <filesystem>
 // #include <iostream>
 #include "la.h"
+#include "directory_cache.h"
+#include "git_branches.h"
 // #include "utils.h"
 #include "../third-party/json/json.hpp"
 // #ifndef _WIN32
@@ -33,6 +35,7 @@ struct EditorColors {
   Vec4f background_color = vec4f(0, 0, 0, 1.0);
   Vec4f highlight_color = vec4f(0.1, 0.1, 0.1, 1.0);
   Vec4f selection_color = vec4f(0.7, 0.7, 0.7, 0.6);
+  Vec4f search_match_color = vec4f(0.9, 0.6, 0.1, 0.35);
   Vec4f status_color = vec4f(0.8, 0.8, 1.0, 0.9);
   Vec4f minibuffer_color = vec4fs(1.0);
   Vec4f line_number_color = vec4fs(0.8);
@@ -42,17 +45,34 @@ class Provider {
 public:
   std::string lastProvidedFolder;
   std::vector<std::string> folderEntries;
+  // listings the completions come from and the one folderEntries is of
+  DirectoryCache directories;
+  std::shared_ptr<const DirectoryCache::Listing> folderListing;
+  // the branch of every repository a file was opened from
+  GitBranches branches;
   int offset = 0;
   EditorColors colors;
   std::string fontPath = getDefaultFontPath();
   std::string configPath;
   bool allowTransparency = false;
+  bool syncOnSave = false;
+  // lines kept while following a file, 0 keeps everything
+  size_t followMaxLines = 0;
+  // files from this size on open as a read-only paged view, 0 never pages
+  size_t pagedThresholdMb = 2048;
+  // memory the undo history of a buffer may use
+  size_t undoMemoryMb = 64;
+  // project grep narrows the files down with a stored trigram index
+  bool trigramIndex = false;
 
   Provider();
   std::string getBranchName(std::string path);
   std::string getCwdFormatted();
+  // where trigram indexes are stored, empty without a home directory
+  std::string getIndexFolder();
   Vec4f getVecOrDefault(json o, const std::string entry, Vec4f def);
   bool getBoolOrDefault(json o, const std::string entry, bool def);
+  size_t getSizeOrDefault(json o, const std::string entry, size_t def);
   std::string getPathOrDefault(json o, const std::string entry,
                                std::string def);
   const std::string getDefaultFontPath();
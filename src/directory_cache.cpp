@@ -0,0 +1,181 @@
+#include "directory_cache.h"
+#include <algorithm>
+
+// how long a listing is used when its directory can't be watched
+static const auto UNWATCHED_LIFETIME = std::chrono::seconds(2);
+// subdirectories read ahead when a directory is visited
+static const size_t PREFETCH_DIRECTORIES = 32;
+
+static std::string keyOf(const std::string &path) {
+  std::error_code error;
+  std::string key = std::filesystem::absolute(path, error)
+                        .lexically_normal()
+                        .generic_string();
+  while (key.length() > 1 && key.back() == '/')
+    key.pop_back();
+  return key;
+}
+
+static std::shared_ptr<DirectoryCache::Listing>
+readDirectory(const std::string &path) {
+  std::error_code error;
+  std::filesystem::directory_iterator it(path, error);
+  if (error)
+    return nullptr;
+  auto listing = std::make_shared<DirectoryCache::Listing>();
+  for (; it != std::filesystem::directory_iterator(); it.increment(error)) {
+    // the type comes with the entry on most systems, it takes no stat
+    std::error_code typeError;
+    listing->push_back({it->path().filename().string(),
+                        it->symlink_status(typeError).type()});
+  }
+  std::sort(listing->begin(), listing->end(),
+            [](const DirectoryEntry &a, const DirectoryEntry &b) {
+              return a.name < b.name;
+            });
+  return listing;
+}
+
+std::shared_ptr<const DirectoryCache::Listing>
+DirectoryCache::get(const std::string &path) {
+  if (path.empty())
+    return nullptr;
+  std::string key = keyOf(path);
+  bool firstVisit;
+  auto listing = fetch(key, true, firstVisit);
+  if (!listing || !firstVisit)
+    return listing;
+  std::filesystem::path directory(key);
+  if (directory.has_parent_path() && directory.parent_path() != directory)
+    queue(directory.parent_path().generic_string());
+  size_t queued = 0;
+  for (auto &entry : *listing) {
+    if (queued == PREFETCH_DIRECTORIES)
+      break;
+    if (entry.type != std::filesystem::file_type::directory)
+      continue;
+    queue((directory / entry.name).generic_string());
+    queued++;
+  }
+  return listing;
+}
+
+void DirectoryCache::prefetch(const std::string &path) {
+  if (path.length())
+    queue(keyOf(path));
+}
+
+void DirectoryCache::queue(const std::string &key) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_cache.count(key) || !_queued.insert(key).second)
+      return;
+  }
+  _prefetcher.submit([this, key] {
+    bool firstVisit;
+    fetch(key, false, firstVisit);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _queued.erase(key);
+  });
+}
+
+std::shared_ptr<const DirectoryCache::Listing>
+DirectoryCache::fetch(const std::string &key, bool visit, bool &firstVisit) {
+  firstVisit = false;
+  uint64_t serial;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    invalidate();
+    auto it = _cache.find(key);
+    if (it != _cache.end() && it->second.listing && it->second.watch < 0 &&
+        std::chrono::steady_clock::now() - it->second.listed >
+            UNWATCHED_LIFETIME) {
+      erase(key);
+      it = _cache.end();
+    }
+    if (it == _cache.end()) {
+      evict();
+      // watched before it is read, a change while reading is not missed
+      int watch = _watcher.add(key, FileWatcher::ENTRIES | FileWatcher::GONE);
+      it = _cache.emplace(key, Cached{nullptr, watch, ++_serial, 0, false, {}})
+               .first;
+      if (watch >= 0)
+        _watched.emplace(watch, key);
+    }
+    Cached &cached = it->second;
+    cached.used = ++_clock;
+    if (visit) {
+      firstVisit = !cached.visited;
+      cached.visited = true;
+    }
+    if (cached.listing)
+      return cached.listing;
+    serial = cached.serial;
+  }
+  // a listing in progress on the other thread is not waited for
+  std::shared_ptr<const Listing> listing = readDirectory(key);
+  std::lock_guard<std::mutex> lock(_mutex);
+  invalidate();
+  auto it = _cache.find(key);
+  if (it != _cache.end() && it->second.serial == serial) {
+    if (!listing) {
+      erase(key);
+    } else if (!it->second.listing) {
+      it->second.listing = listing;
+      it->second.listed = std::chrono::steady_clock::now();
+    }
+  }
+  return listing;
+}
+
+void DirectoryCache::invalidate() {
+  std::vector<WatchEvent> events;
+  if (!_watcher.read(events))
+    return;
+  for (auto &event : events) {
+    std::vector<std::string> keys;
+    if (event.watch < 0) {
+      for (auto &entry : _cache)
+        keys.push_back(entry.first);
+    } else {
+      auto range = _watched.equal_range(event.watch);
+      for (auto it = range.first; it != range.second; it++)
+        keys.push_back(it->second);
+    }
+    for (auto &key : keys)
+      erase(key);
+  }
+}
+
+void DirectoryCache::erase(const std::string &key) {
+  auto it = _cache.find(key);
+  if (it == _cache.end())
+    return;
+  int watch = it->second.watch;
+  _cache.erase(it);
+  if (watch < 0)
+    return;
+  auto range = _watched.equal_range(watch);
+  for (auto entry = range.first; entry != range.second; entry++) {
+    if (entry->second == key) {
+      _watched.erase(entry);
+      break;
+    }
+  }
+  // links to one directory share its watch
+  if (!_watched.count(watch))
+    _watcher.remove(watch);
+}
+
+void DirectoryCache::evict() {
+  if (_cache.size() < MAX_DIRECTORIES)
+    return;
+  auto oldest = _cache.end();
+  for (auto it = _cache.begin(); it != _cache.end(); it++) {
+    if (it->second.listing &&
+        (oldest == _cache.end() || it->second.used < oldest->second.used))
+      oldest = it;
+  }
+  if (oldest != _cache.end())
+    erase(oldest->first);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "file_watcher.h"
+#include "thread_pool.h"
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct DirectoryEntry {
+  std::string name;
+  std::filesystem::file_type type;
+};
+
+/*
+  Sorted listings of directories, kept until inotify reports a change to
+  one, so asking again costs no disk access. Without inotify a listing is
+  trusted for a few seconds. Listing a directory a caller asked for
+  queues its parent and subdirectories to be listed on a worker thread,
+  a completion is likely to go there next. Paths are made absolute before
+  they are looked up. Safe to use from several threads.
+*/
+class DirectoryCache {
+public:
+  using Listing = std::vector<DirectoryEntry>;
+
+private:
+  struct Cached {
+    // null while a listing is being made
+    std::shared_ptr<const Listing> listing;
+    int watch;
+    // changes with every new entry, a listing only lands in its own
+    uint64_t serial;
+    uint64_t used;
+    // asked for by a caller, not only prefetched
+    bool visited;
+    std::chrono::steady_clock::time_point listed;
+  };
+
+  FileWatcher _watcher;
+  std::mutex _mutex;
+  std::unordered_map<std::string, Cached> _cache;
+  std::unordered_multimap<int, std::string> _watched;
+  std::unordered_set<std::string> _queued;
+  uint64_t _serial = 0;
+  uint64_t _clock = 0;
+  // last, it is stopped before the rest goes away
+  ThreadPool _prefetcher{1};
+
+public:
+  static const size_t MAX_DIRECTORIES = 512;
+
+  // The listing of path, read now unless cached, null if path is no
+  // directory that can be read.
+  std::shared_ptr<const Listing> get(const std::string &path);
+  // reads path on the worker thread unless it is cached
+  void prefetch(const std::string &path);
+
+private:
+  std::shared_ptr<const Listing> fetch(const std::string &key, bool visit,
+                                       bool &firstVisit);
+  void queue(const std::string &key);
+  void invalidate();
+  void erase(const std::string &key);
+  void evict();
+};
@@ -1,29 +1,14 @@
 #include "document.h"
 #include "u8String.h"
 #include "utils.h"
+#include "bulk_replace.h"
+#include "regex_search.h"
+#include <algorithm>
 #include <iostream>
 #include <sstream>
-#include <fstream>
 #include <assert.h>
-
-static std::vector<std::string> splitNewLine(const std::string &base) {
-  std::stringstream stream;
-  stream.str("");
-  stream.clear();
-  std::vector<std::string> final;
-  for (auto c = base.begin(); c != base.end(); c++) {
-    const char e = *c;
-    if (e == '\n') {
-      final.push_back(stream.str());
-      stream.str("");
-      stream.clear();
-    } else {
-      stream << e;
-    }
-  }
-  final.push_back(stream.str());
-  return final;
-}
+#include <string.h>
+#include <cmath>
 
 static int findAnyOfLast(std::u16string str, std::u16string what) {
   if (str.length() == 0)
@@ -62,41 +47,332 @@ static float getCells(const std::u16string &text) {
   return text.size();
 }
 
-std::shared_ptr<Document> Document::open(const std::string &path) {
+// indexed before open returns, the rest of the file loads in the background
+static const size_t FIRST_SCAN = 1024 * 1024;
+// decoded lines kept around the cursor of a paged file
+static const size_t WINDOW_LINES = 2048;
+static const size_t WINDOW_BYTES = 8 * 1024 * 1024;
+// longer lines of a paged file are cut when decoded
+static const size_t MAX_PAGED_LINE = 64 * 1024;
+
+std::shared_ptr<Document> Document::open(const std::string &path,
+                                         std::function<void()> onLoad,
+                                         uint64_t pagedThreshold) {
   auto cursor = std::shared_ptr<Document>(new Document);
   cursor->setPath(path);
+  cursor->_onLoad = onLoad;
+  cursor->_pagedThreshold = pagedThreshold;
   if (path.empty()) {
     return cursor;
   }
 
   if (path == "-") {
-    cursor->_lines.clear();
-    std::string line;
-    while (std::getline(std::cin, line)) {
-      cursor->_lines.push_back(create(line));
-    }
+    // stdin is read as it arrives, the buffer starts out empty
+    cursor->follow(true);
     return cursor;
   }
 
-  std::ifstream stream(path);
-  if (!stream.is_open()) {
-    return cursor;
+  cursor->load(path);
+  return cursor;
+}
+
+bool Document::load(const std::string &path) {
+  std::error_code error;
+  uint64_t size = std::filesystem::file_size(path, error);
+  if (!error && _pagedThreshold && size >= _pagedThreshold) {
+    auto paged = PagedFile::open(path, _onLoad);
+    if (!paged)
+      return false;
+    _loader = nullptr;
+    _follower = nullptr;
+    _streamMode = false;
+    _paged = paged;
+    _pageProgress = 0;
+    loadWindow(0, 0);
+    _last_write_time = std::filesystem::last_write_time(path);
+    return true;
+  }
+  auto source = LineSource::open(path, FIRST_SCAN);
+  if (!source)
+    return false;
+  _loader = nullptr;
+  _paged = nullptr;
+  size_t before = _lines.size();
+  _lines.assign(source);
+  changed(0, before, _lines.size());
+  if (!source->isComplete())
+    _loader = std::make_unique<FileLoader>(source, _onLoad);
+  _last_write_time = std::filesystem::last_write_time(path);
+  return true;
+}
+
+bool Document::pollLoader() {
+  if (_paged) {
+    int progress = _paged->getProgress();
+    if (progress == _pageProgress)
+      return false;
+    _pageProgress = progress;
+    uint64_t line;
+    if (_pageBase < 0 && _paged->lineOfOffset(_pageOffsets[0], line))
+      _pageBase = line;
+    return true;
   }
+  if (!_loader || !_loader->take())
+    return false;
+  auto &source = _lines.getSource();
+  size_t known = _lines.size();
+  _lines.appendSpan(known, source->size() - known);
+  changed(known, 0, _lines.size() - known);
+  if (_loader->isDone()) {
+    _loader = nullptr;
+    if (_streamMode)
+      startFollowing();
+  }
+  return true;
+}
 
-  std::stringstream ss;
-  ss << stream.rdbuf();
-  std::string c = ss.str();
-  auto parts = splitNewLine(c);
-
-  cursor->_lines = std::vector<std::u16string>(parts.size());
-  size_t count = 0;
-  for (const auto &ref : parts) {
-    cursor->_lines[count] = create(ref);
-    count++;
-  }
-  stream.close();
-  cursor->_last_write_time = std::filesystem::last_write_time(path);
-  return cursor;
+bool Document::follow(bool enable, size_t maxLines) {
+  _followMaxLines = maxLines;
+  if (!enable) {
+    _streamMode = false;
+    _follower = nullptr;
+    return true;
+  }
+  if (_streamMode)
+    return true;
+  if (_paged ||
+      (_path != "-" && !std::filesystem::is_regular_file(_path)))
+    return false;
+  _streamMode = true;
+  // a file still loading is followed from its end once the load finished
+  if (!_loader)
+    startFollowing();
+  return _streamMode;
+}
+
+void Document::startFollowing() {
+  uint64_t offset = 0;
+  if (_path != "-") {
+    auto &source = _lines.getSource();
+    offset = source ? source->byteSize() : 0;
+    if (_followMaxLines && _lines.size() > _followMaxLines) {
+      size_t before = _lines.size();
+      _lines.erase(0, before - _followMaxLines);
+      changed(0, before, _lines.size());
+    }
+    // A followed file may be truncated any time, the mapping must not be
+    // touched after that.
+    _lines.detach();
+    if (_y >= _lines.size())
+      _y = _lines.size() - 1;
+    if (_skip > _y)
+      _skip = _y;
+    if (_x > _lines[_y].length())
+      _x = _lines[_y].length();
+  }
+  // the edit history no longer matches once lines are dropped
+  _history.clear();
+  _selection.stop();
+  _follower = std::make_unique<FileFollower>(_path, offset, _onLoad);
+  if (!_follower->isValid()) {
+    _follower = nullptr;
+    _streamMode = false;
+  }
+}
+
+void Document::loadWindow(uint64_t start, int64_t base) {
+  const char *data = _paged->data();
+  uint64_t size = _paged->byteSize();
+  std::vector<std::u16string> lines;
+  _pageOffsets.clear();
+  uint64_t offset = start;
+  do {
+    uint64_t next = _paged->nextLine(offset);
+    uint64_t end = next > offset && data[next - 1] == '\n' ? next - 1 : next;
+    if (end - offset > MAX_PAGED_LINE)
+      end = offset + MAX_PAGED_LINE;
+    _pageOffsets.push_back(offset);
+    lines.push_back(create(data + offset, end - offset));
+    // a file ending in a newline has an empty last line
+    if (next == size && end + 1 == next) {
+      _pageOffsets.push_back(next);
+      lines.push_back(u"");
+    }
+    offset = next;
+  } while (offset < size && lines.size() < WINDOW_LINES &&
+           offset - start < WINDOW_BYTES);
+  _pageOffsets.push_back(offset);
+  size_t before = _lines.size();
+  _lines.assign(std::move(lines));
+  _pageBase = base;
+  changed(0, before, _lines.size());
+}
+
+void Document::showPagedLine(uint64_t offset, int64_t line) {
+  // the target ends up in the middle of the new window
+  uint64_t start = offset;
+  int before = 0;
+  while (before < (int)WINDOW_LINES / 2 && start > 0 &&
+         offset - start < WINDOW_BYTES / 2) {
+    start = _paged->previousLine(start);
+    before++;
+  }
+  loadWindow(start, line < 0 ? -1 : line - before);
+  _y = before < (int)_lines.size() ? before : _lines.size() - 1;
+  if (_x > _lines[_y].length())
+    _x = _lines[_y].length();
+}
+
+void Document::slideWindow() {
+  if (!_paged || _bind)
+    return;
+  int margin = _maxLines + 16;
+  bool nearStart = _y < margin && _pageOffsets[0] > 0;
+  bool nearEnd = _y + margin >= (int)_lines.size() &&
+                 _pageOffsets.back() < _paged->byteSize();
+  if (!nearStart && !nearEnd)
+    return;
+  int screen = _y - _skip;
+  showPagedLine(_pageOffsets[_y], getLineNumber());
+  _skip = _y > screen ? _y - screen : 0;
+  _selection.stop();
+}
+
+int64_t Document::getLineNumber() const {
+  if (!_paged)
+    return _y;
+  return _pageBase < 0 ? -1 : _pageBase + _y;
+}
+
+void Document::gotoPercent(int percent) {
+  if (percent < 0)
+    percent = 0;
+  if (percent > 100)
+    percent = 100;
+  if (!_paged) {
+    int line = (int)((int64_t)_lines.size() * percent / 100);
+    gotoLine(line < 1 ? 1 : line);
+    return;
+  }
+  // jumps by byte offset, the line number follows once the index is there
+  uint64_t offset = _paged->lineStart(_paged->byteSize() * percent / 100);
+  uint64_t line;
+  showPagedLine(offset, _paged->lineOfOffset(offset, line) ? line : -1);
+  _x = 0;
+  _xSave = 0;
+  _selection.diff(_x, _y);
+  center(_y + 1);
+}
+
+void Document::gotoEnd() {
+  if (!_paged) {
+    gotoLine(_lines.size());
+    return;
+  }
+  uint64_t offset = _paged->lineStart(_paged->byteSize());
+  uint64_t line;
+  showPagedLine(offset, _paged->lineOfOffset(offset, line) ? line : -1);
+  _x = 0;
+  _xSave = 0;
+  _selection.diff(_x, _y);
+  center(_y + 1);
+}
+
+std::u16string Document::searchPaged(const std::u16string &what,
+                                     bool skipFirst, bool shouldOffset) {
+  std::string needle = convert_str(what);
+  uint64_t size = _paged->byteSize();
+  uint64_t from = shouldOffset ? _pageOffsets[_y] : 0;
+  uint64_t found = _paged->find(needle, from);
+  if (skipFirst && found < size)
+    found = _paged->find(needle, _paged->nextLine(found));
+  if (found >= size)
+    return skipFirst ? u"[No further matches]: " : u"[Not found]: ";
+  uint64_t start = _paged->lineStart(found);
+  uint64_t line;
+  showPagedLine(start, _paged->lineOfOffset(start, line) ? line : -1);
+  std::u16string prefix =
+      create(_paged->data() + start,
+             found - start < MAX_PAGED_LINE ? found - start : MAX_PAGED_LINE);
+  _xSave = prefix.length();
+  center(_y + 1);
+  int64_t number = getLineNumber();
+  return u"[At: " + (number < 0 ? u"?" : create(std::to_string(number + 1))) +
+         u":" + numberToString(_xSave + 1) + u"]: ";
+}
+
+void Document::appendLines(std::vector<std::u16string> lines) {
+  if (lines.empty())
+    return;
+  size_t before = _lines.size();
+  _lines.insert(_lines.size(), std::move(lines));
+  changed(before, 0, _lines.size() - before);
+}
+
+void Document::setLines(std::vector<std::u16string> lines) {
+  if (lines.empty())
+    lines.push_back(u"");
+  size_t before = _lines.size();
+  _lines.assign(std::move(lines));
+  changed(0, before, _lines.size());
+}
+
+void Document::replaceLine(size_t line, std::u16string text) {
+  _lines[line] = std::move(text);
+  changed(line, 1, 1);
+}
+
+bool Document::pollFollower() {
+  if (!_follower)
+    return false;
+  std::vector<std::u16string> pieces;
+  bool truncated;
+  if (!_follower->take(pieces, truncated)) {
+    if (_path == "-" && _follower->hasEnded()) {
+      _follower = nullptr;
+      _streamMode = false;
+      return true;
+    }
+    return false;
+  }
+  size_t before = _lines.size();
+  bool atEnd = _y == _lines.size() - 1;
+  bool dropped = truncated;
+  if (truncated) {
+    _lines.assign(std::vector<std::u16string>{u""});
+    _x = _y = _skip = 0;
+    atEnd = true;
+  }
+  if (pieces.size()) {
+    _lines.back() += pieces[0];
+    pieces.erase(pieces.begin());
+    _lines.insert(_lines.size(), std::move(pieces));
+  }
+  if (_followMaxLines && _lines.size() > _followMaxLines) {
+    size_t drop = _lines.size() - _followMaxLines;
+    _lines.erase(0, drop);
+    dropped = true;
+    _y = _y > drop ? _y - drop : 0;
+    _skip = _skip > drop ? _skip - drop : 0;
+    if (_x > _lines[_y].length())
+      _x = _lines[_y].length();
+  }
+  // the last line grows and lines follow it, unless some were dropped
+  if (dropped)
+    changed(0, before, _lines.size());
+  else
+    changed(before - 1, 1, _lines.size() - before + 1);
+  if (atEnd) {
+    _y = _lines.size() - 1;
+    _x = 0;
+    if (_y >= _maxLines)
+      _skip = _y - _maxLines + 1;
+  }
+  if (_path == "-" && _follower->hasEnded()) {
+    _follower = nullptr;
+    _streamMode = false;
+  }
+  return true;
 }
 
 void Document::setBounds(float height, float lineHeight) {
@@ -112,26 +388,64 @@ void Document::setBounds(float height, float lineHeight) {
 }
 
 void Document::trimTrailingWhiteSpaces() {
-  for (auto &line : _lines) {
-    char16_t last = line[line.length() - 1];
-    if (last == ' ' || last == '\t' || last == '\r') {
-      int remaining = line.length();
+  auto isTrailing = [](char16_t c) {
+    return c == ' ' || c == '\t' || c == '\r';
+  };
+  // Untouched lines are looked at in the raw bytes of the file, only the
+  // ones that end in whitespace get decoded. The whitespace is ASCII, so
+  // its bytes count as many characters.
+  std::vector<std::pair<size_t, int>> trims;
+  size_t line = 0;
+  _lines.forEachChunk([&](const std::u16string *text, const char *raw,
+                          size_t length) {
+    if (text) {
       int count = 0;
-      while (remaining--) {
-        char16_t current = line[remaining];
-        if (current == ' ' || current == '\t' || current == '\r')
-          count++;
-        else
-          break;
-      }
-      line = line.substr(0, line.length() - count);
+      while (count < (int)text->length() &&
+             isTrailing((*text)[text->length() - count - 1]))
+        count++;
+      if (count)
+        trims.push_back({line, count});
+      line++;
+      return true;
+    }
+    const char *end = raw + length;
+    for (const char *start = raw;; line++) {
+      auto newline =
+          start < end ? (const char *)memchr(start, '\n', end - start)
+                      : nullptr;
+      const char *stop = newline ? newline : end;
+      int count = 0;
+      while (stop - count > start && isTrailing(stop[-count - 1]))
+        count++;
+      if (count)
+        trims.push_back({line, count});
+      if (!newline)
+        break;
+      start = newline + 1;
     }
+    line++;
+    return true;
+  });
+  if (trims.size()) {
+    size_t count = trims.back().first - trims.front().first + 1;
+    changed(trims.front().first, count, count);
+  }
+  bool joined = false;
+  for (auto &trim : trims) {
+    auto &line = _lines[trim.first];
+    size_t keep = line.length() - trim.second;
+    // recorded even while a prompt is bound, later undos depend on it
+    _history.record(trim.first, keep, _y, _x, line.substr(keep), u"", joined);
+    joined = true;
+    line.erase(keep);
   }
   if (_x > _lines[_y].length())
     _x = _lines[_y].length();
 }
 
 void Document::comment(std::u16string commentStr) {
+  if (isReadOnly())
+    return;
   if (!_selection.active) {
     std::u16string firstLine = _lines[_y];
     int firstOffset = 0;
@@ -143,15 +457,11 @@ void Document::comment(std::u16string commentStr) {
     bool remove = firstLine.length() - firstOffset >= commentStr.length() &&
                   firstLine.find(commentStr) == firstOffset;
     if (remove) {
-      CommentEntry *cm = new CommentEntry();
-      cm->commentStr = commentStr;
+      historyPush(_y, firstOffset, commentStr, u"");
       (&_lines[_y])->erase(firstOffset, commentStr.length());
-      historyPush(42, firstOffset, u"", cm);
     } else {
-      CommentEntry *cm = new CommentEntry();
-      cm->commentStr = commentStr;
+      historyPush(_y, firstOffset, u"", commentStr);
       (&_lines[_y])->insert(firstOffset, commentStr);
-      historyPush(43, firstOffset, u"", cm);
     }
     return;
   }
@@ -166,24 +476,21 @@ void Document::comment(std::u16string commentStr) {
   }
   bool remove = firstLine.length() - firstOffset >= commentStr.length() &&
                 firstLine.find(commentStr) == firstOffset;
-  CommentEntry *cm = new CommentEntry();
-  cm->firstOffset = firstOffset;
-  cm->commentStr = commentStr;
-  cm->yStart = yStart;
+  beginTransaction();
   if (remove) {
-    historyPush(40, 0, u"", cm);
     for (size_t i = yStart; i < yEnd; i++) {
       if ((&_lines[i])->find(commentStr) != firstOffset)
         break;
+      historyPush(i, firstOffset, commentStr, u"");
       (&_lines[i])->erase(firstOffset, commentStr.length());
-      _history[_history.size() - 1].length += 1;
     }
   } else {
-    historyPush(41, yEnd - yStart, u"", cm);
     for (size_t i = yStart; i < yEnd; i++) {
+      historyPush(i, firstOffset, u"", commentStr);
       (&_lines[i])->insert(firstOffset, commentStr);
     }
   }
+  commitTransaction();
   _selection.stop();
 }
 
@@ -229,13 +536,17 @@ void Document::reset() {
   _skip = 0;
   _prepare.clear();
   _history.clear();
-  _lines = {u""};
+  size_t before = _lines.size();
+  _lines.assign({u""});
+  changed(0, before, 1);
 }
 
 void Document::deleteSelection() {
   if (_selection.yStart == _selection.yEnd) {
     auto line = _lines[_y];
-    historyPush(16, line.length(), line);
+    int xSmall = _selection.getXSmaller();
+    historyPush(_y, xSmall,
+                line.substr(xSmall, _selection.getXBigger() - xSmall), u"");
     auto start = line.substr(0, _selection.getXSmaller());
     auto end = line.substr(_selection.getXBigger());
     _lines[_y] = start + end;
@@ -244,21 +555,28 @@ void Document::deleteSelection() {
     int ySmall = _selection.getYSmaller();
     int yBig = _selection.getYBigger();
     bool isStart = ySmall == _selection.yStart;
-    std::u16string save = _lines[ySmall];
-    std::vector<std::u16string> toSave;
-    _lines[ySmall] =
-        _lines[ySmall].substr(0, isStart ? _selection.xStart : _selection.xEnd);
-    for (int i = 0; i < yBig - ySmall; i++) {
-      toSave.push_back(_lines[ySmall + 1]);
-      if (i == yBig - ySmall - 1) {
-        _x = _lines[ySmall].length();
-        _lines[ySmall] += _lines[ySmall + 1].substr(
-            isStart ? _selection.xEnd : _selection.xStart);
-      }
-      _lines.erase(_lines.begin() + ySmall + 1);
-    }
+    int xFrom = isStart ? _selection.xStart : _selection.xEnd;
+    int xTo = isStart ? _selection.xEnd : _selection.xStart;
+    // only the removed text is kept for undo, not the lines it spans
+    std::u16string removed = _lines[ySmall].substr(xFrom);
+    std::u16string rest;
+    _lines.forEach(ySmall + 1, yBig + 1,
+                   [&](size_t x, const std::u16string &line) {
+                     removed += u"\n";
+                     if (x == yBig) {
+                       removed += line.substr(0, xTo);
+                       rest = line.substr(xTo);
+                     } else {
+                       removed += line;
+                     }
+                     return true;
+                   });
+    historyPush(ySmall, xFrom, removed, u"");
+    _lines[ySmall].erase(xFrom);
+    _x = xFrom;
+    _lines[ySmall] += rest;
+    _lines.erase(ySmall + 1, yBig - ySmall);
     _y = ySmall;
-    historyPushWithExtra(16, save.length(), save, toSave);
   }
 }
 
@@ -317,48 +635,82 @@ void Document::unbind() {
 }
 
 std::u16string Document::search(std::u16string what, bool skipFirst,
-                                bool shouldOffset) {
-  int i = shouldOffset ? _y : 0;
-  bool found = false;
-  for (int x = i; x < _lines.size(); x++) {
-    auto line = _lines[x];
-    auto where = line.find(what);
-    if (where != std::string::npos) {
-      if (skipFirst && !found) {
-        found = true;
-        continue;
-      }
-      _y = x;
-      // we are in non 0 mode here, set savex
-      _xSave = where;
-      center(i);
-      return u"[At: " + numberToString(_y + 1) + u":" +
-             numberToString(where + 1) + u"]: ";
-    }
-    i++;
+                                bool shouldOffset, SearchOptions options) {
+  if (_paged) {
+    if (options.regex)
+      return u"[No regex search in the paged view]: ";
+    return searchPaged(what, skipFirst, shouldOffset);
+  }
+  size_t line = shouldOffset ? _y : 0;
+  size_t column = skipFirst ? _xSave + 1 : 0;
+  bool found;
+  if (options.regex) {
+    RegexSearch searcher(what, options);
+    if (!searcher.isValid())
+      return u"[Invalid regex: " + searcher.error() + u"]: ";
+    found = searcher.find(_lines, line, column);
+  } else {
+    found = TextSearch(what, options).find(_lines, line, column);
   }
+  if (found)
+    return showMatch(line, column);
   if (skipFirst)
     return u"[No further matches]: ";
   return u"[Not found]: ";
 }
 
+std::u16string Document::showMatch(size_t line, size_t column) {
+  _y = line;
+  // we are in non 0 mode here, set savex
+  _xSave = column;
+  center(line);
+  return u"[At: " + numberToString(_y + 1) + u":" +
+         numberToString(column + 1) + u"]: ";
+}
+
 std::u16string Document::replaceOne(std::u16string what, std::u16string replace,
-                                    bool allowCenter, bool shouldOffset) {
+                                    bool allowCenter, bool shouldOffset,
+                                    SearchOptions options) {
+  if (isReadOnly())
+    return u"[Read only]: ";
+  std::unique_ptr<RegexSearch> regex;
+  std::unique_ptr<TextSearch> literal;
+  if (options.regex) {
+    regex = std::make_unique<RegexSearch>(what, options);
+    if (!regex->isValid())
+      return u"[Invalid regex: " + regex->error() + u"]: ";
+  } else {
+    literal = std::make_unique<TextSearch>(what, options);
+    if (literal->isEmpty() || literal->isMultiLine())
+      return u"[Not found]: ";
+  }
   int i = shouldOffset ? _y : 0;
-  bool found = false;
   for (int x = i; x < _lines.size(); x++) {
     auto line = _lines[x];
-    auto where = line.find(what, _xSave);
+    size_t where = std::u16string::npos;
+    size_t end = 0;
+    std::u16string replacement = replace;
+    if (regex) {
+      RegexMatch match;
+      if (regex->find(line.data(), line.length(), _xSave, match)) {
+        where = match.start();
+        end = match.end();
+        replacement = regex->expand(replace, line.data(), match);
+      }
+    } else {
+      where = literal->find(line.data(), line.length(), _xSave);
+      end = where + what.length();
+    }
     if (where != std::string::npos) {
       auto xNow = this->_x;
       auto yNow = this->_y;
       this->_y = x;
       this->_x = where;
-      historyPush(30, line.length(), line);
+      historyPush(x, where, line.substr(where, end - where), replacement);
       std::u16string base = line.substr(0, where);
-      base += replace;
-      if (line.length() - where - what.length() > 0)
-        base += line.substr(where + what.length());
+      base += replacement;
+      if (line.length() > end)
+        base += line.substr(end);
       _lines[x] = base;
       if (allowCenter) {
         this->_y = i;
@@ -366,7 +718,8 @@ std::u16string Document::replaceOne(std::u16string what, std::u16string replace,
       } else {
         this->_y = yNow;
       }
-      _xSave = where + replace.length();
+      // past an empty match, it would be found again
+      _xSave = where + replacement.length() + (end == where);
       this->_x = xNow;
       return u"[At: " + numberToString(_y + 1) + u":" +
              numberToString(where + 1) + u"]: ";
@@ -378,15 +731,49 @@ std::u16string Document::replaceOne(std::u16string what, std::u16string replace,
   return u"[Not found]: ";
 }
 
-size_t Document::replaceAll(std::u16string what, std::u16string replace) {
+size_t Document::replaceAll(std::u16string what, std::u16string replace,
+                            SearchOptions options) {
+  if (isReadOnly())
+    return 0;
+  // the buffer is searched once, every changed line is written back once
+  auto found = findReplacements(_lines, _y, _lines.size(), _xSave, what,
+                                replace, options);
+  // unless every match is what replaced with replace, the texts recorded
+  // are taken from the lines before and after
+  bool varying = options.regex || options.ignoreCase;
+  const LineBuffer &lines = _lines;
+  std::u16string original;
   size_t c = 0;
-  while (true) {
-    auto res = replaceOne(what, replace, false);
-    if (res == u"[Not found]: ")
-      break;
-    c++;
+  beginTransaction();
+  for (size_t i = 0; i < found.lines.size(); i++) {
+    size_t y = found.lines[i].first;
+    const std::u16string &replaced = found.lines[i].second;
+    if (varying)
+      lines.forEach(y, y + 1, [&](size_t, const std::u16string &text) {
+        original = text;
+        return false;
+      });
+    // recorded as if replaced one by one from the left, which is the order
+    // undo and redo apply them in
+    size_t shift = 0;
+    for (uint32_t k = 0; k < found.counts[i]; k++, c++) {
+      if (!varying) {
+        historyPush(y, found.columns[c] + shift, what, replace);
+        shift += replace.length() - what.length();
+        continue;
+      }
+      size_t length = options.regex ? found.lengths[c] : what.length();
+      size_t inserted =
+          options.regex ? found.replacedLengths[c] : replace.length();
+      historyPush(y, found.columns[c] + shift,
+                  original.substr(found.columns[c], length),
+                  replaced.substr(found.columns[c] + shift, inserted));
+      shift += inserted - length;
+    }
   }
-  historyPush(31, c, u"");
+  _lines.replaceLines(found.lines);
+  commitTransaction();
+  _xSave = 0;
   if (_x > _lines[_y].length()) {
     _x = _lines[_y].length();
     _xSave = _x;
@@ -412,179 +799,93 @@ void Document::advanceWord() {
 }
 
 std::u16string Document::deleteWord() {
+  if (!_bind && isReadOnly())
+    return u"";
   std::u16string *target = _bind ? _bind : &_lines[_y];
   int offset = findAnyOf(target->substr(_x), wordSeperator);
   if (offset == -1)
     offset = target->length() - _x;
   std::u16string w = target->substr(_x, offset);
+  if (!_bind)
+    historyPush(_y, _x, w, u"");
   target->erase(_x, offset);
-  historyPush(3, w.length(), w);
   return w;
 }
 
 bool Document::undo() {
-  if (_history.size() == 0)
+  if (!_history.canUndo() || isReadOnly())
     return false;
-  HistoryEntry entry = _history[0];
-  _history.pop_front();
-  switch (entry.mode) {
-  case 3: {
-    _x = entry.x;
-    _y = entry.y;
-    center(_y);
-    (&_lines[_y])->insert(_x, entry.content);
-    _x += entry.length;
-    break;
-  }
-  case 4: {
-    _y = entry.y;
-    _x = entry.x;
-    center(_y);
-    (&_lines[_y])->insert(_x - 1, entry.content);
-    break;
-  }
-  case 5: {
-    _y = entry.y;
-    _x = 0;
-    _lines.insert(_lines.begin() + _y, entry.content);
-    center(_y);
-    if (entry.extra.size())
-      _lines[_y - 1] = entry.extra[0];
-    break;
-  }
-  case 6: {
-    _y = entry.y;
-    _x = (&_lines[_y])->length();
-    _lines.erase(_lines.begin() + _y + 1);
-    center(_y);
-    break;
-  }
-  case 7: {
-    _y = entry.y;
-    _x = 0;
-    if (entry.extra.size()) {
-      _lines[_y] = entry.content + entry.extra[0];
-      _lines.erase(_lines.begin() + _y + 1);
-    } else {
-      _lines.erase(_lines.begin() + _y);
-    }
-    center(_y);
-    break;
-  }
-  case 8: {
-    _y = entry.y;
-    _x = entry.x;
-    (&_lines[_y])->erase(_x, 1);
-    center(_y);
-    break;
+  UndoLog::Edit edit;
+  // a step is undone newest edit first
+  while (_history.undo(edit)) {
+    replaceText(edit.y, edit.x, edit.inserted, edit.removed);
+    if (!edit.joined)
+      break;
   }
-  case 10: {
-    _x = 0;
-    _y = entry.y;
-    _lines[_y] = entry.content;
-    _lines.insert(_lines.begin() + _y, u"");
-    center(_y);
-    break;
-  }
-  case 11: {
-    _y = entry.y;
-    _x = entry.x;
-    (&_lines[_y])->insert(_x, entry.content);
-    break;
-  }
-  case 15: {
-    if (entry.length == 0) {
-      _y = entry.y;
-      _x = entry.x;
-      (&_lines[_y])->erase(_x, entry.content.length());
+  _y = edit.cursorY;
+  _x = edit.cursorX;
+  center(_y);
+  _edited = true;
+  return true;
+}
+
+bool Document::redo() {
+  if (!_history.canRedo() || isReadOnly())
+    return false;
+  UndoLog::Edit edit;
+  do {
+    _history.redo(edit);
+    replaceText(edit.y, edit.x, edit.removed, edit.inserted);
+  } while (_history.redoJoined());
+  _history.seal();
+  // the cursor ends up behind the last text inserted
+  _y = edit.y;
+  _x = edit.x;
+  for (char16_t c : edit.inserted) {
+    if (c == '\n') {
+      _y++;
+      _x = 0;
     } else {
-      _y = entry.y - entry.length;
-      _x = entry.x;
-      for (size_t i = 0; i < entry.length; i++) {
-        _lines.erase(_lines.begin() + _y + 1);
-      }
-      _lines[_y] = entry.content;
+      _x++;
     }
-    break;
-  }
-  case 16: {
-    if (entry.extra.size()) {
-      _y = entry.y;
-      _x = entry.x;
-      _lines[_y] = entry.content;
-      for (int i = 0; i < entry.extra.size(); i++) {
-        _lines.insert(_lines.begin() + _y + i + 1, entry.extra[i]);
-      }
+  }
+  center(_y);
+  _edited = true;
+  return true;
+}
 
+void Document::replaceText(int y, int x, const std::u16string &removed,
+                           const std::u16string &inserted) {
+  int yEnd = y;
+  int xEnd = x;
+  for (char16_t c : removed) {
+    if (c == '\n') {
+      yEnd++;
+      xEnd = 0;
     } else {
-      _y = entry.y;
-      _x = entry.x;
-      _lines[_y] = entry.content;
+      xEnd++;
     }
-    break;
   }
-  case 30: {
-    _y = entry.y;
-    _x = entry.x;
-    _lines[_y] = entry.content;
-    break;
+  changed(y, yEnd - y + 1,
+          std::count(inserted.begin(), inserted.end(), u'\n') + 1);
+  if (yEnd == y && inserted.find(u'\n') == std::u16string::npos) {
+    (&_lines[y])->replace(x, removed.length(), inserted);
+    return;
   }
-  case 31: {
-    for (size_t i = 0; i < entry.length; i++) {
-      undo();
-    }
-    _y = entry.y;
-    _x = entry.x;
-    break;
-  }
-  case 40: {
-    CommentEntry *data = static_cast<CommentEntry *>(entry.userData);
-    std::u16string commentStr = data->commentStr;
-    size_t len = entry.length;
-    for (size_t i = data->yStart; i < data->yStart + len; i++) {
-      (&_lines[i])->insert(data->firstOffset, commentStr);
-    }
-    _x = data->firstOffset;
-    _y = data->yStart;
-    center(_y);
-    delete data;
-    break;
-  }
-  case 41: {
-    CommentEntry *data = static_cast<CommentEntry *>(entry.userData);
-    std::u16string commentStr = data->commentStr;
-    size_t len = entry.length;
-    for (size_t i = data->yStart; i < data->yStart + len; i++) {
-      (&_lines[i])->erase(data->firstOffset, commentStr.length());
-    }
-    _x = data->firstOffset;
-    _y = data->yStart;
-    center(_y);
-    delete data;
-    break;
-  }
-  case 42: {
-    _y = entry.y;
-    center(_y);
-    CommentEntry *data = static_cast<CommentEntry *>(entry.userData);
-    (&_lines[_y])->insert(entry.length, data->commentStr);
-    _x = entry.x;
-    delete data;
-    break;
-  }
-  case 43: {
-    _y = entry.y;
-    center(_y);
-    CommentEntry *data = static_cast<CommentEntry *>(entry.userData);
-    (&_lines[_y])->erase(entry.length, data->commentStr.length());
-    _x = entry.x;
-    delete data;
-    break;
-  }
-  default:
-    return false;
+  std::u16string rest = _lines[yEnd].substr(xEnd);
+  if (yEnd > y)
+    _lines.erase(y + 1, yEnd - y);
+  auto parts = split(inserted, u"\n");
+  std::u16string *first = &_lines[y];
+  first->erase(x);
+  *first += parts[0];
+  if (parts.size() == 1) {
+    *first += rest;
+    return;
   }
-  return true;
+  parts.back() += rest;
+  parts.erase(parts.begin());
+  _lines.insert(y + 1, std::move(parts));
 }
 
 void Document::advanceWordBackwards() {
@@ -605,7 +906,19 @@ void Document::advanceWordBackwards() {
 }
 
 void Document::gotoLine(int l) {
-  if (l - 1 > _lines.size())
+  if (_paged) {
+    uint64_t offset;
+    if (l < 1 || !_paged->offsetOfLine(l - 1, offset))
+      return;
+    showPagedLine(offset, l - 1);
+    _x = 0;
+    _xSave = 0;
+    _selection.diff(_x, _y);
+    center(_y + 1);
+    return;
+  }
+  // only the target line is decoded, the tree finds it through the index
+  if (l < 1 || l > _lines.size())
     return;
   _x = 0;
   _xSave = 0;
@@ -627,93 +940,110 @@ void Document::center(int l) {
   }
 }
 
-void Document::historyPush(int mode, int length, std::u16string content) {
-  if (_bind != nullptr)
+void Document::historyPush(int y, int x, const std::u16string &removed,
+                           const std::u16string &inserted, bool keystroke) {
+  if (removed.empty() && inserted.empty())
     return;
   _edited = true;
-  HistoryEntry entry;
-  entry.x = _x;
-  entry.y = _y;
-  entry.mode = mode;
-  entry.length = length;
-  entry.content = content;
-  if (_history.size() > 5000)
-    _history.pop_back();
-  _history.push_front(entry);
-}
-
-void Document::historyPush(int mode, int length, std::u16string content,
-                           void *userData) {
-  if (_bind != nullptr)
+  changed(y, std::count(removed.begin(), removed.end(), u'\n') + 1,
+          std::count(inserted.begin(), inserted.end(), u'\n') + 1);
+  if (keystroke && !_transactionDepth &&
+      _history.extend(y, x, removed, inserted))
     return;
-  _edited = true;
-  HistoryEntry entry;
-  entry.x = _x;
-  entry.y = _y;
-  entry.userData = userData;
-  entry.mode = mode;
-  entry.length = length;
-  entry.content = content;
-  if (_history.size() > 5000)
-    _history.pop_back();
-  _history.push_front(entry);
-}
-
-void Document::historyPushWithExtra(int mode, int length,
-                                    std::u16string content,
-                                    std::vector<std::u16string> extra) {
-  if (_bind != nullptr)
+  _history.record(y, x, _y, _x, removed, inserted,
+                  _transactionDepth && _transactionStarted);
+  if (_transactionDepth)
+    _transactionStarted = true;
+}
+
+void Document::beginTransaction() {
+  if (!_transactionDepth++)
+    _transactionStarted = false;
+}
+
+void Document::commitTransaction() {
+  if (--_transactionDepth)
     return;
-  _edited = true;
-  HistoryEntry entry;
-  entry.x = _x;
-  entry.y = _y;
-  entry.mode = mode;
-  entry.length = length;
-  entry.content = content;
-  entry.extra = extra;
-  if (_history.size() > 5000)
-    _history.pop_back();
-  _history.push_front(entry);
+  // typing after the transaction doesn't merge into its last edit
+  if (_transactionStarted)
+    _history.seal();
+}
+
+void Document::changed(size_t line, size_t removed, size_t inserted) {
+  _version++;
+  if (!_hasChange) {
+    _change = {line, line + removed, line + inserted};
+    _hasChange = true;
+    return;
+  }
+  // one range covers both, with the unchanged lines between them
+  size_t end = std::max(_change.newEnd, line + removed);
+  _change.oldEnd += end - _change.newEnd;
+  _change.newEnd = end + inserted - removed;
+  _change.from = std::min(_change.from, line);
+}
+
+bool Document::changesSince(size_t version, LineChange &change) const {
+  if (version != _changeBase)
+    return false;
+  if (!_hasChange) {
+    change = {0, 0, 0};
+    return true;
+  }
+  change = _change;
+  return true;
+}
+
+void Document::forgetChanges() {
+  _changeBase = _version;
+  _hasChange = false;
 }
 
 bool Document::didChange(std::string path) {
-  if (!std::filesystem::exists(path))
+  std::error_code error;
+  auto time = std::filesystem::last_write_time(path, error);
+  if (error)
     return false;
-  bool result = _last_write_time != std::filesystem::last_write_time(path);
-  _last_write_time = std::filesystem::last_write_time(path);
+  bool result = _last_write_time != time;
+  _last_write_time = time;
   return result;
 }
 
 bool Document::reloadFile(std::string path) {
-  std::ifstream stream(path);
-  if (!stream.is_open())
+  if (!load(path))
     return false;
   _history.clear();
-  std::stringstream ss;
-  ss << stream.rdbuf();
-  std::string c = ss.str();
-  auto parts = splitNewLine(c);
-  _lines = std::vector<std::u16string>(parts.size());
-  size_t count = 0;
-  for (const auto &ref : parts) {
-    _lines[count] = create(ref);
-    count++;
-  }
   if (_skip > _lines.size() - _maxLines)
     _skip = 0;
   if (_y > _lines.size() - 1)
     _y = _lines.size() - 1;
   if (_x > _lines[_y].length())
     _x = _lines[_y].length();
-  stream.close();
-  _last_write_time = std::filesystem::last_write_time(path);
   _edited = false;
   return true;
 }
 
+void Document::detachFromDisk() {
+  if (_paged || _loader) {
+    reloadFile(_path);
+    return;
+  }
+  auto &source = _lines.getSource();
+  if (!source)
+    return;
+  bool intact = source->checkIntact();
+  size_t lines = _lines.size();
+  _lines.detach();
+  if (intact)
+    return;
+  // the lines past the new end of the file came out short
+  changed(0, lines, lines);
+  _history.clear();
+  if (_x > _lines[_y].length())
+    _x = _lines[_y].length();
+}
+
 bool Document::openFile(std::string oldPath, std::string path) {
-  std::ifstream stream(path);
   if (oldPath.length()) {
     PosEntry entry;
     entry.x = _xSave;
@@ -722,7 +1052,7 @@ bool Document::openFile(std::string oldPath, std::string path) {
     _saveLocs[oldPath] = entry;
   }
 
-  if (!stream.is_open()) {
+  if (!load(path)) {
     return false;
   }
   if (_saveLocs.count(path)) {
@@ -742,35 +1072,29 @@ bool Document::openFile(std::string oldPath, std::string path) {
   }
   _xSave = _x;
   _history.clear();
-  std::stringstream ss;
-  ss << stream.rdbuf();
-  std::string c = ss.str();
-  auto parts = splitNewLine(c);
-  _lines = std::vector<std::u16string>(parts.size());
-  size_t count = 0;
-  for (const auto &ref : parts) {
-    _lines[count] = create(ref);
-    count++;
-  }
   if (_skip > _lines.size() - _maxLines)
     _skip = 0;
   if (_y > _lines.size() - 1)
     _y = _lines.size() - 1;
   if (_x > _lines[_y].length())
     _x = _lines[_y].length();
-  stream.close();
-  _last_write_time = std::filesystem::last_write_time(path);
   _edited = false;
   return true;
 }
 
 void Document::append(char16_t c) {
+  if (!_bind && isReadOnly())
+    return;
   if (_selection.active) {
+    // typing over a selection replaces it in one step
+    beginTransaction();
     deleteSelection();
     _selection.stop();
+    append(c);
+    commitTransaction();
+    return;
   }
   if (c == '\n' && _bind == nullptr) {
-    auto pos = _lines.begin() + _y;
     std::u16string *current = &_lines[_y];
     bool isEnd = _x == current->length();
     if (isEnd) {
@@ -783,22 +1107,21 @@ void Document::append(char16_t c) {
         else
           break;
       }
-      _lines.insert(pos + 1, base);
-      historyPush(6, 0, u"");
+      historyPush(_y, _x, u"", u"\n" + base);
+      _lines.insert(_y + 1, base);
       _x = base.length();
       _y++;
       return;
 
     } else {
+      historyPush(_y, _x, u"", u"\n");
       if (_x == 0) {
-        _lines.insert(pos, u"");
-        historyPush(7, 0, u"");
+        _lines.insert(_y, u"");
       } else {
         std::u16string toWrite = current->substr(0, _x);
         std::u16string next = current->substr(_x);
         _lines[_y] = toWrite;
-        _lines.insert(pos + 1, next);
-        historyPushWithExtra(7, toWrite.length(), toWrite, {next});
+        _lines.insert(_y + 1, next);
       }
     }
     _y++;
@@ -807,8 +1130,9 @@ void Document::append(char16_t c) {
     auto *target = _bind ? _bind : &_lines[_y];
     std::u16string content;
     content += c;
+    if (!_bind)
+      historyPush(_y, _x, u"", content, true);
     target->insert(_x, content);
-    historyPush(8, 1, content);
     _x++;
   }
 }
@@ -819,53 +1143,42 @@ void Document::appendWithLines(std::u16string content) {
     return;
   }
   if (_selection.active) {
+    beginTransaction();
     deleteSelection();
     _selection.stop();
+    appendWithLines(content);
+    commitTransaction();
+    return;
   }
+  historyPush(_y, _x, u"", content);
   bool hasSave = false;
   std::u16string save;
-  std::u16string historySave;
   auto contentLines = split(content, u"\n");
-  int saveX = 0;
-  int count = 0;
-  for (int i = 0; i < contentLines.size(); i++) {
-    if (i == 0) {
-      if (contentLines.size() == 1) {
-        (&_lines[_y])->insert(_x, contentLines[i]);
-        historyPush(15, 0, contentLines[i]);
-      } else {
-        historySave = _lines[_y];
-        hasSave = true;
-        save = _lines[_y].substr(_x);
-        _lines[_y] = _lines[_y].substr(0, _x) + contentLines[i];
-        saveX = _x;
-      }
-      _x += contentLines[i].length();
-      continue;
-    } else if (i == contentLines.size() - 1) {
-      _lines.insert(_lines.begin() + _y + 1, contentLines[i]);
-      _y++;
-      count++;
-
-      _x = contentLines[i].length();
-    } else {
-      _lines.insert(_lines.begin() + _y + 1, contentLines[i]);
-      _y++;
-      count++;
-    }
+  int count = contentLines.size() - 1;
+  if (count == 0) {
+    (&_lines[_y])->insert(_x, contentLines[0]);
+    _x += contentLines[0].length();
+  } else {
+    hasSave = true;
+    save = _lines[_y].substr(_x);
+    _lines[_y] = _lines[_y].substr(0, _x) + contentLines[0];
+    _x = contentLines.back().length();
+    contentLines.erase(contentLines.begin());
+    _lines.insert(_y + 1, std::move(contentLines));
+    _y += count;
   }
   if (hasSave) {
     _lines[_y] += save;
-    int xx = _x;
-    _x = saveX;
-    historyPush(15, count, historySave);
-    _x = xx;
   }
   center(_y);
 }
 
 void Document::append(std::u16string content) {
+  if (!_bind && isReadOnly())
+    return;
   auto *target = _bind ? _bind : &_lines[_y];
+  if (!_bind)
+    historyPush(_y, _x, u"", content);
   target->insert(_x, content);
   _x += content.length();
 }
@@ -880,21 +1193,24 @@ std::u16string Document::getCurrentAdvance(bool useSaveValue) {
 }
 
 void Document::removeBeforeCursor() {
-  if (_selection.active)
+  if (_selection.active || (!_bind && isReadOnly()))
     return;
   std::u16string *target = _bind ? _bind : &_lines[_y];
   if (_x == 0 && target->length() == 0) {
     if (_y == _lines.size() - 1 || _bind)
       return;
     if (target->length() == 0) {
+      historyPush(_y, 0, u"\n", u"");
       std::u16string next = _lines[_y + 1];
       _lines[_y] = next;
-      _lines.erase(_lines.begin() + _y + 1);
-      historyPush(10, next.length(), next);
+      _lines.erase(_y + 1);
       return;
     }
   }
-  historyPush(11, 1, std::u16string(1, (*target)[_x]));
+  if (_x >= target->length())
+    return;
+  if (!_bind)
+    historyPush(_y, _x, std::u16string(1, (*target)[_x]), u"", true);
   target->erase(_x, 1);
 
   if (_x > target->length())
@@ -902,6 +1218,8 @@ void Document::removeBeforeCursor() {
 }
 
 void Document::removeOne() {
+  if (!_bind && isReadOnly())
+    return;
   if (_selection.active) {
     deleteSelection();
     _selection.stop();
@@ -914,19 +1232,17 @@ void Document::removeOne() {
 
     std::u16string *copyTarget = &_lines[_y - 1];
     int xTarget = copyTarget->length();
-    if (target->length() > 0) {
-      historyPushWithExtra(5, (&_lines[_y])->length(), _lines[_y],
-                           {_lines[_y - 1]});
+    historyPush(_y - 1, xTarget, u"\n", u"");
+    if (target->length() > 0)
       copyTarget->append(*target);
-    } else {
-      historyPush(5, (&_lines[_y])->length(), _lines[_y]);
-    }
-    _lines.erase(_lines.begin() + _y);
+    _lines.erase(_y);
 
     _y--;
     _x = xTarget;
   } else {
-    historyPush(4, 1, std::u16string(1, (*target)[_x - 1]));
+    if (!_bind)
+      historyPush(_y, _x - 1, std::u16string(1, (*target)[_x - 1]), u"",
+                  true);
     target->erase(_x - 1, 1);
     _x--;
   }
@@ -992,30 +1308,34 @@ void Document::moveLeft() {
   _selection.diff(_x, _y);
 }
 
-bool Document::saveTo(std::string path) {
+bool Document::saveTo(std::string path, bool sync) {
+  if (isLoading() || _paged) {
+    // only part of the file is known or decoded
+    _writer.lastError = isLoading() ? "still loading" : "paged view";
+    return false;
+  }
   if (!hasEnding(path, ".md"))
     trimTrailingWhiteSpaces();
   if (path == "-") {
-    auto &stream = std::cout;
-    for (size_t i = 0; i < _lines.size(); i++) {
-      stream << convert_str(_lines[i]);
-      if (i < _lines.size() - 1)
-        stream << "\n";
-    }
+    std::cout.flush();
+    _writer.write(_lines, 1);
     exit(0);
     return true;
   }
-  std::ofstream stream(path, std::ofstream::out);
-  if (!stream.is_open()) {
+  auto &source = _lines.getSource();
+  // the raw bytes of a truncated file are not there to be written
+  if (source && !source->checkIntact())
+    detachFromDisk();
+#ifdef _WIN32
+  if (source && std::filesystem::exists(path) &&
+      std::filesystem::equivalent(source->getPath(), path)) {
+    // windows refuses to replace a file that is still mapped
+    _lines.detach();
+  }
+#endif
+  _writer.sync = sync;
+  if (!_writer.save(_lines, path))
     return false;
-  }
-  for (size_t i = 0; i < _lines.size(); i++) {
-    stream << convert_str(_lines[i]);
-    if (i < _lines.size() - 1)
-      stream << "\n";
-  }
-  stream.flush();
-  stream.close();
   _last_write_time = std::filesystem::last_write_time(path);
   _edited = false;
   return true;
@@ -1023,6 +1343,7 @@ bool Document::saveTo(std::string path) {
 
 std::vector<std::pair<int, std::u16string>> *
 Document::getContent(int cellWidth, float maxWidth, bool onlyCalculate) {
+  slideWindow();
   _prepare.clear();
   int end = _skip + _maxLines;
   if (end >= _lines.size()) {
@@ -1046,10 +1367,10 @@ Document::getContent(int cellWidth, float maxWidth, bool onlyCalculate) {
   if (onlyCalculate)
     return nullptr;
   int maxSupport = 0;
-  for (size_t i = _skip; i < end; i++) {
-    auto s = _lines[i];
+  _lines.forEach(_skip, end, [&](size_t, const std::u16string &s) {
     _prepare.push_back(std::pair<int, std::u16string>(s.length(), s));
-  }
+    return true;
+  });
   auto substr = _lines[_y].substr(0, _useXFallback ? _xSave : _x);
   float neededAdvance = getCells(substr) * cellWidth;
   int xOffset = 0;
@@ -1087,8 +1408,11 @@ Document::getContent(int cellWidth, float maxWidth, bool onlyCalculate) {
 
 void Document::moveLine(int diff) {
   int targetY = _y + diff;
-  if (targetY < 0 || targetY == _lines.size())
+  if (targetY < 0 || targetY == _lines.size() || isReadOnly())
     return;
+  int upper = targetY < _y ? targetY : _y;
+  historyPush(upper, 0, _lines[upper] + u"\n" + _lines[upper + 1],
+              _lines[upper + 1] + u"\n" + _lines[upper]);
   if (targetY < _y) {
     std::u16string toOffset = _lines[_y - 1];
     _lines[_y - 1] = _lines[_y];
@@ -1101,23 +1425,7 @@ void Document::moveLine(int diff) {
   _y = targetY;
 }
 
-void Document::calcTotalOffset() {
-  int offset = 0;
-  for (int i = 0; i < _skip; i++) {
-    offset += _lines[i].length() + 1;
-  }
-  _totalCharOffset = offset;
-}
-
-int Document::getTotalOffset() {
-  if (_cachedY != _y || _cachedX != _x || _cachedMaxLines != _maxLines) {
-    calcTotalOffset();
-    _cachedMaxLines = _maxLines;
-    _cachedY = _y;
-    _cachedX = _x;
-  }
-  return _totalCharOffset;
-}
+int Document::getTotalOffset() { return _lines.offsetOf(_skip); }
 
 std::vector<std::string> Document::getSaveLocKeys() {
   std::vector<std::string> ls;
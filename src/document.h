@@ -1,11 +1,18 @@
 #pragma once
 
 #include "selection.h"
+#include "line_buffer.h"
+#include "file_writer.h"
+#include "file_loader.h"
+#include "file_follower.h"
+#include "paged_file.h"
+#include "undo_log.h"
+#include "text_search.h"
 #include <string>
 #include <map>
 #include <vector>
-#include <deque>
 #include <memory>
+#include <functional>
 #ifndef __APPLE__
 #include <filesystem>
 #endif
@@ -14,19 +21,11 @@ struct PosEntry {
   int x, y, skip;
 };
 
-struct HistoryEntry {
-  int x, y;
-  int mode;
-  int length;
-  void *userData;
-  std::u16string content;
-  std::vector<std::u16string> extra;
-};
-
-struct CommentEntry {
-  int firstOffset;
-  int yStart;
-  std::u16string commentStr;
+// lines [from, oldEnd) of an earlier version that are [from, newEnd) now
+struct LineChange {
+  size_t from;
+  size_t oldEnd;
+  size_t newEnd;
 };
 
 class Document {
@@ -35,13 +34,41 @@ class Document {
   bool _useXFallback;
   std::map<std::string, PosEntry> _saveLocs;
   std::filesystem::file_time_type _last_write_time;
+  std::unique_ptr<FileLoader> _loader;
+  std::unique_ptr<FileFollower> _follower;
+  std::function<void()> _onLoad;
+  // lines kept while following, older ones are dropped, 0 keeps all
+  size_t _followMaxLines = 0;
+  // Files at least this large are shown through a window of decoded lines,
+  // 0 never pages.
+  uint64_t _pagedThreshold = 0;
+  std::shared_ptr<PagedFile> _paged;
+  // where every line of the window starts, the last entry is its end
+  std::vector<uint64_t> _pageOffsets;
+  // line number of the first line of the window, -1 while unknown
+  int64_t _pageBase = 0;
+  int _pageProgress = 0;
+  // open beginTransaction calls and whether the outermost recorded an edit
+  int _transactionDepth = 0;
+  bool _transactionStarted = false;
+  // filled by the editor itself, like the results of a search
+  bool _readOnly = false;
+  // the lines changed since version _changeBase, all in one range
+  LineChange _change{0, 0, 0};
+  bool _hasChange = false;
+  size_t _changeBase = 0;
 
 public:
   std::string _branch;
   bool _edited = false;
-  std::vector<std::u16string> _lines;
+  // the file changed on disk and the user was not asked to reload it yet
+  bool _changedOnDisk = false;
+  // bumped whenever the lines change, results computed from them compare it
+  size_t _version = 0;
+  LineBuffer _lines;
   Selection _selection;
-  std::deque<HistoryEntry> _history;
+  UndoLog _history;
+  FileWriter _writer;
 
   int _x = 0;
   int _y = 0;
@@ -52,18 +79,21 @@ public:
   float _height = 0;
   float _lineHeight = 0;
   int _maxLines = 0;
-  int _totalCharOffset = 0;
-  int _cachedY = 0;
-  int _cachedX = 0;
-  int _cachedMaxLines = 0;
 
   float _startX = 0;
   float _startY = 0;
   std::vector<std::pair<int, std::u16string>> _prepare;
   std::u16string *_bind = nullptr;
 
-  Document() { _lines.push_back(u""); }
-  static std::shared_ptr<Document> open(const std::string &path);
+  Document() {
+    _lines.push_back(u"");
+    forgetChanges();
+  }
+  // onLoad is called from the loader thread while a large file is still
+  // being indexed in the background
+  static std::shared_ptr<Document> open(const std::string &path,
+                                        std::function<void()> onLoad = nullptr,
+                                        uint64_t pagedThreshold = 0);
 
   std::string getPath() const { return _path; }
   void setPath(const std::string &path) { _path = path; }
@@ -73,7 +103,16 @@ public:
   std::string getSelection();
   int getSelectionSize();
 
+  // Lines changed since version: change tells which and all other lines are
+  // the same. False when that is not known, only the changes since the
+  // last forgetChanges() are kept.
+  bool changesSince(size_t version, LineChange &change) const;
+  void forgetChanges();
+
 private:
+  // bumps the version, old lines [line, line + removed) are now
+  // [line, line + inserted)
+  void changed(size_t line, size_t removed, size_t inserted);
   void trimTrailingWhiteSpaces();
   void setPosFromMouse(float mouseX, float mouseY, class FontAtlas *atlas);
   void reset();
@@ -82,27 +121,78 @@ private:
 public:
   void advanceWordBackwards();
   std::u16string replaceOne(std::u16string what, std::u16string replace,
-                            bool allowCenter = true, bool shouldOffset = true);
-  size_t replaceAll(std::u16string what, std::u16string replace);
+                            bool allowCenter = true, bool shouldOffset = true,
+                            SearchOptions options = SearchOptions());
+  size_t replaceAll(std::u16string what, std::u16string replace,
+                    SearchOptions options = SearchOptions());
   void bindTo(std::u16string *entry, bool useXSave = false);
   void unbind();
+  // Looks for the next match from the cursor line, or from the start of the
+  // buffer if shouldOffset is false. skipFirst continues after the match the
+  // cursor is on.
   std::u16string search(std::u16string what, bool skipFirst,
-                        bool shouldOffset = true);
+                        bool shouldOffset = true,
+                        SearchOptions options = SearchOptions());
+  // Moves to a match found elsewhere the way search does.
+  std::u16string showMatch(size_t line, size_t column);
   std::u16string deleteWord();
   bool undo();
+  bool redo();
+  // Edits between these undo and redo as one step, transactions nest.
+  void beginTransaction();
+  void commitTransaction();
   void gotoLine(int l);
   bool didChange(std::string path);
   bool reloadFile(std::string path);
+  // Stops reading lines from the mapped file once it changed on disk, it
+  // may have been truncated under them. Read only buffers load it again.
+  void detachFromDisk();
   void advanceWord();
+  bool isLoading() const { return _loader != nullptr; }
+  int getLoadProgress() const { return _loader ? _loader->getProgress() : 100; }
+  // the buffer can't be edited until it is fully loaded, while following,
+  // when paged and when the editor fills it
+  bool isReadOnly() const {
+    return _readOnly || _loader || _follower || _paged;
+  }
+  void setReadOnly(bool readOnly) { _readOnly = readOnly; }
+  // adds lines after the last one, they are not part of the history
+  void appendLines(std::vector<std::u16string> lines);
+  // replaces all lines or one of them, outside of the history as well
+  void setLines(std::vector<std::u16string> lines);
+  void replaceLine(size_t line, std::u16string text);
+  // picks up lines the loader found since the last call, true if any
+  bool pollLoader();
+  bool isFollowing() const { return _streamMode; }
+  // Starts or stops appending what gets written to the file, like tail -f.
+  // Returns false if the file can't be followed.
+  bool follow(bool enable, size_t maxLines = 0);
+  // appends what the follower read since the last call, true if any
+  bool pollFollower();
+  bool isPaged() const { return _paged != nullptr; }
+  int getIndexProgress() const { return _paged ? _paged->getProgress() : 100; }
+  // line number of the cursor in the file, -1 if not known yet
+  int64_t getLineNumber() const;
+  void gotoPercent(int percent);
+  void gotoEnd();
 
 private:
   void center(int l);
-
-  void historyPush(int mode, int length, std::u16string content);
-  void historyPush(int mode, int length, std::u16string content,
-                   void *userData);
-  void historyPushWithExtra(int mode, int length, std::u16string content,
-                            std::vector<std::u16string> extra);
+  bool load(const std::string &path);
+  void startFollowing();
+  void loadWindow(uint64_t start, int64_t base);
+  void showPagedLine(uint64_t offset, int64_t line);
+  void slideWindow();
+  std::u16string searchPaged(const std::u16string &what, bool skipFirst,
+                             bool shouldOffset);
+
+  // Records that at y, x removed was replaced by inserted, with the cursor
+  // still where it was before the edit. Keystrokes coalesce into runs.
+  void historyPush(int y, int x, const std::u16string &removed,
+                   const std::u16string &inserted, bool keystroke = false);
+  // applies a recorded edit to the lines, both texts may span lines
+  void replaceText(int y, int x, const std::u16string &removed,
+                   const std::u16string &inserted);
   bool openFile(std::string oldPath, std::string path);
   void appendWithLines(std::u16string content);
 
@@ -116,15 +206,15 @@ public:
   std::u16string getCurrentAdvance(bool useSaveValue = false);
   void jumpStart();
   void jumpEnd();
-  bool saveTo(std::string path);
+  bool saveTo(std::string path, bool sync = false);
   std::vector<std::pair<int, std::u16string>> *
   getContent(int cellWidth, float maxWidth, bool onlyCalculate);
+  // character offset of the first visible line
   int getTotalOffset();
   void moveLine(int diff);
   void moveRight();
   void moveLeft();
 
 private:
-  void calcTotalOffset();
   std::vector<std::string> getSaveLocKeys();
 };
@@ -0,0 +1,256 @@
+#include "file_follower.h"
+#include "u8String.h"
+#include <string.h>
+#ifdef _WIN32
+#include <Windows.h>
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#endif
+
+static const size_t READ_SIZE = 1024 * 1024;
+// how often files are checked when there is no inotify
+static const int POLL_INTERVAL = 250;
+
+static const char *findLast(const char *data, size_t length, char c) {
+  while (length--)
+    if (data[length] == c)
+      return data + length;
+  return nullptr;
+}
+
+FileFollower::FileFollower(const std::string &path, uint64_t offset,
+                           std::function<void()> notify)
+    : _path(path), _stdin(path == "-"), _offset(offset), _notify(notify) {
+#ifdef _WIN32
+  _fd = _stdin ? 0 : _open(path.c_str(), _O_RDONLY | _O_BINARY);
+  if (_fd >= 0 && !_stdin)
+    _lseeki64(_fd, offset, SEEK_SET);
+#else
+  _fd = _stdin ? 0 : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (_fd >= 0 && !_stdin)
+    lseek(_fd, offset, SEEK_SET);
+  if (_fd >= 0 && pipe(_wake) != 0)
+    _wake[0] = _wake[1] = -1;
+#endif
+  if (_fd >= 0)
+    _thread = std::thread(&FileFollower::run, this);
+}
+
+FileFollower::~FileFollower() {
+  _cancel = true;
+#ifdef _WIN32
+  if (_thread.joinable())
+    _thread.join();
+  if (_fd > 0)
+    _close(_fd);
+#else
+  if (_wake[1] >= 0) {
+    ssize_t written = ::write(_wake[1], "x", 1);
+    (void)written;
+  }
+  if (_thread.joinable())
+    _thread.join();
+  if (_fd > 0)
+    close(_fd);
+  if (_wake[0] >= 0) {
+    close(_wake[0]);
+    close(_wake[1]);
+  }
+#endif
+}
+
+bool FileFollower::take(std::vector<std::u16string> &pieces, bool &truncated) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _signalled = false;
+  truncated = _truncated;
+  _truncated = false;
+  if (!_pending.size() && !truncated)
+    return false;
+  pieces.clear();
+  std::swap(pieces, _pending);
+  return true;
+}
+
+bool FileFollower::hasEnded() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _ended && !_pending.size();
+}
+
+void FileFollower::publish(std::vector<std::u16string> &pieces, bool end) {
+  bool wake;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (pieces.size()) {
+      if (_pending.size()) {
+        _pending.back() += pieces[0];
+        _pending.insert(_pending.end(), std::make_move_iterator(pieces.begin() + 1),
+                        std::make_move_iterator(pieces.end()));
+      } else {
+        _pending = std::move(pieces);
+      }
+    }
+    _ended = end;
+    // one wake up per frame is enough, the UI takes everything at once
+    wake = !_signalled;
+    _signalled = true;
+  }
+  pieces.clear();
+  if (wake && _notify)
+    _notify();
+}
+
+void FileFollower::consume(const char *data, size_t length,
+                           std::string &partial) {
+  const char *last = findLast(data, length, '\n');
+  if (!last) {
+    partial.append(data, length);
+    return;
+  }
+  std::vector<std::u16string> pieces;
+  const char *start = data;
+  const char *end = last + 1;
+  bool first = true;
+  while (start < end) {
+    const char *newline = (const char *)memchr(start, '\n', end - start);
+    if (first && partial.length()) {
+      partial.append(start, newline - start);
+      pieces.push_back(create(partial));
+      partial.clear();
+    } else {
+      pieces.push_back(create(start, newline - start));
+    }
+    first = false;
+    start = newline + 1;
+  }
+  // the line after the last newline, empty until more arrives
+  pieces.push_back(u"");
+  partial.append(end, data + length - end);
+  publish(pieces, false);
+}
+
+bool FileFollower::wait(int timeout) {
+#ifdef _WIN32
+  if (!_stdin) {
+    Sleep(timeout < 0 ? POLL_INTERVAL : timeout);
+    return !_cancel;
+  }
+  // peek first so the read below never blocks and cancel stays responsive
+  HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+  DWORD available = 0;
+  while (!_cancel &&
+         PeekNamedPipe(input, nullptr, 0, nullptr, &available, nullptr) &&
+         !available)
+    Sleep(10);
+  return !_cancel;
+#else
+  struct pollfd fds[2];
+  fds[0].fd = _wake[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = _stdin ? _fd : -1;
+  fds[1].events = POLLIN;
+  if (poll(fds, 2, timeout) < 0 && errno != EINTR)
+    return false;
+  return !_cancel;
+#endif
+}
+
+void FileFollower::run() {
+  std::vector<char> buffer(READ_SIZE);
+  std::string partial;
+#ifdef __linux__
+  int watch = -1;
+  if (!_stdin) {
+    watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch >= 0 &&
+        inotify_add_watch(watch, _path.c_str(), IN_MODIFY | IN_ATTRIB) < 0) {
+      close(watch);
+      watch = -1;
+    }
+  }
+#endif
+  while (!_cancel) {
+    if (_stdin) {
+      if (!wait(-1))
+        break;
+#ifdef _WIN32
+      int got = _read(_fd, buffer.data(), (unsigned int)buffer.size());
+#else
+      ssize_t got = ::read(_fd, buffer.data(), buffer.size());
+      if (got < 0 && errno == EINTR)
+        continue;
+#endif
+      if (got <= 0) {
+        // what is left of the stream is its last line
+        std::vector<std::u16string> rest;
+        rest.push_back(create(partial));
+        publish(rest, true);
+        break;
+      }
+      consume(buffer.data(), got, partial);
+      continue;
+    }
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_fstat64(_fd, &info) == 0 && (uint64_t)info.st_size < _offset) {
+#else
+    struct stat info;
+    if (fstat(_fd, &info) == 0 && (uint64_t)info.st_size < _offset) {
+#endif
+      // truncated in place, as log rotation with copytruncate does
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending.clear();
+        _truncated = true;
+      }
+      partial.clear();
+      _offset = 0;
+#ifdef _WIN32
+      _lseeki64(_fd, 0, SEEK_SET);
+#else
+      lseek(_fd, 0, SEEK_SET);
+#endif
+      std::vector<std::u16string> none;
+      publish(none, false);
+    }
+    while (!_cancel) {
+#ifdef _WIN32
+      int got = _read(_fd, buffer.data(), (unsigned int)buffer.size());
+#else
+      ssize_t got = ::read(_fd, buffer.data(), buffer.size());
+      if (got < 0 && errno == EINTR)
+        continue;
+#endif
+      if (got <= 0)
+        break;
+      _offset += got;
+      consume(buffer.data(), got, partial);
+    }
+#ifdef __linux__
+    if (watch >= 0) {
+      struct pollfd fds[2] = {{_wake[0], POLLIN, 0}, {watch, POLLIN, 0}};
+      if (poll(fds, 2, -1) < 0 && errno != EINTR)
+        break;
+      char events[4096];
+      while (::read(watch, events, sizeof(events)) > 0) {
+      }
+      continue;
+    }
+#endif
+    if (!wait(POLL_INTERVAL))
+      break;
+  }
+#ifdef __linux__
+  if (watch >= 0)
+    close(watch);
+#endif
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+/*
+  Reads what gets appended to a file or to stdin on a worker thread, the
+  way tail -f does. Files are watched with inotify where it exists and
+  polled elsewhere. Only the new bytes are read and only up to the last
+  '\n' is decoded, the rest of a line still being written waits for its
+  newline.
+  The text handed out by take() is split at its newlines: the first piece
+  continues the last line of the buffer, every further piece starts a new
+  line.
+*/
+class FileFollower {
+  std::string _path;
+  bool _stdin;
+  int _fd = -1;
+  uint64_t _offset;
+  std::function<void()> _notify;
+  std::thread _thread;
+  std::atomic<bool> _cancel{false};
+#ifndef _WIN32
+  int _wake[2] = {-1, -1};
+#endif
+
+  std::mutex _mutex;
+  std::vector<std::u16string> _pending;
+  bool _signalled = false;
+  bool _truncated = false;
+  bool _ended = false;
+
+public:
+  // follows path from byte offset on, "-" follows stdin
+  FileFollower(const std::string &path, uint64_t offset,
+               std::function<void()> notify);
+  FileFollower(const FileFollower &) = delete;
+  FileFollower &operator=(const FileFollower &) = delete;
+  ~FileFollower();
+
+  bool isValid() const { return _fd >= 0; }
+  // Moves the pieces read since the last call into pieces. truncated is set
+  // when the file shrank, the pieces then start over at its beginning.
+  bool take(std::vector<std::u16string> &pieces, bool &truncated);
+  // stdin was closed, nothing will follow
+  bool hasEnded();
+
+private:
+  void run();
+  bool wait(int timeout);
+  void consume(const char *data, size_t length, std::string &partial);
+  void publish(std::vector<std::u16string> &pieces, bool end);
+};
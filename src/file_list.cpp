@@ -0,0 +1,72 @@
+#include "file_list.h"
+#include "project_walker.h"
+
+FileList::FileList(const std::string &root, std::function<void()> notify)
+    : _root(root), _notify(std::move(notify)) {
+  _crawling = true;
+  _thread = std::thread(&FileList::crawl, this);
+}
+
+FileList::~FileList() {
+  _cancel = true;
+  if (_thread.joinable())
+    _thread.join();
+}
+
+void FileList::crawl() {
+  ProjectWalker::walk(_root, 0, _cancel,
+                      [this](size_t, const std::string &,
+                             const std::string &relative) {
+                        bool wasEmpty;
+                        {
+                          std::lock_guard<std::mutex> lock(_mutex);
+                          wasEmpty = _found.empty();
+                          _found.push_back(relative);
+                        }
+                        // once is enough until update() picked them up
+                        if (wasEmpty && _notify)
+                          _notify();
+                      });
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _done = true;
+  }
+  if (_notify)
+    _notify();
+}
+
+bool FileList::update() {
+  if (!_crawling)
+    return false;
+  std::vector<std::string> found;
+  bool done;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    found.swap(_found);
+    done = _done;
+  }
+  auto &target = _replacing ? _next : _paths;
+  target.insert(target.end(), std::make_move_iterator(found.begin()),
+                std::make_move_iterator(found.end()));
+  bool changed = !_replacing && found.size();
+  if (done) {
+    _thread.join();
+    if (_replacing) {
+      _paths.swap(_next);
+      _next.clear();
+      _next.shrink_to_fit();
+      _generation++;
+      changed = true;
+    }
+    _crawling = _replacing = _done = false;
+    _crawled = std::chrono::steady_clock::now();
+  }
+  return changed;
+}
+
+void FileList::refresh(std::chrono::steady_clock::duration interval) {
+  if (_crawling || std::chrono::steady_clock::now() - _crawled < interval)
+    return;
+  _crawling = _replacing = true;
+  _thread = std::thread(&FileList::crawl, this);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+  The files below a root as a ProjectWalker finds them, so ignored files
+  are left out, crawled on a thread of its own. The first crawl adds files
+  to paths() as they are found, a later one from refresh() builds a new
+  list aside and swaps it in whole, so a list being looked at never loses
+  entries halfway. paths() and update() belong to the thread that made the
+  list.
+*/
+class FileList {
+  std::string _root;
+  std::function<void()> _notify;
+  std::vector<std::string> _paths;
+  // bumped whenever _paths is replaced instead of appended to
+  size_t _generation = 0;
+  bool _crawling = false;
+  bool _replacing = false;
+  std::vector<std::string> _next;
+  std::chrono::steady_clock::time_point _crawled;
+
+  std::mutex _mutex;
+  std::vector<std::string> _found;
+  bool _done = false;
+  std::atomic<bool> _cancel{false};
+  std::thread _thread;
+
+public:
+  // notify is called from the crawling thread when files were found
+  FileList(const std::string &root, std::function<void()> notify);
+  FileList(const FileList &) = delete;
+  FileList &operator=(const FileList &) = delete;
+  ~FileList();
+
+  const std::string &root() const { return _root; }
+  // below the root, separated by '/'
+  const std::vector<std::string> &paths() const { return _paths; }
+  size_t generation() const { return _generation; }
+  bool isCrawling() const { return _crawling; }
+  // Picks up what the crawl found, true if paths() changed.
+  bool update();
+  // Crawls again unless that is going on or the last crawl ended less
+  // than interval ago.
+  void refresh(std::chrono::steady_clock::duration interval);
+
+private:
+  void crawl();
+};
@@ -0,0 +1,58 @@
+#include "file_loader.h"
+#include <chrono>
+
+static const size_t CHUNK_SIZE = 4 * 1024 * 1024;
+// the UI is woken at most this often while loading
+static const auto NOTIFY_INTERVAL = std::chrono::milliseconds(50);
+
+FileLoader::FileLoader(std::shared_ptr<LineSource> source,
+                       std::function<void()> notify)
+    : _source(source), _data(source->data()), _size(source->byteSize()),
+      _notify(notify), _scanned(source->scannedBytes()) {
+  _thread = std::thread(&FileLoader::run, this);
+}
+
+FileLoader::~FileLoader() {
+  _cancel = true;
+  _thread.join();
+}
+
+void FileLoader::run() {
+  size_t offset = _scanned;
+  auto last = std::chrono::steady_clock::now();
+  while (offset < _size && !_cancel) {
+    size_t length = _size - offset < CHUNK_SIZE ? _size - offset : CHUNK_SIZE;
+    LineIndex part;
+    part.scan(_data + offset, length, offset);
+    offset += length;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _pending.append(part);
+      _scanned = offset;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (_notify && (offset == _size || now - last >= NOTIFY_INTERVAL)) {
+      last = now;
+      _notify();
+    }
+  }
+}
+
+bool FileLoader::take() {
+  LineIndex found;
+  size_t scanned;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_scanned == _source->scannedBytes())
+      return false;
+    std::swap(found, _pending);
+    scanned = _scanned;
+  }
+  _source->extend(found, scanned);
+  return true;
+}
+
+int FileLoader::getProgress() const {
+  size_t size = _source->byteSize();
+  return size ? (int)(_source->scannedBytes() * 100 / size) : 100;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "line_source.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*
+  Indexes the rest of a partially opened LineSource on a worker thread.
+  The worker only ever reads the mapping, newly found line starts are kept
+  aside until the UI thread moves them into the source with take(), so the
+  source and everything built on it stay owned by the UI thread.
+*/
+class FileLoader {
+  std::shared_ptr<LineSource> _source;
+  const char *_data;
+  size_t _size;
+  std::function<void()> _notify;
+  std::thread _thread;
+  std::atomic<bool> _cancel{false};
+
+  std::mutex _mutex;
+  LineIndex _pending;
+  size_t _scanned;
+
+public:
+  // notify is called from the worker whenever there is something to take
+  FileLoader(std::shared_ptr<LineSource> source, std::function<void()> notify);
+  FileLoader(const FileLoader &) = delete;
+  FileLoader &operator=(const FileLoader &) = delete;
+  ~FileLoader();
+
+  // Moves what the worker found so far into the source, returns false if
+  // there was nothing new.
+  bool take();
+  bool isDone() const { return _source->isComplete(); }
+  int getProgress() const;
+
+private:
+  void run();
+};
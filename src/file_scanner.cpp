@@ -0,0 +1,245 @@
+#include "file_scanner.h"
+#include "simd.h"
+#include "u8String.h"
+#include <cstring>
+
+static const size_t NOT_FOUND = (size_t)-1;
+// bytes checked for a NUL to tell a binary file
+static const size_t BINARY_PROBE = 8 * 1024;
+// the byte filter and the line loop look at cancel this often
+static const size_t BYTES_PER_CHECK = 1024 * 1024;
+static const size_t LINES_PER_CHECK = 4096;
+
+static unsigned char otherCase(unsigned char c) {
+  if (c >= 'a' && c <= 'z')
+    return c - 32;
+  if (c >= 'A' && c <= 'Z')
+    return c + 32;
+  return c;
+}
+
+#ifdef LEDIT_SSE2
+// candidates starting in [from, last], the ones verify accepts end the scan
+template <typename F>
+static size_t filterSse2(const char *data, size_t from, size_t last,
+                         size_t length, const unsigned char *first,
+                         const unsigned char *final, F &verify,
+                         size_t &match) {
+  __m128i first0 = _mm_set1_epi8((char)first[0]);
+  __m128i first1 = _mm_set1_epi8((char)first[1]);
+  __m128i final0 = _mm_set1_epi8((char)final[0]);
+  __m128i final1 = _mm_set1_epi8((char)final[1]);
+  size_t i = from;
+  for (; i + 16 <= last + 1; i += 16) {
+    __m128i head = _mm_loadu_si128((const __m128i *)(data + i));
+    __m128i tail = _mm_loadu_si128((const __m128i *)(data + i + length - 1));
+    __m128i hit = _mm_and_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(head, first0),
+                     _mm_cmpeq_epi8(head, first1)),
+        _mm_or_si128(_mm_cmpeq_epi8(tail, final0),
+                     _mm_cmpeq_epi8(tail, final1)));
+    uint32_t mask = _mm_movemask_epi8(hit);
+    while (mask) {
+      int bit = simd::ctz(mask);
+      if (verify(i + bit)) {
+        match = i + bit;
+        return i;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return i;
+}
+#endif
+
+#ifdef LEDIT_AVX2
+template <typename F>
+LEDIT_AVX2_TARGET static size_t
+filterAvx2(const char *data, size_t from, size_t last, size_t length,
+           const unsigned char *first, const unsigned char *final, F &verify,
+           size_t &match) {
+  __m256i first0 = _mm256_set1_epi8((char)first[0]);
+  __m256i first1 = _mm256_set1_epi8((char)first[1]);
+  __m256i final0 = _mm256_set1_epi8((char)final[0]);
+  __m256i final1 = _mm256_set1_epi8((char)final[1]);
+  size_t i = from;
+  for (; i + 32 <= last + 1; i += 32) {
+    __m256i head = _mm256_loadu_si256((const __m256i *)(data + i));
+    __m256i tail =
+        _mm256_loadu_si256((const __m256i *)(data + i + length - 1));
+    __m256i hit = _mm256_and_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(head, first0),
+                        _mm256_cmpeq_epi8(head, first1)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(tail, final0),
+                        _mm256_cmpeq_epi8(tail, final1)));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(hit);
+    while (mask) {
+      int bit = simd::ctz(mask);
+      if (verify(i + bit)) {
+        match = i + bit;
+        return i;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return i;
+}
+#endif
+
+FileScanner::FileScanner(const std::u16string &term, SearchOptions options) {
+  if (options.regex) {
+    _regex = std::make_unique<RegexSearch>(term, options);
+    return;
+  }
+  _literal = std::make_unique<TextSearch>(term, options);
+  bool ascii = true;
+  for (char16_t c : term)
+    ascii &= c < 0x80;
+  std::string bytes = convert_str(term);
+  // invalid UTF-16 or U+FFFD could match bytes that differ from it
+  bool exact = create(bytes) == term &&
+               term.find(u'\uFFFD') == std::u16string::npos;
+  if (bytes.empty() || !exact || (options.ignoreCase && !ascii))
+    return;
+  _bytes = std::move(bytes);
+  _foldAscii = options.ignoreCase;
+  unsigned char head = _bytes.front();
+  unsigned char tail = _bytes.back();
+  _first[0] = _first[1] = head;
+  _last[0] = _last[1] = tail;
+  if (_foldAscii) {
+    _first[1] = otherCase(head);
+    _last[1] = otherCase(tail);
+  }
+}
+
+FileScanner::FileScanner(const FileScanner &other)
+    : _bytes(other._bytes), _foldAscii(other._foldAscii) {
+  if (other._regex)
+    _regex = std::make_unique<RegexSearch>(*other._regex);
+  if (other._literal)
+    _literal = std::make_unique<TextSearch>(*other._literal);
+  memcpy(_first, other._first, sizeof(_first));
+  memcpy(_last, other._last, sizeof(_last));
+}
+
+FileScanner::~FileScanner() {}
+
+bool FileScanner::isBinary(const char *data, size_t size) {
+  return memchr(data, 0, size < BINARY_PROBE ? size : BINARY_PROBE);
+}
+
+bool FileScanner::equalBytes(const char *data) const {
+  if (!_foldAscii)
+    return !memcmp(data, _bytes.data(), _bytes.length());
+  for (size_t i = 0; i < _bytes.length(); i++) {
+    unsigned char c = data[i];
+    unsigned char want = _bytes[i];
+    if (c != want && otherCase(c) != want)
+      return false;
+  }
+  return true;
+}
+
+size_t FileScanner::findBytes(const char *data, size_t from,
+                              size_t last) const {
+  size_t length = _bytes.length();
+  auto verify = [&](size_t at) { return equalBytes(data + at); };
+  size_t i = from;
+  size_t match = NOT_FOUND;
+  bool filtered = false;
+#ifdef LEDIT_AVX2
+  if (simd::hasAvx2()) {
+    i = filterAvx2(data, i, last, length, _first, _last, verify, match);
+    filtered = true;
+  }
+#endif
+#ifdef LEDIT_SSE2
+  if (!filtered)
+    i = filterSse2(data, i, last, length, _first, _last, verify, match);
+#endif
+  if (match != NOT_FOUND)
+    return match;
+  for (; i <= last; i++) {
+    unsigned char head = data[i];
+    unsigned char tail = data[i + length - 1];
+    if ((head == _first[0] || head == _first[1]) &&
+        (tail == _last[0] || tail == _last[1]) && verify(i))
+      return i;
+  }
+  return NOT_FOUND;
+}
+
+bool FileScanner::matchLine(size_t line, const std::u16string &text,
+                            const MatchCallback &fn) {
+  size_t from = 0;
+  RegexMatch match;
+  while (from <= text.length()) {
+    size_t start, end;
+    if (_regex) {
+      if (!_regex->find(text.data(), text.length(), from, match))
+        break;
+      start = match.start();
+      end = match.end();
+    } else {
+      start = _literal->find(text.data(), text.length(), from);
+      if (start == std::u16string::npos)
+        break;
+      end = start + _literal->length();
+    }
+    if (!fn(line, text, start, end - start))
+      return false;
+    // an empty match moves on by a character, it would be found again
+    from = end > start ? end : end + 1;
+  }
+  return true;
+}
+
+void FileScanner::scan(const char *data, size_t size, const MatchCallback &fn,
+                       const std::atomic<bool> *cancel) {
+  std::u16string text;
+  if (_bytes.empty()) {
+    const char *at = data;
+    const char *end = data + size;
+    for (size_t line = 0;; line++) {
+      if (line % LINES_PER_CHECK == 0 && cancel && *cancel)
+        return;
+      const char *newline =
+          at < end ? (const char *)memchr(at, '\n', end - at) : nullptr;
+      text.clear();
+      appendUtf16(text, at, (newline ? newline : end) - at);
+      if (!matchLine(line, text, fn) || !newline)
+        return;
+      at = newline + 1;
+    }
+  }
+  size_t length = _bytes.length();
+  // the line number of counted, a line start everything before is counted up
+  size_t line = 0;
+  const char *counted = data;
+  size_t at = 0;
+  while (at + length <= size) {
+    if (cancel && *cancel)
+      return;
+    size_t last = size - length;
+    if (last - at > BYTES_PER_CHECK)
+      last = at + BYTES_PER_CHECK;
+    size_t hit = findBytes(data, at, last);
+    if (hit == NOT_FOUND) {
+      at = last + 1;
+      continue;
+    }
+    const char *start = data + hit;
+    while (start > counted && start[-1] != '\n')
+      start--;
+    line += simd::countNewlines(counted, start - counted);
+    counted = start;
+    auto newline = (const char *)memchr(data + hit, '\n', size - hit);
+    const char *end = newline ? newline : data + size;
+    text.clear();
+    appendUtf16(text, start, end - start);
+    if (!matchLine(line, text, fn))
+      return;
+    at = end - data + 1;
+  }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "regex_search.h"
+#include "text_search.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+/*
+  Finds the matches of a search term in the raw bytes of a file without
+  decoding all of it. A literal term that is case sensitive or folds plain
+  ASCII only is looked for in the bytes first: candidates are found a vector
+  at a time by their first and last byte, the way TextSearch filters
+  characters, and only the lines holding one are decoded and searched again,
+  which settles whole words and the columns. Regex terms and folded non
+  ASCII ones decode every line. Lines end at '\n' like in LineSource.
+  The term has to be valid and a single line. scan() is not const for a
+  regex, use a copy per thread.
+*/
+class FileScanner {
+  std::unique_ptr<TextSearch> _literal;
+  std::unique_ptr<RegexSearch> _regex;
+  // the term in UTF-8 when the bytes can be filtered, empty otherwise
+  std::string _bytes;
+  bool _foldAscii = false;
+  // both cases of the first and the last byte
+  unsigned char _first[2];
+  unsigned char _last[2];
+
+public:
+  FileScanner(const std::u16string &term, SearchOptions options);
+  FileScanner(const FileScanner &other);
+  ~FileScanner();
+
+  // fn(line, text of the line, column, length) for every match in order,
+  // the callback returns false to stop
+  using MatchCallback =
+      std::function<bool(size_t, const std::u16string &, size_t, size_t)>;
+  // Scans data[0, size), stops early once cancel is set.
+  void scan(const char *data, size_t size, const MatchCallback &fn,
+            const std::atomic<bool> *cancel = nullptr);
+
+  // a NUL byte within the first few KiB, the way git and grep tell
+  static bool isBinary(const char *data, size_t size);
+
+private:
+  size_t findBytes(const char *data, size_t from, size_t last) const;
+  bool equalBytes(const char *data) const;
+  bool matchLine(size_t line, const std::u16string &text,
+                 const MatchCallback &fn);
+};
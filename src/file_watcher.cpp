@@ -0,0 +1,76 @@
+#include "file_watcher.h"
+#ifdef __linux__
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+
+FileWatcher::FileWatcher() { _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC); }
+
+FileWatcher::~FileWatcher() {
+  if (_fd >= 0)
+    close(_fd);
+}
+
+int FileWatcher::add(const std::string &path, uint32_t events) {
+  if (_fd < 0)
+    return -1;
+  uint32_t mask = 0;
+  if (events & MODIFIED)
+    mask |= IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE;
+  if (events & ENTRIES)
+    mask |= IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+  if (events & GONE)
+    mask |= IN_DELETE_SELF | IN_MOVE_SELF;
+  return inotify_add_watch(_fd, path.c_str(), mask);
+}
+
+void FileWatcher::remove(int watch) {
+  if (_fd >= 0 && watch >= 0)
+    inotify_rm_watch(_fd, watch);
+}
+
+bool FileWatcher::read(std::vector<WatchEvent> &out) {
+  if (_fd < 0)
+    return false;
+  size_t before = out.size();
+  // room for many events, a single one never exceeds it
+  alignas(struct inotify_event) char buffer[64 * 1024];
+  while (true) {
+    ssize_t got = ::read(_fd, buffer, sizeof(buffer));
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      break;
+    for (char *at = buffer; at < buffer + got;) {
+      auto *event = (struct inotify_event *)at;
+      at += sizeof(struct inotify_event) + event->len;
+      uint32_t events = 0;
+      if (event->mask & (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE))
+        events |= MODIFIED;
+      if (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))
+        events |= ENTRIES;
+      // the watch ends once the file is gone or removed, IN_IGNORED follows
+      if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED |
+                         IN_UNMOUNT))
+        events |= GONE;
+      // events were dropped, anything could have changed
+      if (event->mask & IN_Q_OVERFLOW)
+        events |= MODIFIED | ENTRIES;
+      out.push_back({event->wd, events, event->len ? event->name : ""});
+    }
+  }
+  return out.size() > before;
+}
+
+#else
+
+FileWatcher::FileWatcher() {}
+FileWatcher::~FileWatcher() {}
+int FileWatcher::add(const std::string &, uint32_t) { return -1; }
+void FileWatcher::remove(int) {}
+bool FileWatcher::read(std::vector<WatchEvent> &) { return false; }
+
+#endif
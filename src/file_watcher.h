@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct WatchEvent {
+  // -1 when events were lost, any watch may have changed then
+  int watch;
+  // FileWatcher flags
+  uint32_t events;
+  // the entry of a watched directory the event is about, empty for the
+  // watched path itself
+  std::string name;
+};
+
+/*
+  Reports changes to watched files and directories through inotify. There
+  is no watcher on other systems, isValid() is false there and callers
+  have to look at the files themselves. A watch that reports GONE is no
+  longer active.
+*/
+class FileWatcher {
+  int _fd = -1;
+
+public:
+  // the file was written to or its attributes changed
+  static const uint32_t MODIFIED = 1;
+  // entries were created, deleted or renamed in the directory
+  static const uint32_t ENTRIES = 2;
+  // the watched path was deleted or moved away
+  static const uint32_t GONE = 4;
+
+  FileWatcher();
+  FileWatcher(const FileWatcher &) = delete;
+  FileWatcher &operator=(const FileWatcher &) = delete;
+  ~FileWatcher();
+
+  bool isValid() const { return _fd >= 0; }
+  // readable when events are waiting, -1 without a watcher
+  int fd() const { return _fd; }
+  // Watches path for the events given, -1 if that failed. The same file
+  // watched twice gets the same watch back.
+  int add(const std::string &path, uint32_t events);
+  void remove(int watch);
+  // Appends the events waiting without blocking, false if there were none.
+  bool read(std::vector<WatchEvent> &out);
+};
@@ -0,0 +1,212 @@
+#include "file_writer.h"
+#include "u8String.h"
+#include <chrono>
+#include <filesystem>
+#include <string.h>
+#ifdef _WIN32
+#include <Windows.h>
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+static const size_t BUFFER_COUNT = 4;
+// spans at least this long are written from the mapping instead of copied
+static const size_t DIRECT_SPAN = 64 * 1024;
+static const size_t MAX_SEGMENTS = 512;
+
+void FileWriter::add(const char *data, size_t length) {
+  _buffers[_current].append(data, length);
+}
+
+void FileWriter::encode(const std::u16string &text) {
+  appendUtf8(_buffers[_current], text.data(), text.length());
+}
+
+void FileWriter::closeSegment() {
+  std::string &buffer = _buffers[_current];
+  if (buffer.size() > _segmentStart)
+    _segments.push_back(
+        {buffer.data() + _segmentStart, buffer.size() - _segmentStart});
+  // a buffer is never appended to again before the flush, the segment
+  // pointers into it stay valid
+  _current++;
+  _segmentStart = 0;
+}
+
+bool FileWriter::flush(int fd) {
+  size_t index = 0;
+  size_t offset = 0;
+  while (index < _segments.size()) {
+#ifdef _WIN32
+    const Segment &segment = _segments[index];
+    size_t left = segment.length - offset;
+    int result = _write(fd, segment.data + offset,
+                        (unsigned int)(left > 0x40000000 ? 0x40000000 : left));
+    if (result < 0) {
+      lastError = strerror(errno);
+      return false;
+    }
+    size_t done = result;
+#else
+    struct iovec vectors[64];
+    int count = 0;
+    for (size_t i = index; i < _segments.size() && count < 64; i++, count++) {
+      size_t skip = i == index ? offset : 0;
+      vectors[count].iov_base = (void *)(_segments[i].data + skip);
+      vectors[count].iov_len = _segments[i].length - skip;
+    }
+    ssize_t result = writev(fd, vectors, count);
+    if (result < 0) {
+      if (errno == EINTR)
+        continue;
+      lastError = strerror(errno);
+      return false;
+    }
+    size_t done = result;
+#endif
+    lastBytes += done;
+    // advance past what the kernel took, writes may be partial
+    while (done && index < _segments.size()) {
+      size_t left = _segments[index].length - offset;
+      if (done >= left) {
+        done -= left;
+        index++;
+        offset = 0;
+      } else {
+        offset += done;
+        done = 0;
+      }
+    }
+  }
+  _segments.clear();
+  for (auto &buffer : _buffers)
+    buffer.clear();
+  _current = 0;
+  _segmentStart = 0;
+  return true;
+}
+
+bool FileWriter::write(const LineBuffer &lines, int fd) {
+  if (_buffers.size() != BUFFER_COUNT) {
+    _buffers.resize(BUFFER_COUNT);
+    for (auto &buffer : _buffers)
+      buffer.reserve(bufferSize + bufferSize / 2);
+  }
+  for (auto &buffer : _buffers)
+    buffer.clear();
+  _segments.clear();
+  _current = 0;
+  _segmentStart = 0;
+  lastBytes = 0;
+  lastError = "";
+
+  bool ok = true;
+  bool first = true;
+  auto next = [&]() {
+    closeSegment();
+    if (_current == _buffers.size() || _segments.size() >= MAX_SEGMENTS)
+      return flush(fd);
+    return true;
+  };
+  lines.forEachChunk(
+      [&](const std::u16string *text, const char *raw, size_t rawLength) {
+        if (!first)
+          add("\n", 1);
+        first = false;
+        if (text) {
+          encode(*text);
+        } else if (rawLength >= DIRECT_SPAN) {
+          if (!(ok = next()))
+            return false;
+          _segments.push_back({raw, rawLength});
+        } else {
+          add(raw, rawLength);
+        }
+        if (_buffers[_current].size() >= bufferSize ||
+            _segments.size() >= MAX_SEGMENTS)
+          ok = next();
+        return ok;
+      });
+  if (!ok)
+    return false;
+  closeSegment();
+  return flush(fd);
+}
+
+bool FileWriter::save(const LineBuffer &lines, const std::string &path) {
+  auto start = std::chrono::steady_clock::now();
+  std::string target = path;
+  std::error_code error;
+  // replace the file a symlink points to, not the link itself
+  if (std::filesystem::is_symlink(path, error))
+    target = std::filesystem::canonical(path, error).generic_string();
+  std::filesystem::path targetPath(target);
+  std::string temp =
+      (targetPath.parent_path() / ("." + targetPath.filename().string() +
+                                   ".ledit-XXXXXX"))
+          .string();
+#ifdef _WIN32
+  temp.replace(temp.size() - 6, 6, "tmp");
+  int fd = _open(temp.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,
+                 _S_IREAD | _S_IWRITE);
+#else
+  int fd = mkstemp(&temp[0]);
+#endif
+  if (fd < 0) {
+    lastError = strerror(errno);
+    return false;
+  }
+#ifndef _WIN32
+  // mkstemp creates 0600, keep the mode of the file being replaced
+  struct stat info;
+  if (stat(target.c_str(), &info) == 0) {
+    fchmod(fd, info.st_mode & 07777);
+  } else {
+    mode_t mask = umask(0);
+    umask(mask);
+    fchmod(fd, 0666 & ~mask);
+  }
+#endif
+  bool ok = write(lines, fd);
+#ifdef _WIN32
+  if (ok && sync)
+    ok = _commit(fd) == 0;
+  _close(fd);
+  if (ok)
+    ok = MoveFileExA(temp.c_str(), target.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+  if (!ok)
+    _unlink(temp.c_str());
+#else
+  if (ok && sync)
+    ok = fsync(fd) == 0;
+  if (close(fd) != 0)
+    ok = false;
+  if (ok)
+    ok = rename(temp.c_str(), target.c_str()) == 0;
+  if (!ok) {
+    if (!lastError.length())
+      lastError = strerror(errno);
+    unlink(temp.c_str());
+  } else if (sync) {
+    // make the rename itself durable
+    std::string dir = targetPath.parent_path().string();
+    int dirFd = ::open(dir.length() ? dir.c_str() : ".", O_RDONLY);
+    if (dirFd >= 0) {
+      fsync(dirFd);
+      close(dirFd);
+    }
+  }
+#endif
+  std::chrono::duration<double> took =
+      std::chrono::steady_clock::now() - start;
+  lastSeconds = took.count();
+  return ok;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "line_buffer.h"
+#include <string>
+#include <vector>
+
+/*
+  Writes a LineBuffer to disk.
+  Decoded lines are encoded into a few large buffers that are reused between
+  saves, untouched spans of the source file are handed to writev as they are.
+  Files are written to a temporary next to the target and renamed over it,
+  so a crash mid save leaves the old contents intact.
+*/
+class FileWriter {
+  struct Segment {
+    const char *data;
+    size_t length;
+  };
+  std::vector<std::string> _buffers;
+  std::vector<Segment> _segments;
+  size_t _current = 0;
+  size_t _segmentStart = 0;
+
+public:
+  // flush the file to the device before the rename
+  bool sync = false;
+  size_t bufferSize = 1024 * 1024;
+
+  size_t lastBytes = 0;
+  double lastSeconds = 0;
+  std::string lastError;
+
+  bool save(const LineBuffer &lines, const std::string &path);
+  bool write(const LineBuffer &lines, int fd);
+
+private:
+  void add(const char *data, size_t length);
+  void encode(const std::u16string &text);
+  void closeSegment();
+  bool flush(int fd);
+};
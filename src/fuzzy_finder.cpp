@@ -0,0 +1,252 @@
+#include "fuzzy_finder.h"
+#include "simd.h"
+#include "u8String.h"
+#include <algorithm>
+#include <cstring>
+
+static const size_t NOT_FOUND = (size_t)-1;
+// paths scored by one task
+static const size_t SLICE = 16 * 1024;
+
+static const int SCORE_MATCH = 16;
+static const int PENALTY_GAP_START = 3;
+static const int PENALTY_GAP = 1;
+static const int BONUS_CONSECUTIVE = 4;
+static const int BONUS_CAMEL = 7;
+static const int BONUS_WORD = 8;
+static const int BONUS_COMPONENT = 10;
+static const int BONUS_FILE_NAME = 12;
+
+static inline unsigned char fold(unsigned char c) {
+  return c >= 'A' && c <= 'Z' ? c + 32 : c;
+}
+
+// the bit of each byte in the mask of a path, one per letter and digit,
+// the other bytes share the rest but the top bit, which marks a mask as
+// computed
+struct MaskTable {
+  uint64_t bits[256];
+
+  MaskTable() {
+    for (int c = 0; c < 256; c++) {
+      unsigned char folded = fold(c);
+      if (folded >= 'a' && folded <= 'z')
+        bits[c] = 1ull << (folded - 'a');
+      else if (folded >= '0' && folded <= '9')
+        bits[c] = 1ull << (26 + folded - '0');
+      else
+        bits[c] = 1ull << (36 + folded % 27);
+    }
+  }
+};
+
+static const MaskTable maskTable;
+
+static uint64_t textMask(const std::string &text) {
+  uint64_t mask = 0;
+  for (unsigned char c : text)
+    mask |= maskTable.bits[c];
+  return mask;
+}
+
+// the first byte at or after from that is c in either case
+static size_t findFolded(const char *text, size_t length, size_t from,
+                         unsigned char c) {
+  unsigned char upper = c >= 'a' && c <= 'z' ? c - 32 : c;
+  size_t i = from;
+#ifdef LEDIT_SSE2
+  __m128i lower16 = _mm_set1_epi8((char)c);
+  __m128i upper16 = _mm_set1_epi8((char)upper);
+  for (; i + 16 <= length; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(text + i));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(block, lower16), _mm_cmpeq_epi8(block, upper16)));
+    if (mask)
+      return i + simd::ctz(mask);
+  }
+  if (i < length && length >= 16) {
+    // the last block overlaps the one before, bytes seen are masked out
+    __m128i block = _mm_loadu_si128((const __m128i *)(text + length - 16));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(block, lower16), _mm_cmpeq_epi8(block, upper16)));
+    mask &= 0xFFFFu << (i - (length - 16));
+    return mask ? length - 16 + simd::ctz(mask) : NOT_FOUND;
+  }
+#endif
+  for (; i < length; i++) {
+    if ((unsigned char)text[i] == c || (unsigned char)text[i] == upper)
+      return i;
+  }
+  return NOT_FOUND;
+}
+
+// the last byte before before that is c in either case
+static size_t findFoldedBack(const char *text, size_t before,
+                             unsigned char c) {
+  unsigned char upper = c >= 'a' && c <= 'z' ? c - 32 : c;
+  size_t i = before;
+#ifdef LEDIT_SSE2
+  __m128i lower16 = _mm_set1_epi8((char)c);
+  __m128i upper16 = _mm_set1_epi8((char)upper);
+  for (; i >= 16; i -= 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(text + i - 16));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(block, lower16), _mm_cmpeq_epi8(block, upper16)));
+    if (mask)
+      return i - 16 + 31 - simd::clz(mask);
+  }
+#endif
+  while (i > 0) {
+    i--;
+    if ((unsigned char)text[i] == c || (unsigned char)text[i] == upper)
+      return i;
+  }
+  return NOT_FOUND;
+}
+
+static int bonusAt(const std::string &path, size_t at) {
+  if (at == 0)
+    return BONUS_COMPONENT;
+  unsigned char before = path[at - 1];
+  unsigned char c = path[at];
+  if (before == '/')
+    return BONUS_COMPONENT;
+  if (before == '_' || before == '-' || before == '.' || before == ' ')
+    return BONUS_WORD;
+  if (before >= 'a' && before <= 'z' && c >= 'A' && c <= 'Z')
+    return BONUS_CAMEL;
+  bool wasDigit = before >= '0' && before <= '9';
+  if (!wasDigit && c >= '0' && c <= '9')
+    return BONUS_CAMEL;
+  return 0;
+}
+
+// Score of query in path, false if it is not a subsequence. The match
+// ending first is narrowed to the latest start that still holds the query
+// and scored from there, every step jumps to the next character wanted.
+static bool scorePath(const std::string &path, const std::string &query,
+                      int32_t &score) {
+  const char *text = path.data();
+  size_t length = path.length();
+  size_t at = 0;
+  for (unsigned char c : query) {
+    at = findFolded(text, length, at, c);
+    if (at == NOT_FOUND)
+      return false;
+    at++;
+  }
+  size_t start = at;
+  for (size_t j = query.length(); j > 0; j--)
+    start = findFoldedBack(text, start, query[j - 1]);
+  int total = 0;
+  int runBonus = 0;
+  size_t last = start;
+  at = start;
+  for (size_t j = 0; j < query.length(); j++, at++) {
+    at = findFolded(text, length, at, query[j]);
+    int bonus = bonusAt(path, at);
+    if (j && at == last + 1) {
+      // a run keeps the bonus of the boundary it started at
+      bonus = std::max({bonus, runBonus, BONUS_CONSECUTIVE});
+    } else {
+      if (j)
+        total -= PENALTY_GAP_START + PENALTY_GAP * (int)(at - last - 2);
+      runBonus = bonus;
+    }
+    total += SCORE_MATCH + (j ? bonus : 2 * bonus);
+    last = at;
+  }
+  if (!memchr(text + start, '/', length - start))
+    total += BONUS_FILE_NAME;
+  score = total;
+  return true;
+}
+
+void FuzzyFinder::clear() {
+  _query.clear();
+  _generation = 0;
+  _valid = false;
+  _masks.clear();
+  _hits.clear();
+  _ranked.clear();
+}
+
+template <typename Fn>
+void FuzzyFinder::score(const std::vector<std::string> &paths, size_t count,
+                        Fn fn, std::vector<FuzzyMatch> &out) {
+  uint64_t mask = textMask(_query);
+  size_t slices = (count + SLICE - 1) / SLICE;
+  std::vector<std::vector<FuzzyMatch>> found(slices);
+  auto scoreSlice = [&](size_t slice) {
+    size_t end = std::min(count, (slice + 1) * SLICE);
+    for (size_t i = slice * SLICE; i < end; i++) {
+      uint32_t index = fn(i);
+      // paths new since the last call have no mask yet
+      if (!_masks[index])
+        _masks[index] = textMask(paths[index]) | 1ull << 63;
+      int32_t value;
+      if ((_masks[index] & mask) == mask &&
+          scorePath(paths[index], _query, value))
+        found[slice].push_back(
+            {index, value, (uint32_t)paths[index].length()});
+    }
+  };
+  if (slices > 1)
+    _pool.forEach(slices, scoreSlice);
+  else if (slices)
+    scoreSlice(0);
+  for (auto &matches : found)
+    out.insert(out.end(), matches.begin(), matches.end());
+}
+
+bool FuzzyFinder::update(const std::vector<std::string> &paths,
+                         size_t generation, const std::u16string &query) {
+  std::string folded = convert_str(query);
+  for (auto &c : folded)
+    c = fold(c);
+  if (generation != _generation) {
+    _masks.clear();
+    _hits.clear();
+    _query.clear();
+    _valid = false;
+    _generation = generation;
+  }
+  size_t known = _masks.size();
+  if (_valid && known == paths.size() && folded == _query)
+    return false;
+  _masks.resize(paths.size());
+  if (!_valid || folded.compare(0, _query.length(), _query)) {
+    // not a narrower query, every path is looked at again
+    _query = folded;
+    _hits.clear();
+    score(paths, paths.size(), [](size_t i) { return (uint32_t)i; }, _hits);
+  } else {
+    if (folded != _query) {
+      _query = folded;
+      std::vector<FuzzyMatch> hits;
+      hits.swap(_hits);
+      score(paths, hits.size(), [&](size_t i) { return hits[i].index; },
+            _hits);
+    }
+    score(paths, paths.size() - known,
+          [known](size_t i) { return (uint32_t)(known + i); }, _hits);
+  }
+  rank();
+  _valid = true;
+  return true;
+}
+
+void FuzzyFinder::rank() {
+  auto better = [](const FuzzyMatch &a, const FuzzyMatch &b) {
+    if (a.score != b.score)
+      return a.score > b.score;
+    return a.length != b.length ? a.length < b.length : a.index < b.index;
+  };
+  _ranked.assign(_hits.begin(), _hits.end());
+  if (_ranked.size() > MAX_RANKED) {
+    std::nth_element(_ranked.begin(), _ranked.begin() + MAX_RANKED,
+                     _ranked.end(), better);
+    _ranked.resize(MAX_RANKED);
+  }
+  std::sort(_ranked.begin(), _ranked.end(), better);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "thread_pool.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct FuzzyMatch {
+  // into the paths given to FuzzyFinder::update()
+  uint32_t index;
+  int32_t score;
+  // of the path, shorter ones win ties
+  uint32_t length;
+};
+
+/*
+  Ranks paths by how well a query matches them as a subsequence, ASCII
+  letters in either case. Matches score higher when their characters are
+  consecutive, start a word or a path component and lie in the file name,
+  gaps cost a little, shorter paths win ties.
+  Each path keeps a mask of the characters in it, a path lacking one of
+  the query is passed over without looking at it, the others are scanned a
+  block of bytes at a time. A query that extends the last one only looks
+  at the paths that matched it and paths added since are scored on their
+  own, so typing stays cheap however many paths there are. Paths are
+  scored in slices on a ThreadPool.
+*/
+class FuzzyFinder {
+  ThreadPool &_pool;
+  std::string _query;
+  size_t _generation = 0;
+  // _hits are those of _query
+  bool _valid = false;
+  std::vector<uint64_t> _masks;
+  // every match, unordered
+  std::vector<FuzzyMatch> _hits;
+  // the best of _hits in order
+  std::vector<FuzzyMatch> _ranked;
+
+public:
+  // only this many matches are put in order
+  static const size_t MAX_RANKED = 1000;
+
+  explicit FuzzyFinder(ThreadPool &pool) : _pool(pool) {}
+
+  // Ranks paths for query, false if neither changed since the last call.
+  // Paths may have grown meanwhile, a different generation means they were
+  // replaced.
+  bool update(const std::vector<std::string> &paths, size_t generation,
+              const std::u16string &query);
+  void clear();
+  size_t count() const { return _hits.size(); }
+  const std::vector<FuzzyMatch> &ranked() const { return _ranked; }
+
+private:
+  // scores the paths that fn(i) names for i in [0, count)
+  template <typename Fn>
+  void score(const std::vector<std::string> &paths, size_t count, Fn fn,
+             std::vector<FuzzyMatch> &out);
+  void rank();
+};
@@ -0,0 +1,133 @@
+#include "git_branches.h"
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// how long a branch is trusted without inotify
+static const std::chrono::seconds UNWATCHED_LIFETIME(2);
+
+static std::string trim(const std::string &text) {
+  size_t start = text.find_first_not_of(" \t\r\n");
+  if (start == std::string::npos)
+    return "";
+  size_t end = text.find_last_not_of(" \t\r\n");
+  return text.substr(start, end - start + 1);
+}
+
+static std::string readLine(const std::filesystem::path &path) {
+  std::ifstream stream(path, std::ios::binary);
+  std::string line;
+  std::getline(stream, line);
+  return trim(line);
+}
+
+// the git directory .git in directory stands for, "" if there is none
+static std::string findGitDirectory(const std::filesystem::path &directory) {
+  std::filesystem::path dotGit = directory / ".git";
+  std::error_code error;
+  auto status = std::filesystem::status(dotGit, error);
+  if (error)
+    return "";
+  if (std::filesystem::is_directory(status))
+    return dotGit.generic_string();
+  if (!std::filesystem::is_regular_file(status))
+    return "";
+  std::string line = readLine(dotGit);
+  if (line.rfind("gitdir:", 0) != 0)
+    return "";
+  std::filesystem::path target = trim(line.substr(7));
+  if (target.is_relative())
+    target = directory / target;
+  return target.lexically_normal().generic_string();
+}
+
+static std::string readBranch(const std::string &gitDirectory) {
+  std::string head = readLine(std::filesystem::path(gitDirectory) / "HEAD");
+  if (head.rfind("ref:", 0) == 0) {
+    std::string ref = trim(head.substr(4));
+    const std::string heads = "refs/heads/";
+    return ref.rfind(heads, 0) == 0 ? ref.substr(heads.length()) : ref;
+  }
+  if (head.empty())
+    return "";
+  return "(HEAD detached at " + head.substr(0, 7) + ")";
+}
+
+const std::string &GitBranches::gitDirectoryOf(const std::string &path) {
+  std::string directory = std::filesystem::absolute(path)
+                              .lexically_normal()
+                              .parent_path()
+                              .generic_string();
+  auto known = _gitDirectories.find(directory);
+  if (known != _gitDirectories.end())
+    return known->second;
+  std::string found;
+  for (std::filesystem::path at = directory; found.empty();
+       at = at.parent_path()) {
+    found = findGitDirectory(at);
+    if (at == at.parent_path())
+      break;
+  }
+  return _gitDirectories.emplace(directory, found).first->second;
+}
+
+std::string GitBranches::headOf(const std::string &path) {
+  const std::string &gitDirectory = gitDirectoryOf(path);
+  return gitDirectory.empty() ? "" : gitDirectory + "/HEAD";
+}
+
+std::string GitBranches::branchOf(const std::string &path) {
+  std::string gitDirectory = gitDirectoryOf(path);
+  if (gitDirectory.empty())
+    return "";
+  invalidate();
+  auto now = std::chrono::steady_clock::now();
+  auto it = _repositories.find(gitDirectory);
+  if (it != _repositories.end() &&
+      (it->second.watch >= 0 || now - it->second.read < UNWATCHED_LIFETIME))
+    return it->second.branch;
+  if (it == _repositories.end()) {
+    // HEAD is replaced through a rename, its directory is watched, and
+    // before it is read so a change while reading is not missed
+    int watch = _watcher.add(gitDirectory, FileWatcher::MODIFIED |
+                                               FileWatcher::ENTRIES |
+                                               FileWatcher::GONE);
+    it = _repositories.emplace(gitDirectory, Repository{"", watch, now})
+             .first;
+    if (watch >= 0)
+      _watched[watch] = gitDirectory;
+  }
+  it->second.branch = readBranch(gitDirectory);
+  it->second.read = now;
+  return it->second.branch;
+}
+
+void GitBranches::invalidate() {
+  std::vector<WatchEvent> events;
+  if (!_watcher.read(events))
+    return;
+  for (auto &event : events) {
+    if (event.watch < 0) {
+      while (_repositories.size())
+        erase(_repositories.begin()->first);
+      continue;
+    }
+    auto watched = _watched.find(event.watch);
+    if (watched == _watched.end())
+      continue;
+    if (event.name == "HEAD" ||
+        (event.name.empty() && (event.events & FileWatcher::GONE)))
+      erase(watched->second);
+  }
+}
+
+void GitBranches::erase(const std::string &gitDirectory) {
+  auto it = _repositories.find(gitDirectory);
+  if (it == _repositories.end())
+    return;
+  if (it->second.watch >= 0) {
+    _watcher.remove(it->second.watch);
+    _watched.erase(it->second.watch);
+  }
+  _repositories.erase(it);
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "file_watcher.h"
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+/*
+  The branch checked out in the git repository holding a file, read from
+  its HEAD without running git. The repository is found by looking for
+  .git in the directory of the file and its parents, a .git file as left
+  by worktrees and submodules names the real one after "gitdir:". The
+  branch is kept per repository until inotify reports a change to HEAD,
+  without inotify it is trusted for a few seconds.
+*/
+class GitBranches {
+  struct Repository {
+    std::string branch;
+    int watch;
+    std::chrono::steady_clock::time_point read;
+  };
+
+  FileWatcher _watcher;
+  // the git directory of every directory asked about, "" outside of one
+  std::unordered_map<std::string, std::string> _gitDirectories;
+  std::unordered_map<std::string, Repository> _repositories;
+  std::unordered_map<int, std::string> _watched;
+
+public:
+  // "" outside of a repository, "(HEAD detached at <hash>)" without a branch
+  std::string branchOf(const std::string &path);
+  // the HEAD file deciding the branch of path, "" outside of a repository
+  std::string headOf(const std::string &path);
+
+private:
+  const std::string &gitDirectoryOf(const std::string &path);
+  void invalidate();
+  void erase(const std::string &gitDirectory);
+};
@@ -144,6 +144,30 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action,
       if (action == GLFW_PRESS && key == GLFW_KEY_H) {
         gState->highlightLine = !gState->highlightLine;
       }
+      if (action == GLFW_PRESS && key == GLFW_KEY_T) {
+        gState->toggleFollow();
+      }
+      if (action == GLFW_PRESS && key == GLFW_KEY_C) {
+        gState->toggleSearchOption(&SearchOptions::ignoreCase);
+      }
+      if (action == GLFW_PRESS && key == GLFW_KEY_B) {
+        gState->toggleSearchOption(&SearchOptions::wholeWord);
+      }
+      if (action == GLFW_PRESS && key == GLFW_KEY_R) {
+        gState->toggleSearchOption(&SearchOptions::regex);
+      }
+      if (action == GLFW_PRESS && key == GLFW_KEY_F) {
+        gState->searchBuffers();
+      }
+      if (action == GLFW_PRESS && key == GLFW_KEY_J) {
+        gState->showBufferMatches();
+      }
+      if (action == GLFW_PRESS && key == GLFW_KEY_P) {
+        gState->grepProject();
+      }
+      if (action == GLFW_PRESS && key == GLFW_KEY_D) {
+        gState->findFile();
+      }
       if (action == GLFW_PRESS && key == GLFW_KEY_O) {
         gState->open();
       }
@@ -167,12 +191,16 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action,
         gState->renderCoords();
       }
       if (action == GLFW_PRESS && key == GLFW_KEY_E) {
-        cursor->gotoLine(cursor->_lines.size());
+        cursor->gotoEnd();
         gState->renderCoords();
       }
       return;
     }
     if (shift_pressed) {
+      if (key == GLFW_KEY_Z && isPress) {
+        gState->redo();
+        return;
+      }
       if (key == GLFW_KEY_P && isPress) {
         gState->active->moveLine(-1);
       } else if (key == GLFW_KEY_N && isPress) {
@@ -232,7 +260,7 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action,
       if (gState->mode != 0) {
         gState->inform(true, shift_pressed);
         return;
-      } else
+      } else if (!gState->openGrepMatch())
         cursor->append('\n');
     }
     if (isPress && key == GLFW_KEY_TAB) {
@@ -325,6 +353,8 @@ std::tuple<float, float> GlfwApp::getScale() const { return _impl->getScale(); }
 
 void GlfwApp::wait() { glfwWaitEvents(); }
 
+void GlfwApp::postEmptyEvent() { glfwPostEmptyEvent(); }
+
 void GlfwApp::flush() {
   _impl->swapBuffers();
   glfwWaitEvents();
@@ -13,4 +13,6 @@ public:
   void flush();
   std::tuple<float, float> getScale() const;
   void wait();
+  // wakes up a pending wait() from any thread
+  static void postEmptyEvent();
 };
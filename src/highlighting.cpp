@@ -0,0 +1,326 @@
+#include "highlighting.h"
+#include <algorithm>
+#include <chrono>
+
+// lines between two checkpoints, every line lexed ahead of one it is colored
+static const size_t CHECKPOINT_INTERVAL = 128;
+// lines a job lexes at most, which keeps its snapshot cheap to take
+static const size_t JOB_LINES = 16384;
+// how long highlight() waits for the lines asked for, a small edit is
+// lexed long before
+static const std::chrono::milliseconds WAIT(4);
+
+Highlighter::~Highlighter() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+    _interrupted = true;
+  }
+  _wake.notify_one();
+  if (_thread.joinable())
+    _thread.join();
+}
+
+void Highlighter::setNotify(std::function<void()> notify) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _notify = notify;
+}
+
+void Highlighter::setLanguage(Language lang, std::string name) {
+  language.modeName = create(lang.modeName);
+  language.keyWords.clear();
+  for (auto &entry : lang.keyWords)
+    language.keyWords.push_back(create(entry));
+  language.specialWords.clear();
+  for (auto &entry : lang.specialWords)
+    language.specialWords.push_back(create(entry));
+  language.singleLineComment = create(lang.singleLineComment);
+  if (lang.multiLineComment.first.length())
+    language.multiLineComment =
+        std::pair(create(lang.multiLineComment.first),
+                  create(lang.multiLineComment.second));
+  else
+    language.multiLineComment = std::pair(u"", u"");
+  language.stringCharacters = create(lang.stringCharacters);
+  language.escapeChar = (char16_t)lang.escapeChar;
+  _lexer = std::make_shared<Lexer>(language);
+
+  languageName = create(name);
+  _document = nullptr;
+}
+
+void Highlighter::reset() {
+  _checkpoints.assign(1, {0, {Lexer::NONE, 0}, true});
+  _valid = 1;
+  _generation++;
+  _interrupted = true;
+  _spansValid = false;
+}
+
+void Highlighter::follow(Document &document) {
+  LineChange change;
+  if (&document != _document || !document.changesSince(_version, change)) {
+    reset();
+    _document = &document;
+  } else if (document._version != _version) {
+    apply(change);
+  }
+  _version = document._version;
+  document.forgetChanges();
+}
+
+void Highlighter::apply(const LineChange &change) {
+  // a checkpoint holds what the lines before it leave open, the one on the
+  // first edited line stays right
+  size_t kept = 0;
+  size_t valid = 0;
+  bool first = true;
+  for (size_t i = 0; i < _checkpoints.size(); i++) {
+    Checkpoint checkpoint = _checkpoints[i];
+    if (checkpoint.line > change.from) {
+      if (checkpoint.line < change.oldEnd)
+        continue;
+      checkpoint.line = checkpoint.line - change.oldEnd + change.newEnd;
+      // removed lines can move it onto the one on the first edited line
+      if (kept && _checkpoints[kept - 1].line == checkpoint.line)
+        continue;
+      if (first)
+        checkpoint.linked = false;
+      first = false;
+    } else if (i < _valid) {
+      valid++;
+    }
+    _checkpoints[kept++] = checkpoint;
+  }
+  _checkpoints.resize(kept);
+  _valid = valid;
+  _generation++;
+  _interrupted = true;
+  // the lines before the edit keep their colors
+  if (change.from < _spansFrom + _spanCount)
+    _spanCount = change.from > _spansFrom ? change.from - _spansFrom : 0;
+}
+
+void Highlighter::take() {
+  if (!_hasResult)
+    return;
+  _hasResult = false;
+  if (_resultGeneration != _generation)
+    return;
+  _spans.swap(_result);
+  _spansFrom = _resultFrom;
+  _spanCount = _spans.size();
+  _spansValid = true;
+}
+
+bool Highlighter::covers(size_t from, size_t to) const {
+  return from == to || (_spansValid && from >= _spansFrom &&
+                        to <= _spansFrom + _spanCount);
+}
+
+Highlighter::Job Highlighter::plan(size_t from, size_t to) const {
+  size_t start = _checkpoints[checkpointBefore(from)].line;
+  return {_generation, _lexer, nullptr, start,
+          std::min(to, start + JOB_LINES), from, to, false};
+}
+
+bool Highlighter::planRest(size_t lines, Job &job) const {
+  // lexing from the last checkpoint known right confirms the ones after it
+  size_t start = _checkpoints[_valid - 1].line;
+  if (_valid == _checkpoints.size() && start + CHECKPOINT_INTERVAL >= lines)
+    return false;
+  job = {_generation, _lexer, nullptr, start,
+         std::min(lines, start + JOB_LINES), 0, 0, true};
+  return true;
+}
+
+void Highlighter::post(const Document &document, Job job) {
+  _posted = job;
+  job.lines =
+      std::make_shared<LineSnapshot>(document._lines, job.start, job.end);
+  _job = std::make_unique<Job>(std::move(job));
+  _interrupted = true;
+  if (!_thread.joinable())
+    _thread = std::thread(&Highlighter::run, this);
+  _wake.notify_one();
+}
+
+size_t Highlighter::checkpointBefore(size_t line) const {
+  auto end = _checkpoints.begin() + _valid;
+  auto after = std::upper_bound(
+      _checkpoints.begin(), end, line,
+      [](size_t line, const Checkpoint &checkpoint) {
+        return line < checkpoint.line;
+      });
+  return after - _checkpoints.begin() - 1;
+}
+
+bool Highlighter::pass(size_t line, const Lexer::State &state,
+                       size_t &next) {
+  if (next < _checkpoints.size() && _checkpoints[next].line == line) {
+    if (next++ < _valid)
+      return false;
+    Checkpoint &checkpoint = _checkpoints[next - 1];
+    bool same = checkpoint.state == state;
+    checkpoint.state = state;
+    checkpoint.linked = true;
+    _valid = next;
+    if (!same) {
+      // the next one was lexed from the state replaced
+      if (next < _checkpoints.size())
+        _checkpoints[next].linked = false;
+      return false;
+    }
+    // the lines after it are lexed the same as before up to the next edit
+    while (_valid < _checkpoints.size() && _checkpoints[_valid].linked)
+      _valid++;
+    return true;
+  }
+  if (line - _checkpoints[next - 1].line < CHECKPOINT_INTERVAL)
+    return false;
+  _checkpoints.insert(_checkpoints.begin() + next, {line, state, true});
+  if (next++ <= _valid)
+    _valid++;
+  return false;
+}
+
+size_t Highlighter::dueAfter(size_t next) const {
+  size_t due = _checkpoints[next - 1].line + CHECKPOINT_INTERVAL;
+  if (next < _checkpoints.size())
+    due = std::min(due, _checkpoints[next].line);
+  return due;
+}
+
+void Highlighter::highlight(Document &document, const EditorColors *colors,
+                            size_t from, size_t to) {
+  _palette[COLOR_DEFAULT] = colors->default_color;
+  _palette[COLOR_STRING] = colors->string_color;
+  _palette[COLOR_KEYWORD] = colors->keyword_color;
+  _palette[COLOR_SPECIAL] = colors->special_color;
+  _palette[COLOR_COMMENT] = colors->comment_color;
+  _palette[COLOR_NUMBER] = colors->number_color;
+  highlight(document, from, to);
+}
+
+void Highlighter::highlight(Document &document, size_t from, size_t to) {
+  size_t lines = document._lines.size();
+  to = std::min(to, lines);
+  from = std::min(from, to);
+  _askedFrom = from;
+  _askedTo = to;
+  _lineCount = lines;
+  auto deadline = std::chrono::steady_clock::now() + WAIT;
+  std::unique_lock<std::mutex> lock(_mutex);
+  follow(document);
+  while (true) {
+    take();
+    if (covers(from, to))
+      break;
+    Job job = plan(from, to);
+    if (!isBusy() || !job.sameAs(_posted))
+      post(document, std::move(job));
+    if (_finished.wait_until(lock, deadline) == std::cv_status::timeout)
+      return;
+  }
+  Job rest;
+  if (!isBusy() && planRest(lines, rest))
+    post(document, std::move(rest));
+}
+
+bool Highlighter::isBehind() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_hasResult && _resultGeneration == _generation)
+    return true;
+  if (!_document || isBusy())
+    return false;
+  Job rest;
+  return !covers(_askedFrom, _askedTo) || planRest(_lineCount, rest);
+}
+
+const std::vector<ColorSpan> *Highlighter::spansOf(size_t line) const {
+  if (!_spansValid || line < _spansFrom || line >= _spansFrom + _spanCount)
+    return nullptr;
+  return &_spans[line - _spansFrom];
+}
+
+void Highlighter::run() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    _wake.wait(lock, [this] { return _stop || _job; });
+    if (_stop)
+      return;
+    std::unique_ptr<Job> job = std::move(_job);
+    _running = true;
+    _interrupted = false;
+    lock.unlock();
+    bool done = work(*job);
+    job.reset();
+    lock.lock();
+    _running = false;
+    _finished.notify_all();
+    if (done && _notify) {
+      auto notify = _notify;
+      lock.unlock();
+      notify();
+      lock.lock();
+    }
+  }
+}
+
+bool Highlighter::work(const Job &job) {
+  std::vector<std::vector<ColorSpan>> spans;
+  if (!job.background)
+    spans.resize(job.to - job.from);
+  Lexer::State state;
+  size_t next;
+  size_t due;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (job.generation != _generation)
+      return false;
+    next = checkpointBefore(job.start);
+    state = _checkpoints[next++].state;
+    due = dueAfter(next);
+  }
+  bool dropped = false;
+  bool confirmed = false;
+  size_t line = job.start;
+  for (auto &part : job.lines->parts()) {
+    part.forEach([&](size_t, const std::u16string &text) {
+      // a newer job or edit makes this one useless
+      if (_interrupted.load(std::memory_order_relaxed)) {
+        dropped = true;
+        return false;
+      }
+      if (line > job.start && line >= due) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stop || _job || job.generation != _generation) {
+          dropped = true;
+          return false;
+        }
+        // once the lines ahead are known to be right they are skipped
+        if (pass(line, state, next) && (job.background || line < job.from)) {
+          confirmed = true;
+          return false;
+        }
+        due = dueAfter(next);
+      }
+      bool colored = !job.background && line >= job.from && line < job.to;
+      state = job.lexer->lex(text, state,
+                              colored ? &spans[line - job.from] : nullptr);
+      return ++line < job.end;
+    });
+    if (dropped || confirmed || line >= job.end)
+      break;
+  }
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (dropped || job.generation != _generation)
+    return false;
+  if (!job.background && line >= job.to) {
+    _result.swap(spans);
+    _resultFrom = job.from;
+    _resultGeneration = job.generation;
+    _hasResult = true;
+  }
+  return true;
+}
@@ -3,9 +3,18 @@
 #include "u8String.h"
 #include "la.h"
 #include "config_provider.h"
+#include "document.h"
+#include "lexer.h"
+#include "line_snapshot.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
-#include <map>
-#include <sstream>
+#include <thread>
+#include <vector>
+#include <stdint.h>
 struct Language {
   std::string modeName;
   std::vector<std::string> keyWords;
@@ -16,278 +25,145 @@ struct Language {
   char escapeChar;
   std::vector<std::string> fileExtensions;
 };
-struct LanguageExpanded {
-  std::u16string modeName;
-  std::vector<std::u16string> keyWords;
-  std::vector<std::u16string> specialWords;
-  std::u16string singleLineComment;
-  std::pair<std::u16string, std::u16string> multiLineComment;
-  std::u16string stringCharacters;
-  char16_t escapeChar;
-};
-struct HighlighterState {
-  int start;
-  bool busy;
-  bool wasReset;
-  int mode;
-  std::u16string buffer;
-  char stringChar;
-};
-struct SavedState {
-  HighlighterState state;
-  Vec4f color;
-  bool loaded = false;
-};
+/*
+  Colors the lines of a document for a language. All a line takes over
+  from the lines before it is whether it starts inside a string or a block
+  comment, that state is kept at checkpoints every few lines. Lines are
+  colored by lexing from the closest checkpoint before them, only the lines
+  last asked for keep their colors, as spans of a color kind each.
+  An edit leaves the checkpoints after it unconfirmed. Lexing on from the
+  edit, the first one found to hold the state reached confirms every one
+  after it up to the next edited lines, so an edit costs the lines up to
+  there, not the document.
+  The lexing runs on a thread of its own over a LineSnapshot of the lines
+  it needs, a few thousand at a time. The lines asked for go first, the
+  rest of the document is lexed after them so any line can be colored
+  from a checkpoint close by. Asking waits a moment for the lines, lines
+  still being lexed after that have no spans until a later call, the
+  thread calls notify once it is done with them. Every change to the
+  checkpoints starts a new generation, the spans of an older one are
+  dropped and a job for it stops at its next line.
+*/
 class Highlighter {
+  struct Checkpoint {
+    size_t line;
+    // at the start of line
+    Lexer::State state;
+    // follows from the one before through lines not edited since
+    bool linked;
+  };
+  // lexes lines [start, end) from the checkpoint on start
+  struct Job {
+    size_t generation;
+    std::shared_ptr<const Lexer> lexer;
+    std::shared_ptr<const LineSnapshot> lines;
+    size_t start;
+    size_t end;
+    // the lines colored, a background job colors none
+    size_t from;
+    size_t to;
+    bool background;
+
+    // the same lines wanted, where it starts only moves on with the work
+    bool sameAs(const Job &other) const {
+      return generation == other.generation && from == other.from &&
+             to == other.to && background == other.background;
+    }
+  };
+
+  // the thread calling highlight() owns these
+  std::shared_ptr<const Lexer> _lexer;
+  const Document *_document = nullptr;
+  // Document::_version the checkpoints are for
+  size_t _version = 0;
+  // the colors of lines [_spansFrom, _spansFrom + _spanCount)
+  std::vector<std::vector<ColorSpan>> _spans;
+  size_t _spansFrom = 0;
+  size_t _spanCount = 0;
+  bool _spansValid = false;
+  Vec4f _palette[COLOR_KINDS];
+  // the job posted last
+  Job _posted{};
+  // what the last highlight() call asked for, of a document of _lineCount
+  size_t _askedFrom = 0;
+  size_t _askedTo = 0;
+  size_t _lineCount = 0;
+
+  // shared with the thread, under _mutex
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _finished;
+  std::vector<Checkpoint> _checkpoints;
+  // checkpoints [0, _valid) are right
+  size_t _valid = 0;
+  size_t _generation = 0;
+  // waiting for the thread, it stops the running one
+  std::unique_ptr<Job> _job;
+  bool _running = false;
+  // set with every job posted and every change to the checkpoints, the
+  // running job looks at it on every line and takes the lock only on
+  // lines pass() has something to do with
+  std::atomic<bool> _interrupted{false};
+  // spans of the last job that colored lines
+  bool _hasResult = false;
+  size_t _resultGeneration = 0;
+  size_t _resultFrom = 0;
+  std::vector<std::vector<ColorSpan>> _result;
+  std::function<void()> _notify;
+  bool _stop = false;
+  std::thread _thread;
+
 public:
   std::u16string languageName;
-
   LanguageExpanded language;
-  const std::u16string whitespace = u" \t\n[]{}();:.,*-+/";
-  bool isNonChar(char16_t c) {
-    return whitespace.find(c) != std::string::npos;
-  }
- bool isNumber(char16_t c) {
-  return c >= '0' && c <= '9';
- }
- bool isNumberEnd(char16_t c, bool hexa) {
-  if(hexa && ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')))
-    return false;
-  return !isNumber(c) && c != '.' && c != 'x';
- }
-  std::u16string cachedContent = u"";
-  std::map<int, Vec4f> cached;
-  std::map<int, std::pair<int, int>> lineIndex;
-  Vec4f lastEntry;
-  int lastSkip = 0;
-  int lastMax = 0;
-  int lastY = 0;
-  SavedState savedState;
-  bool wasCached = false;
-  void setLanguage(Language lang, std::string name) {
-    language.modeName = create(lang.modeName);
-    language.keyWords.clear();
-    for(auto& entry : lang.keyWords) {
-      language.keyWords.push_back(create(entry));
-    }
-    language.specialWords.clear();
-    for(auto& entry : lang.specialWords) {
-      language.specialWords.push_back(create(entry));
-    }
-    if(lang.singleLineComment.length()) {
-      language.singleLineComment = create(lang.singleLineComment);
-    } else {
-      language.singleLineComment = u"";
-    }
-    if(lang.multiLineComment.first.length()) {
-      language.multiLineComment = std::pair(create(lang.multiLineComment.first), create(lang.multiLineComment.second));
-    } else {
-      language.multiLineComment = std::pair(u"", u"");
-    }
-    language.stringCharacters = create(lang.stringCharacters);
-    language.escapeChar = (char16_t) lang.escapeChar;
-
-    languageName = create(name);
-    wasCached = false;
-  }
-  std::map<int, Vec4f>* highlight(std::vector<std::u16string>& lines, EditorColors* colors, int skip, int maxLines, int y) {
-    std::u16string str;
-    for(size_t i = 0; i < lines.size(); i++) {
-      str += lines[i];
-      if(i < lines.size() -1)
-        str += u"\n";
-    }
-    return highlight(str, colors, skip, maxLines, y);
-  }
-  std::map<int, Vec4f>* get() {
-    return &cached;
-  }
-  std::map<int, Vec4f>* highlight(std::u16string raw, EditorColors* colors, int skip, int maxLines, int yPassed) {
-    // if(wasCached && raw == cachedContent && skip == lastSkip)
-    //   return &cached;
-
-     std::map<int, Vec4f> entries;
-    if(skip != lastSkip) {
-      wasCached = false;
-    }
-    //   entries = cached;
-    // }
-    HighlighterState state =  {0, false, false, 0, u"", 0};
-    // if(skip > 0 && wasCached)
-    //   state = savedState;
-    int startIndex = 0;
-    int y = 0;
-    lineIndex.clear();
-    Vec4f string_color = colors->string_color;
-    Vec4f default_color = colors->default_color;
-    Vec4f keyword_color = colors->keyword_color;
-    Vec4f special_color = colors->special_color;
-    Vec4f comment_color = colors->comment_color;
-    Vec4f number_color = colors->number_color;
-    char16_t last = 0;
-    size_t i;
-    size_t lCount = 0;
-    int last_entry = -1;
-    bool wasTriggered = false;
-    for(i = 0; i < raw.length(); i++) {
-      char16_t current = raw[i];
-      if(current == '\n') {
-        int endIndex = entries.size();
-        lineIndex[y++] = std::pair<int, int>(startIndex, endIndex);
-        startIndex = endIndex;
-        if(lCount++ > skip + maxLines && wasCached)
-          break;
-      }
-      if(skip > 0 && wasCached && lCount < skip-1) {
-        continue;
-      }
-      if(language.stringCharacters.find(current) != std::string::npos && (last != language.escapeChar || (last == language.escapeChar && i >1 && raw[i-2] == language.escapeChar))) {
-        if(state.mode == 0 && !state.busy) {
-          state.mode = 1;
-          state.busy = true;
-          state.start = i;
-          state.stringChar = current;
-          entries[i] = string_color;
-          last_entry = i;
-        } else if (state.mode == 1 && current == state.stringChar) {
-          state.busy = false;
-          state.mode = 0;
-          state.start = 0;
-          entries[i+1] = default_color;
-          last_entry = i+1;
-        }
-      } else if (state.busy && state.mode == 3 && hasEnding(state.buffer, language.multiLineComment.second)) {
-        state.mode = 0;
-        state.busy = false;
-        entries[i] = default_color;
-        last_entry = i;
-      } else if (state.busy && (state.mode == 6 || state.mode == 7) && isNumberEnd(current, state.mode == 7)) {
-        state.buffer = u"";
-        state.busy = false;
-        state.mode = 0;
-        entries[i] = default_color;
-        last_entry = i;
-      } else if (state.busy && state.mode == 2 && current == '\n') {
-        state.buffer = u"";
-        state.busy = false;
-        state.mode = 0;
-        entries[i] = default_color;
-        last_entry = i;
-      } else if (language.singleLineComment.length() && hasEnding(state.buffer+current, language.singleLineComment) && !state.busy) {
 
-        entries[i  - (language.singleLineComment.length()-1)] = comment_color;
-        last_entry = i- (language.singleLineComment.length()-1);
-        state.busy = true;
-        state.mode = 2;
-        state.buffer = u"";
-      } else if (language.multiLineComment.first.length() && hasEnding(state.buffer, language.multiLineComment.first) && !state.busy) {
-        entries[i- language.multiLineComment.first.length()] = comment_color;
-        last_entry = i- (language.multiLineComment.first.length());
-        state.buffer = u"";
-        state.busy = true;
-        state.mode = 3;
-      } else if(isNonChar(current) && !state.busy && state.buffer.length() && !state.wasReset) {
+  Highlighter() = default;
+  Highlighter(const Highlighter &) = delete;
+  Highlighter &operator=(const Highlighter &) = delete;
+  ~Highlighter();
+
+  // called from the thread whenever it finished a job
+  void setNotify(std::function<void()> notify);
+  void setLanguage(Language lang, std::string name);
+  // Colors lines [from, to) of document, taking the changes since the last
+  // call into account. Another document starts over.
+  void highlight(Document &document, const EditorColors *colors, size_t from,
+                 size_t to);
+  // the same with the colors given last
+  void highlight(Document &document, size_t from, size_t to);
+  // the spans of a line, null for lines not colored yet
+  const std::vector<ColorSpan> *spansOf(size_t line) const;
+  // True if highlight() should be called again, the thread has lines for
+  // it or is idle while there are lines left to lex.
+  bool isBehind();
+  const Vec4f &colorOf(ColorKind kind) const { return _palette[kind]; }
 
-        if (std::find(language.keyWords.begin(), language.keyWords.end(), state.buffer)!= language.keyWords.end()) {
-
-          entries[state.start] = keyword_color;
-          entries[i] = default_color;
-          last_entry = i;
-          state.wasReset = true;
-          state.buffer = u"";
-        } else if (std::find(language.specialWords.begin(), language.specialWords.end(), state.buffer)!= language.specialWords.end()) {
-          entries[state.start] = special_color;
-          entries[i] = default_color;
-          last_entry = i;
-          state.wasReset = true;
-          state.buffer = u"";
-        }
-
-      } else if (isNumber(current) && isNonChar(last) && !state.busy) {
-          state.mode = 6;
-          if(current == '0' && i < raw.length()-1 && (raw[i+1] == 'x' || raw[i+1] == 'X'))
-            state.mode = 7;
-          state.busy = true;
-          last_entry = i;
-          entries[i] = number_color;
-      } else if(!state.busy && isNonChar(last) && !isNonChar(current)) {
-        state.wasReset = false;
-        state.buffer = u"";
-        state.start = i;
-      }
-
-      state.buffer += current;
-      last = current;
-      if(current == '\n') {
-        bool cont = false;
-        if(skip > 0) {
-          if(lCount == skip) {
-        if(!wasCached && skip != lastSkip) {
-          savedState = {state, last_entry == -1 ? default_color : entries[last_entry], true};
-          entries[i+1] = savedState.color;
-        } else if(wasCached  && savedState.loaded) {
-          entries[i+1] = savedState.color;
-          state = savedState.state;
-        }
-
-
-          }
-        }
-      } else if (wasTriggered) {
-        wasTriggered = false;
-      }
-    }
-
-    //        std::cout << "lol: " << state.buffer << "end\n";
-    if(state.buffer.length()) {
-
-      if (std::find(language.keyWords.begin(), language.keyWords.end(), state.buffer)!= language.keyWords.end() && nextIsValid(raw, i)) {
-        entries[state.start] = keyword_color;
-        entries[i] = default_color;
-        state.wasReset = true;
-      } else if (std::find(language.specialWords.begin(), language.specialWords.end(), state.buffer)!= language.specialWords.end() && nextIsValid(raw, i)) {
-        entries[state.start] = special_color;
-        entries[i] = default_color;
-        state.wasReset = true;
-      }  else if (hasEnding(state.buffer, language.singleLineComment)) {
-
-        entries[offset(i) - language.singleLineComment.length()] = comment_color;
-        state.busy = true;
-        state.mode = 2;
-        state.buffer = u"";
-      }else if (hasEnding(state.buffer, language.multiLineComment.first)) {
-        entries[i] = comment_color;
-        state.buffer = u"";
-        state.busy = true;
-        state.mode = 3;
-      }
-    }
-    int endIndex = entries.size();
-    lineIndex[y++] = std::pair<int, int>(startIndex, endIndex);
-
-    lastMax = maxLines;
-    cached = entries;
-    lastY = yPassed;;
-
-    wasCached = true;
-    lastSkip = skip;
-    cachedContent = raw;
-    return &cached;
-  }
 private:
-  bool nextIsValid(std::u16string str, int i) {
-    return i >= str.length()-1 || isNonChar(str[i+1]);
-  }
-  int offset(int i) {
-    return i+1;
-  }
-  bool hasEnding (std::u16string const &fullString, std::u16string const &ending) {
-    if (fullString.length() >= ending.length()) {
-      return (0 == fullString.compare (fullString.length() - ending.length(), ending.length(), ending));
-    } else {
-      return false;
-    }
-  }
+  // the rest needs _mutex held, except where noted
+  void reset();
+  void follow(Document &document);
+  void apply(const LineChange &change);
+  // takes over the spans of a finished job
+  void take();
+  bool covers(size_t from, size_t to) const;
+  // the job lines [from, to) need next
+  Job plan(size_t from, size_t to) const;
+  // the job the rest of the document needs next, false if it is all lexed
+  bool planRest(size_t lines, Job &job) const;
+  bool isBusy() const { return _running || _job; }
+  void post(const Document &document, Job job);
+  // last checkpoint known right at or before line
+  size_t checkpointBefore(size_t line) const;
+  // Keeps the checkpoints up to date for a line about to be lexed, next is
+  // the first checkpoint not before it. True if the checkpoints after it
+  // were confirmed.
+  bool pass(size_t line, const Lexer::State &state, size_t &next);
+  // the first line after the checkpoint before next pass() acts on
+  size_t dueAfter(size_t next) const;
+  // on the thread, without the lock
+  void run();
+  // false if the job was dropped
+  bool work(const Job &job);
 };
 
 #endif
@@ -0,0 +1,166 @@
+#include "ignore_rules.h"
+#include "utils.h"
+#include <cstring>
+
+std::shared_ptr<const IgnoreRules>
+IgnoreRules::load(std::shared_ptr<const IgnoreRules> parent,
+                  const std::string &path, const std::string &relative) {
+  return parse(std::move(parent), file_to_string(path + "/.gitignore"),
+               relative);
+}
+
+std::shared_ptr<const IgnoreRules>
+IgnoreRules::parse(std::shared_ptr<const IgnoreRules> parent,
+                   const std::string &text, const std::string &relative) {
+  auto rules = std::make_shared<IgnoreRules>();
+  rules->_parent = std::move(parent);
+  rules->_base = relative;
+  size_t start = 0;
+  while (start < text.length()) {
+    size_t end = text.find('\n', start);
+    if (end == std::string::npos)
+      end = text.length();
+    std::string line = text.substr(start, end - start);
+    start = end + 1;
+    if (line.length() && line.back() == '\r')
+      line.pop_back();
+    // trailing spaces don't count unless escaped
+    while (line.length() && line.back() == ' ' &&
+           (line.length() < 2 || line[line.length() - 2] != '\\'))
+      line.pop_back();
+    if (line.empty() || line[0] == '#')
+      continue;
+    Pattern pattern;
+    if (line[0] == '!') {
+      pattern.negate = true;
+      line.erase(0, 1);
+    } else if (line[0] == '\\' && line.length() > 1 &&
+               (line[1] == '!' || line[1] == '#')) {
+      line.erase(0, 1);
+    }
+    if (line.length() && line.back() == '/') {
+      pattern.directoryOnly = true;
+      line.pop_back();
+    }
+    pattern.anchored = line.find('/') != std::string::npos;
+    if (line.length() && line[0] == '/')
+      line.erase(0, 1);
+    if (line.empty())
+      continue;
+    pattern.glob = std::move(line);
+    rules->_patterns.push_back(std::move(pattern));
+  }
+  if (rules->_patterns.empty())
+    return rules->_parent;
+  return rules;
+}
+
+bool IgnoreRules::isIgnored(const std::string &relative,
+                            bool isDirectory) const {
+  size_t slash = relative.rfind('/');
+  const char *name =
+      relative.data() + (slash == std::string::npos ? 0 : slash + 1);
+  const char *end = relative.data() + relative.length();
+  for (const IgnoreRules *level = this; level; level = level->_parent.get()) {
+    // the patterns of a level only see the path below its directory
+    if (relative.compare(0, level->_base.length(), level->_base))
+      continue;
+    const char *below = relative.data() + level->_base.length();
+    for (size_t i = level->_patterns.size(); i-- > 0;) {
+      const Pattern &pattern = level->_patterns[i];
+      if (pattern.directoryOnly && !isDirectory)
+        continue;
+      const char *glob = pattern.glob.data();
+      const char *globEnd = glob + pattern.glob.length();
+      if (pattern.anchored ? matchGlob(glob, globEnd, below, end)
+                           : matchGlob(glob, globEnd, name, end))
+        return !pattern.negate;
+    }
+  }
+  return false;
+}
+
+// the end of a [...] class starting at glob, null if it is not closed
+static const char *classEnd(const char *glob, const char *globEnd) {
+  const char *p = glob + 1;
+  if (p < globEnd && (*p == '!' || *p == '^'))
+    p++;
+  // a ']' right at the start is part of the class
+  if (p < globEnd && *p == ']')
+    p++;
+  while (p < globEnd && *p != ']')
+    p++;
+  return p < globEnd ? p : nullptr;
+}
+
+static bool matchClass(const char *glob, const char *end, char c) {
+  const char *p = glob + 1;
+  bool negate = *p == '!' || *p == '^';
+  if (negate)
+    p++;
+  bool found = false;
+  for (; p < end; p++) {
+    if (p + 2 < end && p[1] == '-') {
+      found |= c >= p[0] && c <= p[2];
+      p += 2;
+    } else {
+      found |= c == *p;
+    }
+  }
+  return found != negate;
+}
+
+bool IgnoreRules::matchGlob(const char *glob, const char *globEnd,
+                            const char *text, const char *textEnd) {
+  while (glob < globEnd) {
+    if (*glob == '*') {
+      if (glob + 1 < globEnd && glob[1] == '*') {
+        glob += 2;
+        // "**/" stands for any number of directories, none included
+        if (glob < globEnd && *glob == '/') {
+          glob++;
+          for (const char *at = text;;) {
+            if (matchGlob(glob, globEnd, at, textEnd))
+              return true;
+            at = (const char *)memchr(at, '/', textEnd - at);
+            if (!at)
+              return false;
+            at++;
+          }
+        }
+        // anywhere else it matches everything, slashes included
+        for (const char *at = textEnd; at >= text; at--) {
+          if (matchGlob(glob, globEnd, at, textEnd))
+            return true;
+        }
+        return false;
+      }
+      glob++;
+      for (const char *at = text;; at++) {
+        if (matchGlob(glob, globEnd, at, textEnd))
+          return true;
+        if (at == textEnd || *at == '/')
+          return false;
+      }
+    }
+    if (text == textEnd)
+      return false;
+    if (*glob == '?') {
+      if (*text == '/')
+        return false;
+    } else if (*glob == '[' && classEnd(glob, globEnd)) {
+      const char *end = classEnd(glob, globEnd);
+      if (*text == '/' || !matchClass(glob, end, *text))
+        return false;
+      glob = end;
+    } else {
+      if (*glob == '\\' && glob + 1 < globEnd)
+        glob++;
+      if (*glob != *text)
+        return false;
+    }
+    glob++;
+    text++;
+  }
+  return text == textEnd;
+}
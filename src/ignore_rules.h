@@ -0,0 +1,48 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+  The patterns of the .gitignore files on the way from a project root down
+  to one directory. A directory with a .gitignore adds a level on top of the
+  one of its parent, levels never change once made, so the threads of a
+  walk share them freely. As in git deeper levels override the ones above
+  and within a file the last matching pattern wins.
+  Supported are `*`, `?`, `[...]` and `**`, negation with a leading `!`,
+  directory only patterns ending in `/` and patterns holding a `/`, which
+  are relative to their directory. A directory that is ignored is not
+  looked into, so a negated pattern can't bring back a file inside it.
+*/
+class IgnoreRules {
+  struct Pattern {
+    std::string glob;
+    bool negate = false;
+    bool directoryOnly = false;
+    // matched against the whole relative path, not just the name
+    bool anchored = false;
+  };
+
+  std::shared_ptr<const IgnoreRules> _parent;
+  // directory of the .gitignore relative to the root, "" or ending in '/'
+  std::string _base;
+  std::vector<Pattern> _patterns;
+
+public:
+  // The rules that apply below the directory at path, which has a
+  // .gitignore: parent itself if that holds no patterns. relative is its
+  // path below the root, "" or ending in '/'.
+  static std::shared_ptr<const IgnoreRules>
+  load(std::shared_ptr<const IgnoreRules> parent, const std::string &path,
+       const std::string &relative);
+  // the same for the text of a .gitignore
+  static std::shared_ptr<const IgnoreRules>
+  parse(std::shared_ptr<const IgnoreRules> parent, const std::string &text,
+        const std::string &relative);
+
+  // relative is the path below the root, separated by '/'
+  bool isIgnored(const std::string &relative, bool isDirectory) const;
+
+  static bool matchGlob(const char *glob, const char *globEnd,
+                        const char *text, const char *textEnd);
+};
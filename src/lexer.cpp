@@ -0,0 +1,562 @@
+#include "lexer.h"
+#include <algorithm>
+#include <map>
+#include <string_view>
+#include <tuple>
+
+static const std::u16string whitespace = u" \t\n[]{}();:.,*-+/";
+
+static bool isSeparator(char16_t c) {
+  return whitespace.find(c) != std::u16string::npos;
+}
+
+static bool isNumber(char16_t c) { return c >= '0' && c <= '9'; }
+
+static bool isHexLetter(char16_t c) {
+  return (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static size_t slotOf(uint64_t hash, uint32_t displacement, size_t mask) {
+  // an odd step reaches every slot, the bucket is in the high bits
+  return ((uint32_t)hash + displacement * ((uint32_t)(hash >> 32) | 1)) &
+         mask;
+}
+
+/*
+  Makes the table of a Lexer by running the rules over classes. A state is
+  where the rules are at, with the classes after it they could not decide
+  on yet. Running them from a state over those classes and one more gives
+  the ops decided and the state they stop in, running them with the line
+  ending there gives what a line ending in the state leaves.
+*/
+class Lexer::Builder {
+  enum Step : uint8_t {
+    // between words, after a separator or at the start of the line
+    SEPARATED,
+    // on from a character that is not a separator
+    GLUED,
+    WORD,
+    NUMBER,
+    IN_STRING,
+    // after the escape character in a string
+    ESCAPED,
+    IN_COMMENT,
+    LINE_COMMENT
+  };
+  struct Position {
+    Step step;
+    // the class closing the string
+    uint8_t quote;
+    bool hexa;
+    // whether the last character of the number is a separator
+    bool separated;
+  };
+  struct Class {
+    bool separator;
+    bool digit;
+    bool hexLetter;
+    bool quote;
+    // the character for the classes of one, -1 for the others
+    int32_t character;
+  };
+  // ops on columns of the classes run over
+  typedef std::vector<std::pair<size_t, uint8_t>> Ops;
+
+  Lexer &_lexer;
+  std::vector<Class> _info;
+  std::vector<uint8_t> _single;
+  std::vector<uint8_t> _opener;
+  std::vector<uint8_t> _closer;
+  int _escape = -1;
+  std::vector<std::pair<Position, std::vector<uint8_t>>> _states;
+  std::map<std::vector<uint8_t>, uint16_t> _stateIndex;
+  std::map<std::vector<uint8_t>, uint16_t> _actionIndex;
+
+public:
+  Builder(Lexer &lexer, const LanguageExpanded &language);
+  void build();
+
+private:
+  void addClasses(const LanguageExpanded &language);
+  std::vector<uint8_t> classesOf(const std::u16string &text) const;
+  uint16_t stateOf(const Position &at, std::vector<uint8_t> pending);
+  uint16_t actionOf(const Ops &ops, size_t column);
+  State endOf(const Position &at) const;
+  Position after(uint8_t c) const {
+    return {_info[c].separator ? SEPARATED : GLUED, 0, false, false};
+  }
+  // 1 if delimiter starts at column of text, -1 if text ends before that
+  // is known
+  int match(const std::vector<uint8_t> &text, size_t column,
+            const std::vector<uint8_t> &delimiter, bool final) const;
+  int opensComment(const std::vector<uint8_t> &text, size_t column,
+                   bool final) const;
+  bool endsNumber(uint8_t c, bool hexa) const;
+  // runs the rules from at over text, the column it stopped on
+  size_t run(Position &at, const std::vector<uint8_t> &text, bool final,
+             Ops &ops) const;
+};
+
+Lexer::Builder::Builder(Lexer &lexer, const LanguageExpanded &language)
+    : _lexer(lexer) {
+  addClasses(language);
+  _single = classesOf(language.singleLineComment);
+  if (language.multiLineComment.second.length()) {
+    _opener = classesOf(language.multiLineComment.first);
+    _closer = classesOf(language.multiLineComment.second);
+  }
+  if (language.escapeChar)
+    _escape = _lexer.classOf(language.escapeChar);
+  for (char16_t quote : language.stringCharacters)
+    if (_lexer._quotes.find(quote) == std::u16string::npos)
+      _lexer._quotes += quote;
+}
+
+void Lexer::Builder::addClasses(const LanguageExpanded &language) {
+  std::u16string special = language.singleLineComment +
+                           language.multiLineComment.first +
+                           language.multiLineComment.second +
+                           language.stringCharacters;
+  if (language.escapeChar)
+    special += language.escapeChar;
+  // characters alike to the rules share a class, the ones the rules
+  // compare with have one of their own
+  std::map<std::tuple<bool, bool, int32_t>, uint8_t> classes;
+  auto classOf = [&](char16_t c) {
+    int32_t character = -1;
+    if (special.find(c) != std::u16string::npos || c == '0' || c == '.' ||
+        c == 'x' || c == 'X')
+      character = c;
+    else if (isNumber(c))
+      character = -2;
+    auto key = std::make_tuple(isSeparator(c), isHexLetter(c), character);
+    auto known = classes.find(key);
+    if (known != classes.end())
+      return known->second;
+    bool quote = language.stringCharacters.find(c) != std::u16string::npos;
+    _info.push_back({isSeparator(c), isNumber(c), isHexLetter(c), quote,
+                     character >= 0 ? character : -1});
+    return classes[key] = (uint8_t)(_info.size() - 1);
+  };
+  // class 0 is every character above 127 not in special
+  classOf(0xffff);
+  for (char16_t c = 0; c < 128; c++)
+    _lexer._classes[c] = classOf(c);
+  for (char16_t c : special)
+    if (c >= 128)
+      _lexer._wideClasses.push_back({c, classOf(c)});
+  std::sort(_lexer._wideClasses.begin(), _lexer._wideClasses.end());
+  _lexer._wideClasses.erase(std::unique(_lexer._wideClasses.begin(),
+                                        _lexer._wideClasses.end()),
+                            _lexer._wideClasses.end());
+  _lexer._classCount = _info.size();
+  // rows a power of two long find the state of a row with a shift
+  while ((size_t)1 << _lexer._rowShift < _lexer._classCount)
+    _lexer._rowShift++;
+}
+
+std::vector<uint8_t>
+Lexer::Builder::classesOf(const std::u16string &text) const {
+  std::vector<uint8_t> classes;
+  for (char16_t c : text)
+    classes.push_back(_lexer.classOf(c));
+  return classes;
+}
+
+void Lexer::Builder::build() {
+  _lexer._actions.assign(2, 0);
+  _lexer._startNone = stateOf({SEPARATED, 0, false, false}, {});
+  _lexer._startComment = stateOf({IN_COMMENT, 0, false, false}, {});
+  for (char16_t quote : _lexer._quotes)
+    _lexer._startString.push_back(
+        stateOf({IN_STRING, _lexer.classOf(quote), false, false}, {}));
+  // states are added while going through them
+  for (size_t state = 0; state < _states.size(); state++) {
+    for (size_t c = 0; c < _info.size(); c++) {
+      Position at = _states[state].first;
+      std::vector<uint8_t> text = _states[state].second;
+      text.push_back((uint8_t)c);
+      Ops ops;
+      size_t stopped = run(at, text, false, ops);
+      uint16_t action = actionOf(ops, text.size() - 1);
+      uint16_t next = stateOf(
+          at, std::vector<uint8_t>(text.begin() + stopped, text.end()));
+      _lexer._transitions.push_back(
+          {(uint32_t)next << _lexer._rowShift, action});
+    }
+    _lexer._transitions.resize((state + 1) << _lexer._rowShift);
+    Position at = _states[state].first;
+    const std::vector<uint8_t> &pending = _states[state].second;
+    Ops ops;
+    run(at, pending, true, ops);
+    _lexer._ends.push_back({actionOf(ops, pending.size()), endOf(at)});
+  }
+}
+
+uint16_t Lexer::Builder::stateOf(const Position &at,
+                                 std::vector<uint8_t> pending) {
+  std::vector<uint8_t> key = pending;
+  key.push_back(at.step);
+  key.push_back(at.quote);
+  key.push_back(at.hexa);
+  key.push_back(at.separated);
+  auto known = _stateIndex.find(key);
+  if (known != _stateIndex.end())
+    return known->second;
+  _states.push_back({at, std::move(pending)});
+  return _stateIndex[key] = (uint16_t)(_states.size() - 1);
+}
+
+uint16_t Lexer::Builder::actionOf(const Ops &ops, size_t column) {
+  if (ops.empty())
+    return 0;
+  std::vector<uint8_t> key;
+  for (auto &op : ops) {
+    key.push_back((uint8_t)(op.first - column));
+    key.push_back(op.second);
+  }
+  auto known = _actionIndex.find(key);
+  if (known != _actionIndex.end())
+    return known->second;
+  for (auto &op : ops)
+    _lexer._ops.push_back({(int8_t)(op.first - column), op.second});
+  _lexer._actions.push_back(_lexer._ops.size());
+  return _actionIndex[key] = (uint16_t)(_lexer._actions.size() - 2);
+}
+
+Lexer::State Lexer::Builder::endOf(const Position &at) const {
+  if (at.step == IN_STRING || at.step == ESCAPED)
+    return {STRING, (char16_t)_info[at.quote].character};
+  if (at.step == IN_COMMENT)
+    return {COMMENT, 0};
+  return {NONE, 0};
+}
+
+int Lexer::Builder::match(const std::vector<uint8_t> &text, size_t column,
+                          const std::vector<uint8_t> &delimiter,
+                          bool final) const {
+  if (delimiter.empty())
+    return 0;
+  for (size_t i = 0; i < delimiter.size(); i++) {
+    if (column + i >= text.size())
+      return final ? 0 : -1;
+    if (text[column + i] != delimiter[i])
+      return 0;
+  }
+  return 1;
+}
+
+int Lexer::Builder::opensComment(const std::vector<uint8_t> &text,
+                                 size_t column, bool final) const {
+  int single = match(text, column, _single, final);
+  int block = match(text, column, _opener, final);
+  if (single > 0 || block > 0)
+    return 1;
+  return single < 0 || block < 0 ? -1 : 0;
+}
+
+bool Lexer::Builder::endsNumber(uint8_t c, bool hexa) const {
+  const Class &info = _info[c];
+  if (hexa && info.hexLetter)
+    return false;
+  return !info.digit && info.character != '.' && info.character != 'x';
+}
+
+size_t Lexer::Builder::run(Position &at, const std::vector<uint8_t> &text,
+                           bool final, Ops &ops) const {
+  size_t column = 0;
+  while (column < text.size()) {
+    uint8_t c = text[column];
+    const Class &info = _info[c];
+    switch (at.step) {
+    case LINE_COMMENT:
+      column++;
+      break;
+    case IN_STRING:
+      if (c == _escape) {
+        at.step = ESCAPED;
+      } else if (c == at.quote) {
+        ops.push_back({column + 1, COLOR_DEFAULT});
+        at = after(c);
+      }
+      column++;
+      break;
+    case ESCAPED:
+      at.step = IN_STRING;
+      column++;
+      break;
+    case IN_COMMENT: {
+      int closes = match(text, column, _closer, final);
+      if (closes < 0)
+        return column;
+      if (!closes) {
+        column++;
+        break;
+      }
+      column += _closer.size();
+      ops.push_back({column, COLOR_DEFAULT});
+      at = after(_closer.back());
+      break;
+    }
+    case NUMBER:
+      if (endsNumber(c, at.hexa)) {
+        ops.push_back({column, COLOR_DEFAULT});
+        at = {at.separated ? SEPARATED : GLUED, 0, false, false};
+        break;
+      }
+      at.separated = info.separator;
+      column++;
+      break;
+    case WORD: {
+      // a word runs up to a separator to count
+      if (info.separator) {
+        ops.push_back({column, WORD_END});
+        at = {GLUED, 0, false, false};
+        break;
+      }
+      int ends = info.quote ? 1 : opensComment(text, column, final);
+      if (ends < 0)
+        return column;
+      if (ends)
+        at = {GLUED, 0, false, false};
+      else
+        column++;
+      break;
+    }
+    default: {
+      int single = match(text, column, _single, final);
+      if (single < 0)
+        return column;
+      if (single) {
+        ops.push_back({column, COLOR_COMMENT});
+        at.step = LINE_COMMENT;
+        column++;
+        break;
+      }
+      int block = match(text, column, _opener, final);
+      if (block < 0)
+        return column;
+      if (block) {
+        ops.push_back({column, COLOR_COMMENT});
+        at = {IN_COMMENT, 0, false, false};
+        column += _opener.size();
+        break;
+      }
+      if (info.quote) {
+        ops.push_back({column, COLOR_STRING});
+        at = {IN_STRING, c, false, false};
+        column++;
+        break;
+      }
+      // only what starts after a separator is a number or a word
+      if (info.separator || at.step == GLUED) {
+        at.step = info.separator ? SEPARATED : GLUED;
+        column++;
+        break;
+      }
+      if (!info.digit) {
+        ops.push_back({column, WORD_START});
+        at.step = WORD;
+        column++;
+        break;
+      }
+      bool hexa = false;
+      if (info.character == '0') {
+        if (column + 1 == text.size() && !final)
+          return column;
+        if (column + 1 < text.size()) {
+          int32_t x = _info[text[column + 1]].character;
+          hexa = x == 'x' || x == 'X';
+        }
+      }
+      ops.push_back({column, COLOR_NUMBER});
+      at = {NUMBER, 0, hexa, info.separator};
+      column++;
+      break;
+    }
+    }
+  }
+  if (final && at.step == WORD)
+    ops.push_back({column, WORD_END});
+  return column;
+}
+
+Lexer::Lexer(const LanguageExpanded &language) {
+  Builder builder(*this, language);
+  builder.build();
+  addWords(language);
+}
+
+uint8_t Lexer::wideClassOf(char16_t c) const {
+  auto found = std::lower_bound(
+      _wideClasses.begin(), _wideClasses.end(), c,
+      [](const std::pair<char16_t, uint8_t> &entry, char16_t c) {
+        return entry.first < c;
+      });
+  return found != _wideClasses.end() && found->first == c ? found->second
+                                                          : 0;
+}
+
+uint16_t Lexer::startOf(const State &state) const {
+  if (state.mode == COMMENT)
+    return _startComment;
+  size_t quote = _quotes.find(state.quote);
+  if (state.mode == STRING && quote != std::u16string::npos)
+    return _startString[quote];
+  return _startNone;
+}
+
+Lexer::State Lexer::lex(const std::u16string &line, State state,
+                        std::vector<ColorSpan> *spans) const {
+  const char16_t *text = line.data();
+  size_t length = line.length();
+  size_t row = (size_t)startOf(state) << _rowShift;
+  if (!spans) {
+    for (size_t i = 0; i < length; i++)
+      row = _transitions[row + classOf(text[i])].next;
+    return _ends[row >> _rowShift].state;
+  }
+  auto mark = [&](size_t column, ColorKind kind) {
+    if (column >= length)
+      return;
+    if (spans->size() && spans->back().column == column)
+      spans->pop_back();
+    ColorKind before = spans->size() ? spans->back().kind : COLOR_DEFAULT;
+    if (kind != before)
+      spans->push_back({(uint32_t)column, kind});
+  };
+  size_t wordStart = 0;
+  auto perform = [&](uint16_t action, size_t column) {
+    for (uint32_t i = _actions[action]; i < _actions[action + 1]; i++) {
+      const Op &op = _ops[i];
+      size_t where = column + op.offset;
+      if (op.code < COLOR_KINDS) {
+        mark(where, (ColorKind)op.code);
+      } else if (op.code == WORD_START) {
+        wordStart = where;
+      } else {
+        mark(wordStart, kindOf(text + wordStart, where - wordStart));
+        mark(where, COLOR_DEFAULT);
+      }
+    }
+  };
+  if (state.mode != NONE)
+    mark(0, state.mode == COMMENT ? COLOR_COMMENT : COLOR_STRING);
+  for (size_t i = 0; i < length; i++) {
+    Transition transition = _transitions[row + classOf(text[i])];
+    row = transition.next;
+    if (transition.action)
+      perform(transition.action, i);
+  }
+  const End &end = _ends[row >> _rowShift];
+  perform(end.action, length);
+  return end.state;
+}
+
+uint64_t Lexer::hash(const char16_t *word, size_t length, uint64_t seed) {
+  uint64_t hash = 0xcbf29ce484222325 ^ seed;
+  for (size_t i = 0; i < length; i++)
+    hash = (hash ^ word[i]) * 0x100000001b3;
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccd;
+  return hash ^ (hash >> 33);
+}
+
+void Lexer::addWords(const LanguageExpanded &language) {
+  std::vector<Slot> words;
+  std::vector<std::pair<std::u16string_view, ColorKind>> unique;
+  auto collect = [&](const std::vector<std::u16string> &list,
+                     ColorKind kind) {
+    for (auto &word : list) {
+      if (word.empty() || word.length() > UINT16_MAX)
+        continue;
+      bool known = false;
+      for (auto &entry : unique)
+        known = known || entry.first == word;
+      if (!known)
+        unique.push_back({word, kind});
+    }
+  };
+  // a word in both lists is a keyword
+  collect(language.keyWords, COLOR_KEYWORD);
+  collect(language.specialWords, COLOR_SPECIAL);
+  for (auto &entry : unique) {
+    size_t length = entry.first.length();
+    words.push_back({(uint32_t)_words.length(), (uint16_t)length,
+                     entry.second});
+    _words += entry.first;
+    if (_firsts.size() <= length)
+      _firsts.resize(length + 1, 0);
+    _firsts[length] |= (uint64_t)1 << (entry.first[0] & 63);
+  }
+  // twice as many slots as words, a bucket for every two
+  size_t size = 1;
+  while (size < 2 * words.size())
+    size *= 2;
+  unsigned bucketBits = 1;
+  while ((size_t)1 << bucketBits < words.size() / 2)
+    bucketBits++;
+  _bucketShift = 64 - bucketBits;
+  std::vector<std::vector<size_t>> buckets;
+  std::vector<uint64_t> hashes(words.size());
+  for (_seed = 0;; _seed++) {
+    buckets.assign((size_t)1 << bucketBits, {});
+    for (size_t i = 0; i < words.size(); i++) {
+      hashes[i] = hash(_words.data() + words[i].start, words[i].length,
+                       _seed);
+      buckets[hashes[i] >> _bucketShift].push_back(i);
+    }
+    std::vector<size_t> order(buckets.size());
+    for (size_t i = 0; i < order.size(); i++)
+      order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return buckets[a].size() > buckets[b].size();
+    });
+    _slots.assign(size, {0, 0, COLOR_DEFAULT});
+    _displacements.assign(buckets.size(), 0);
+    bool placed = true;
+    for (size_t bucket : order) {
+      auto &members = buckets[bucket];
+      if (members.empty())
+        break;
+      // the first displacement putting the words of the bucket in free
+      // slots of their own
+      placed = false;
+      for (uint32_t displacement = 0; !placed && displacement < 4 * size;
+           displacement++) {
+        placed = true;
+        for (size_t i = 0; placed && i < members.size(); i++) {
+          size_t slot = slotOf(hashes[members[i]], displacement, size - 1);
+          placed = _slots[slot].length == 0;
+          for (size_t j = 0; placed && j < i; j++)
+            placed = slot != slotOf(hashes[members[j]], displacement,
+                                    size - 1);
+        }
+        if (!placed)
+          continue;
+        for (size_t i : members)
+          _slots[slotOf(hashes[i], displacement, size - 1)] = words[i];
+        _displacements[bucket] = displacement;
+      }
+      if (!placed)
+        break;
+    }
+    if (placed)
+      return;
+  }
+}
+
+ColorKind Lexer::kindOf(const char16_t *word, size_t length) const {
+  // most words are not looked up at all
+  if (length >= _firsts.size() || !(_firsts[length] >> (word[0] & 63) & 1))
+    return COLOR_DEFAULT;
+  uint64_t wordHash = hash(word, length, _seed);
+  const Slot &slot =
+      _slots[slotOf(wordHash, _displacements[wordHash >> _bucketShift],
+                    _slots.size() - 1)];
+  if (slot.length != length ||
+      std::char_traits<char16_t>::compare(_words.data() + slot.start, word,
+                                          length) != 0)
+    return COLOR_DEFAULT;
+  return slot.kind;
+}
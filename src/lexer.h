@@ -0,0 +1,136 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+struct LanguageExpanded {
+  std::u16string modeName;
+  std::vector<std::u16string> keyWords;
+  std::vector<std::u16string> specialWords;
+  std::u16string singleLineComment;
+  std::pair<std::u16string, std::u16string> multiLineComment;
+  std::u16string stringCharacters;
+  char16_t escapeChar;
+};
+
+enum ColorKind : uint8_t {
+  COLOR_DEFAULT,
+  COLOR_STRING,
+  COLOR_KEYWORD,
+  COLOR_SPECIAL,
+  COLOR_COMMENT,
+  COLOR_NUMBER,
+  COLOR_KINDS
+};
+
+// the color of a line from column on up to the next span
+struct ColorSpan {
+  uint32_t column;
+  ColorKind kind;
+};
+
+/*
+  A language compiled for coloring lines, once when it is chosen. Characters
+  fall into a few classes, those that act alike in the language, and a DFA
+  over the classes walks a line one table lookup per character. Lexing
+  needs to look ahead for comment delimiters longer than a character, a
+  state holds the characters not decided on yet and a transition carries
+  out what the character read decides for them: marks a color at a column
+  close to it, or starts or ends a word. A word ending looks itself up in
+  a perfect hash of the key and special words, a hash, a displacement and
+  one comparison. Lexing only for the state a line leaves is the table
+  walk alone, nothing allocates either way.
+  The table is made by running the rules on every state and class, so it
+  colors exactly as they say: comments, block comments and strings go
+  first in that order, the rest of a line is words, numbers and
+  separators, and only words and numbers starting after a separator count.
+  Delimiters are expected to be ASCII, other characters still work, they
+  take a lookup of their own. A block comment needs both of its delimiters.
+  Throughput target on source code, in MB of the file on one core: 250
+  MB/s finding the states lines leave, 80 MB/s coloring them, about ten
+  and three times what the rules make run directly (bench/lexer_bench.cpp).
+*/
+class Lexer {
+public:
+  enum Mode : uint8_t { NONE, STRING, COMMENT };
+  // what a line leaves open for the next one
+  struct State {
+    Mode mode;
+    // what closes the string
+    char16_t quote;
+    bool operator==(const State &other) const {
+      return mode == other.mode && quote == other.quote;
+    }
+  };
+
+private:
+  struct Transition {
+    // where the row of the next state starts
+    uint32_t next;
+    // into _actions, 0 for none
+    uint16_t action;
+  };
+  // an op on the column offset from the character read, the codes after
+  // the color kinds mark words
+  struct Op {
+    int8_t offset;
+    uint8_t code;
+  };
+  enum : uint8_t { WORD_START = COLOR_KINDS, WORD_END };
+  // what is left at the end of a line in a state
+  struct End {
+    uint16_t action;
+    State state;
+  };
+  struct Slot {
+    uint32_t start;
+    // 0 for an empty slot
+    uint16_t length;
+    ColorKind kind;
+  };
+
+  uint8_t _classes[128];
+  // characters of a class of their own from 128 on, sorted
+  std::vector<std::pair<char16_t, uint8_t>> _wideClasses;
+  size_t _classCount = 0;
+  // a row of 1 << _rowShift per state, one for each class
+  unsigned _rowShift = 0;
+  std::vector<Transition> _transitions;
+  std::vector<End> _ends;
+  // the ops of action i are [_actions[i], _actions[i + 1])
+  std::vector<uint32_t> _actions;
+  std::vector<Op> _ops;
+  // the states lines start in, strings by the quote in _quotes
+  uint16_t _startNone = 0;
+  uint16_t _startComment = 0;
+  std::u16string _quotes;
+  std::vector<uint16_t> _startString;
+
+  // the words, _slots hashed with _seed and displaced per bucket
+  std::u16string _words;
+  std::vector<Slot> _slots;
+  std::vector<uint32_t> _displacements;
+  uint64_t _seed = 0;
+  unsigned _bucketShift = 63;
+  // per length a bit for the first characters of the words, modulo 64
+  std::vector<uint64_t> _firsts;
+
+public:
+  explicit Lexer(const LanguageExpanded &language);
+  // colors line starting in state into spans if given, the state at its end
+  State lex(const std::u16string &line, State state,
+            std::vector<ColorSpan> *spans) const;
+
+private:
+  class Builder;
+
+  uint8_t classOf(char16_t c) const {
+    return c < 128 ? _classes[c] : wideClassOf(c);
+  }
+  uint8_t wideClassOf(char16_t c) const;
+  uint16_t startOf(const State &state) const;
+  ColorKind kindOf(const char16_t *word, size_t length) const;
+  void addWords(const LanguageExpanded &language);
+  static uint64_t hash(const char16_t *word, size_t length, uint64_t seed);
+};
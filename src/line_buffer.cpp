@@ -0,0 +1,403 @@
+#include "line_buffer.h"
+#include "u8String.h"
+#include <utility>
+
+static const size_t BLOCK_SIZE = 1024;
+
+LineBuffer::Node *LineBuffer::locate(size_t index, size_t &offset) const {
+  Node *node = _root;
+  offset = index;
+  while (node) {
+    size_t left = countOf(node->left);
+    if (offset < left) {
+      node = node->left;
+    } else if (offset < left + node->weight) {
+      offset -= left;
+      return node;
+    } else {
+      offset -= left + node->weight;
+      node = node->right;
+    }
+  }
+  return nullptr;
+}
+
+LineBuffer::Node *LineBuffer::find(size_t index) {
+  size_t offset;
+  Node *node = locate(index, offset);
+  if (node && node->span != NO_SPAN)
+    node = isolate(index);
+  // the caller gets a mutable reference, the line may change length
+  if (node)
+    touch(index);
+  return node;
+}
+
+void LineBuffer::touch(size_t index) {
+  Node *node = _root;
+  while (node) {
+    node->chars = UNKNOWN;
+    size_t left = countOf(node->left);
+    if (index < left) {
+      node = node->left;
+    } else if (index < left + node->weight) {
+      return;
+    } else {
+      index -= left + node->weight;
+      node = node->right;
+    }
+  }
+}
+
+size_t LineBuffer::ownChars(const Node *node) const {
+  if (node->span == NO_SPAN)
+    return node->text.length() + 1;
+  if (node->spanChars == UNKNOWN) {
+    size_t last = node->span + node->weight - 1;
+    const char *raw = _source->lineData(node->span);
+    size_t length = _source->lineData(last) + _source->lineLength(last) - raw;
+    // the newlines between the lines are one unit each already
+    node->spanChars = utf16Length(raw, length) + 1;
+  }
+  return node->spanChars;
+}
+
+size_t LineBuffer::charsOf(const Node *node) const {
+  if (!node)
+    return 0;
+  if (node->chars == UNKNOWN)
+    node->chars = charsOf(node->left) + ownChars(node) + charsOf(node->right);
+  return node->chars;
+}
+
+size_t LineBuffer::offsetOf(size_t line) {
+  // Cutting at the line leaves the lines before it in nodes of their own,
+  // so a deep position is measured once and cheap to ask for again.
+  cut(line);
+  size_t offset = 0;
+  Node *node = _root;
+  while (node) {
+    size_t left = countOf(node->left);
+    if (line < left) {
+      node = node->left;
+    } else if (line == left) {
+      return offset + charsOf(node->left);
+    } else {
+      offset += charsOf(node->left) + ownChars(node);
+      line -= left + node->weight;
+      node = node->right;
+    }
+  }
+  return offset;
+}
+
+size_t LineBuffer::lineAt(size_t offset) const {
+  const Node *node = _root;
+  size_t line = 0;
+  while (node) {
+    size_t left = charsOf(node->left);
+    if (offset < left) {
+      node = node->left;
+      continue;
+    }
+    offset -= left;
+    line += countOf(node->left);
+    size_t own = ownChars(node);
+    if (offset < own) {
+      if (node->span == NO_SPAN)
+        return line;
+      for (size_t i = 0; i + 1 < node->weight; i++) {
+        size_t length = utf16Length(_source->lineData(node->span + i),
+                                    _source->lineLength(node->span + i)) +
+                        1;
+        if (offset < length)
+          return line + i;
+        offset -= length;
+      }
+      return line + node->weight - 1;
+    }
+    offset -= own;
+    line += node->weight;
+    node = node->right;
+  }
+  return size() ? size() - 1 : 0;
+}
+
+LineBuffer::Node *LineBuffer::isolate(size_t index) {
+  cut(index);
+  cut(index + 1);
+  size_t offset;
+  Node *node = locate(index, offset);
+  node->text = _source->decode(node->span);
+  node->span = NO_SPAN;
+  return node;
+}
+
+void LineBuffer::cut(size_t index) {
+  size_t offset;
+  Node *node = locate(index, offset);
+  if (!node || !offset)
+    return;
+  // The span is taken out and both halves are merged back as nodes of their
+  // own. Halves sharing the priority of the original node would pile up into
+  // a list after many cuts, merging gives the tail a fresh one instead.
+  Node *left, *middle, *right;
+  split(_root, index - offset, left, right);
+  split(right, node->weight, middle, right);
+  Node *tail = allocateSpan(node->span + offset, node->weight - offset);
+  node->weight = offset;
+  node->spanChars = UNKNOWN;
+  update(node);
+  _root = merge(merge(merge(left, node), tail), right);
+}
+
+LineBuffer::Node *LineBuffer::allocate(std::u16string text) {
+  if (!_free) {
+    _blocks.emplace_back(new Node[BLOCK_SIZE]);
+    Node *block = _blocks.back().get();
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+      block[i].right = _free;
+      _free = &block[i];
+    }
+  }
+  Node *node = _free;
+  _free = node->right;
+  node->left = nullptr;
+  node->right = nullptr;
+  node->count = 1;
+  node->weight = 1;
+  node->span = NO_SPAN;
+  node->chars = UNKNOWN;
+  node->spanChars = UNKNOWN;
+  node->prio = nextPrio();
+  node->text = std::move(text);
+  return node;
+}
+
+LineBuffer::Node *LineBuffer::allocateSpan(size_t start, size_t count) {
+  Node *node = allocate(u"");
+  node->span = start;
+  node->weight = count;
+  node->count = count;
+  return node;
+}
+
+void LineBuffer::release(Node *node) {
+  // walks the subtree without recursion, reusing right as the free list link
+  std::vector<Node *> stack;
+  if (node)
+    stack.push_back(node);
+  while (stack.size()) {
+    Node *current = stack.back();
+    stack.pop_back();
+    if (current->left)
+      stack.push_back(current->left);
+    if (current->right)
+      stack.push_back(current->right);
+    std::u16string().swap(current->text);
+    current->left = nullptr;
+    current->right = _free;
+    _free = current;
+  }
+}
+
+uint32_t LineBuffer::nextPrio() {
+  _seed ^= _seed << 13;
+  _seed ^= _seed >> 17;
+  _seed ^= _seed << 5;
+  return _seed;
+}
+
+void LineBuffer::update(Node *node) {
+  node->count = node->weight + countOf(node->left) + countOf(node->right);
+  node->chars = UNKNOWN;
+}
+
+void LineBuffer::split(Node *node, size_t index, Node *&left, Node *&right) {
+  if (!node) {
+    left = right = nullptr;
+    return;
+  }
+  size_t leftCount = countOf(node->left);
+  if (index <= leftCount) {
+    split(node->left, index, left, node->left);
+    right = node;
+  } else {
+    // callers cut() first, so index never falls inside a span
+    split(node->right, index - leftCount - node->weight, node->right, right);
+    left = node;
+  }
+  update(node);
+}
+
+LineBuffer::Node *LineBuffer::merge(Node *left, Node *right) {
+  if (!left)
+    return right;
+  if (!right)
+    return left;
+  if (left->prio > right->prio) {
+    left->right = merge(left->right, right);
+    update(left);
+    return left;
+  }
+  right->left = merge(left, right->left);
+  update(right);
+  return right;
+}
+
+void LineBuffer::heapify(Node *node) {
+  // sift the priority down so a balanced build still is a valid treap
+  while (node) {
+    Node *max = node;
+    if (node->left && node->left->prio > max->prio)
+      max = node->left;
+    if (node->right && node->right->prio > max->prio)
+      max = node->right;
+    if (max == node)
+      return;
+    std::swap(node->prio, max->prio);
+    node = max;
+  }
+}
+
+LineBuffer::Node *LineBuffer::build(std::vector<std::u16string> &lines,
+                                    size_t start, size_t end) {
+  if (start >= end)
+    return nullptr;
+  size_t mid = start + (end - start) / 2;
+  Node *node = allocate(std::move(lines[mid]));
+  node->left = build(lines, start, mid);
+  node->right = build(lines, mid + 1, end);
+  heapify(node);
+  update(node);
+  return node;
+}
+
+LineBuffer::Node *LineBuffer::build(std::vector<Node *> &nodes, size_t start,
+                                    size_t end) {
+  if (start >= end)
+    return nullptr;
+  size_t mid = start + (end - start) / 2;
+  Node *node = nodes[mid];
+  node->left = build(nodes, start, mid);
+  node->right = build(nodes, mid + 1, end);
+  heapify(node);
+  update(node);
+  return node;
+}
+
+void LineBuffer::replaceLines(
+    std::vector<std::pair<size_t, std::u16string>> &lines) {
+  // a few lines are cheaper to isolate than rebuilding everything
+  if (lines.size() < 1024) {
+    for (auto &line : lines)
+      (*this)[line.first] = std::move(line.second);
+    return;
+  }
+  std::vector<Node *> nodes;
+  std::vector<Node *> stack;
+  Node *node = _root;
+  while (node || stack.size()) {
+    while (node) {
+      stack.push_back(node);
+      node = node->left;
+    }
+    node = stack.back();
+    stack.pop_back();
+    nodes.push_back(node);
+    node = node->right;
+  }
+  std::vector<Node *> result;
+  result.reserve(nodes.size() + 2 * lines.size());
+  size_t next = 0;
+  size_t base = 0;
+  for (Node *current : nodes) {
+    size_t end = base + current->weight;
+    current->left = current->right = nullptr;
+    if (next == lines.size() || lines[next].first >= end) {
+      result.push_back(current);
+    } else if (current->span == NO_SPAN) {
+      current->text = std::move(lines[next++].second);
+      result.push_back(current);
+    } else {
+      // the span is cut around the replaced lines, which become own nodes
+      size_t at = base;
+      while (next < lines.size() && lines[next].first < end) {
+        size_t line = lines[next].first;
+        if (line > at)
+          result.push_back(
+              allocateSpan(current->span + (at - base), line - at));
+        result.push_back(allocate(std::move(lines[next++].second)));
+        at = line + 1;
+      }
+      if (at < end)
+        result.push_back(allocateSpan(current->span + (at - base), end - at));
+      release(current);
+    }
+    base = end;
+  }
+  _root = build(result, 0, result.size());
+}
+
+void LineBuffer::insert(size_t index, std::u16string line) {
+  cut(index);
+  Node *left, *right;
+  split(_root, index, left, right);
+  _root = merge(merge(left, allocate(std::move(line))), right);
+}
+
+void LineBuffer::insert(size_t index, std::vector<std::u16string> lines) {
+  if (!lines.size())
+    return;
+  cut(index);
+  Node *left, *right;
+  split(_root, index, left, right);
+  _root = merge(merge(left, build(lines, 0, lines.size())), right);
+}
+
+void LineBuffer::erase(size_t index, size_t count) {
+  if (!count)
+    return;
+  cut(index);
+  cut(index + count);
+  Node *left, *middle, *right;
+  split(_root, index, left, right);
+  split(right, count, middle, right);
+  release(middle);
+  _root = merge(left, right);
+}
+
+void LineBuffer::assign(std::vector<std::u16string> lines) {
+  clear();
+  _root = build(lines, 0, lines.size());
+}
+
+void LineBuffer::assign(std::shared_ptr<LineSource> source) {
+  clear();
+  _source = source;
+  if (_source->size())
+    _root = allocateSpan(0, _source->size());
+}
+
+void LineBuffer::appendSpan(size_t start, size_t count) {
+  if (count)
+    _root = merge(_root, allocateSpan(start, count));
+}
+
+void LineBuffer::clear() {
+  release(_root);
+  _root = nullptr;
+  _source = nullptr;
+}
+
+void LineBuffer::detach() {
+  if (!_source)
+    return;
+  std::vector<std::u16string> lines;
+  lines.reserve(size());
+  forEach([&](size_t, const std::u16string &line) {
+    lines.push_back(line);
+    return true;
+  });
+  assign(std::move(lines));
+}
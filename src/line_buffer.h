@@ -0,0 +1,183 @@
+#pragma once
+#include "line_source.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+/*
+  Line storage for Document.
+  Lines are kept in an implicit treap ordered by line index, every node knows
+  how many lines are below it, so locating, inserting or erasing a line costs
+  O(log n) no matter where in the buffer it happens. Nodes come from a pooled
+  allocator and never move, references returned by operator[] stay valid
+  until that line is erased.
+  A node either owns one decoded line or a span of untouched lines of the
+  LineSource the buffer was loaded from. Spans are split and decoded lazily
+  when a line in them is accessed through operator[].
+  Nodes also sum up the UTF-16 length of their subtree, counting one newline
+  per line, which turns line numbers into character offsets and back in
+  O(log n). The sums are filled in lazily: structural changes and
+  operator[] clear them on the path they touch and the next query
+  recomputes only what was cleared, spans are measured on first use.
+*/
+class LineBuffer {
+  static const size_t NO_SPAN = (size_t)-1;
+  static const size_t UNKNOWN = (size_t)-1;
+
+  struct Node {
+    Node *left = nullptr;
+    Node *right = nullptr;
+    uint32_t prio = 0;
+    size_t count = 1;
+    // lines held by this node itself, only spans hold more than one
+    size_t weight = 1;
+    size_t span = NO_SPAN;
+    // characters of the subtree and of a span itself, UNKNOWN until needed
+    mutable size_t chars = UNKNOWN;
+    mutable size_t spanChars = UNKNOWN;
+    std::u16string text;
+  };
+
+  Node *_root = nullptr;
+  std::vector<std::unique_ptr<Node[]>> _blocks;
+  Node *_free = nullptr;
+  uint32_t _seed = 0x9e3779b9;
+  std::shared_ptr<LineSource> _source;
+
+public:
+  LineBuffer() = default;
+  LineBuffer(const LineBuffer &) = delete;
+  LineBuffer &operator=(const LineBuffer &) = delete;
+
+  size_t size() const { return _root ? _root->count : 0; }
+  bool empty() const { return _root == nullptr; }
+
+  std::u16string &operator[](size_t index) { return find(index)->text; }
+  std::u16string &back() { return find(size() - 1)->text; }
+
+  void push_back(std::u16string line) { insert(size(), std::move(line)); }
+  void insert(size_t index, std::u16string line);
+  void insert(size_t index, std::vector<std::u16string> lines);
+  void erase(size_t index, size_t count = 1);
+  void assign(std::vector<std::u16string> lines);
+  void assign(std::shared_ptr<LineSource> source);
+  // Replaces the text of many lines, sorted by index, in one pass that
+  // rebuilds the tree instead of isolating every line on its own.
+  void replaceLines(std::vector<std::pair<size_t, std::u16string>> &lines);
+  // appends source lines [start, start + count) after the last line, used
+  // while the source is still growing
+  void appendSpan(size_t start, size_t count);
+  void clear();
+
+  // Character offset at which a line starts, size() gives the total. Lines
+  // before it that are still in a span are measured, not decoded.
+  size_t offsetOf(size_t line);
+  // line that contains a character offset
+  size_t lineAt(size_t offset) const;
+
+  const std::shared_ptr<LineSource> &getSource() const { return _source; }
+  // decodes every span left so the source is no longer referenced
+  void detach();
+
+  // Visits lines [from, to) in order, the callback returns false to stop.
+  // Lines still in a span are decoded into a scratch buffer for the call.
+  template <typename F> void forEach(size_t from, size_t to, F &&fn) const {
+    std::u16string scratch;
+    visit(_root, 0, from, to, fn, scratch);
+  }
+  template <typename F> void forEach(F &&fn) const {
+    forEach(0, size(), fn);
+  }
+
+  // Visits the buffer node by node with fn(text, raw, rawLength): decoded
+  // lines come as text, untouched spans as the raw source bytes of all their
+  // lines including the newlines between them. Consecutive chunks are
+  // separated by a single newline.
+  template <typename F> void forEachChunk(F &&fn) const {
+    forEachChunk(0, size(), fn);
+  }
+  // the same for lines [from, to), spans come cut to the lines in it
+  template <typename F>
+  void forEachChunk(size_t from, size_t to, F &&fn) const {
+    visitChunks(_root, 0, from, to, fn);
+  }
+
+private:
+  Node *locate(size_t index, size_t &offset) const;
+  Node *find(size_t index);
+  Node *isolate(size_t index);
+  // makes index the first line of a node by cutting the span it falls in
+  void cut(size_t index);
+  Node *allocate(std::u16string text);
+  Node *allocateSpan(size_t start, size_t count);
+  void release(Node *node);
+  uint32_t nextPrio();
+  Node *build(std::vector<std::u16string> &lines, size_t start, size_t end);
+  Node *build(std::vector<Node *> &nodes, size_t start, size_t end);
+  static void heapify(Node *node);
+  static void update(Node *node);
+  static size_t countOf(const Node *node) { return node ? node->count : 0; }
+  size_t charsOf(const Node *node) const;
+  size_t ownChars(const Node *node) const;
+  void touch(size_t index);
+  void split(Node *node, size_t index, Node *&left, Node *&right);
+  static Node *merge(Node *left, Node *right);
+
+  template <typename F>
+  bool visitChunks(const Node *node, size_t base, size_t from, size_t to,
+                   F &fn) const {
+    while (node) {
+      size_t own = base + countOf(node->left);
+      if (from < own && !visitChunks(node->left, base, from, to, fn))
+        return false;
+      if (own >= to)
+        return true;
+      if (node->span == NO_SPAN) {
+        if (own >= from && !fn(&node->text, nullptr, 0))
+          return false;
+      } else if (own + node->weight > from) {
+        size_t first = from > own ? from - own : 0;
+        size_t end = to - own < node->weight ? to - own : node->weight;
+        const char *raw = _source->lineData(node->span + first);
+        size_t last = node->span + end - 1;
+        size_t length =
+            _source->lineData(last) + _source->lineLength(last) - raw;
+        if (!fn(nullptr, raw, length))
+          return false;
+      }
+      base = own + node->weight;
+      node = node->right;
+    }
+    return true;
+  }
+
+  template <typename F>
+  bool visit(const Node *node, size_t base, size_t from, size_t to, F &fn,
+             std::u16string &scratch) const {
+    // iterative descent along the right spine keeps the stack at O(log n)
+    while (node) {
+      size_t own = base + countOf(node->left);
+      if (from < own && !visit(node->left, base, from, to, fn, scratch))
+        return false;
+      if (own >= to)
+        return true;
+      if (node->span == NO_SPAN) {
+        if (own >= from && !fn(own, static_cast<const std::u16string &>(
+                                        node->text)))
+          return false;
+      } else {
+        size_t first = from > own ? from - own : 0;
+        size_t last = to - own < node->weight ? to - own : node->weight;
+        for (size_t i = first; i < last; i++) {
+          _source->decodeInto(node->span + i, scratch);
+          if (!fn(own + i, static_cast<const std::u16string &>(scratch)))
+            return false;
+        }
+      }
+      base = own + node->weight;
+      node = node->right;
+    }
+    return true;
+  }
+};
@@ -0,0 +1,121 @@
+#include "line_index.h"
+#include "simd.h"
+#include <algorithm>
+#include <thread>
+
+// below this a single thread finishes before the others would have started
+static const size_t PARALLEL_CHUNK = 16 * 1024 * 1024;
+// bytes counted at each of SAMPLES places to guess how many lines to reserve
+static const size_t SAMPLE_SIZE = 16 * 1024;
+static const size_t SAMPLES = 4;
+
+// Lines in data[0, size) extrapolated from a few samples spread over it,
+// with some headroom. A wrong guess only costs a regrowth of the vector.
+static size_t estimateLines(const char *data, size_t size) {
+  if (size <= SAMPLES * SAMPLE_SIZE)
+    return simd::countNewlines(data, size) + 1;
+  size_t found = 0;
+  for (size_t s = 0; s < SAMPLES; s++)
+    found += simd::countNewlines(
+        data + (size - SAMPLE_SIZE) / (SAMPLES - 1) * s, SAMPLE_SIZE);
+  size_t lines = size / (SAMPLES * SAMPLE_SIZE) * found;
+  return lines + lines / 8 + 1;
+}
+
+uint64_t LineIndex::operator[](size_t index) const {
+  uint64_t high = std::upper_bound(_wraps.begin(), _wraps.end(), index) -
+                  _wraps.begin();
+  return (high << 32) | _low[index];
+}
+
+void LineIndex::append(const LineIndex &other) {
+  _low.reserve(_low.size() + other._low.size());
+  size_t wrap = 0;
+  uint64_t high = 0;
+  for (size_t i = 0; i < other._low.size(); i++) {
+    while (wrap < other._wraps.size() && other._wraps[wrap] <= i) {
+      wrap++;
+      high++;
+    }
+    push((high << 32) | other._low[i]);
+  }
+}
+
+#ifdef LEDIT_AVX2
+LEDIT_AVX2_TARGET static size_t scanAvx2(const char *data, size_t size,
+                                         uint64_t base, LineIndex &index) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(data + i));
+    uint32_t nl = (uint32_t)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(block, newline));
+    while (nl) {
+      index.push(base + i + simd::ctz(nl) + 1);
+      nl &= nl - 1;
+    }
+  }
+  return i;
+}
+#endif
+
+#ifdef LEDIT_SSE2
+static size_t scanSse2(const char *data, size_t size, uint64_t base,
+                       LineIndex &index) {
+  const __m128i newline = _mm_set1_epi8('\n');
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+    uint32_t nl = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+    while (nl) {
+      index.push(base + i + simd::ctz(nl) + 1);
+      nl &= nl - 1;
+    }
+  }
+  return i;
+}
+#endif
+
+void LineIndex::scan(const char *data, size_t size, uint64_t base) {
+  size_t i = 0;
+#ifdef LEDIT_AVX2
+  if (simd::hasAvx2())
+    i = scanAvx2(data, size, base, *this);
+#endif
+#ifdef LEDIT_SSE2
+  i += scanSse2(data + i, size - i, base + i, *this);
+#endif
+  for (; i < size; i++) {
+    if (data[i] == '\n')
+      push(base + i + 1);
+  }
+}
+
+LineIndex LineIndex::build(const char *data, size_t size, unsigned threads) {
+  LineIndex index;
+  index.push(0);
+  if (!threads)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t chunks = std::min<size_t>(threads, size / PARALLEL_CHUNK);
+  if (chunks <= 1) {
+    index.reserve(estimateLines(data, size) + 1);
+    index.scan(data, size, 0);
+    return index;
+  }
+  size_t chunkSize = size / chunks;
+  std::vector<LineIndex> parts(chunks);
+  std::vector<std::thread> workers;
+  for (size_t c = 0; c < chunks; c++) {
+    size_t start = c * chunkSize;
+    size_t end = c == chunks - 1 ? size : start + chunkSize;
+    workers.emplace_back([&parts, c, data, start, end]() {
+      parts[c].reserve(estimateLines(data + start, end - start));
+      parts[c].scan(data + start, end - start, start);
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+  for (auto &part : parts)
+    index.append(part);
+  return index;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+  Byte offsets of line starts in a file.
+  Offsets are stored as their low 32 bits, _wraps holds the line indices at
+  which the upper half grows, so the table costs 4 bytes per line for files
+  of any size.
+*/
+class LineIndex {
+  std::vector<uint32_t> _low;
+  std::vector<uint64_t> _wraps;
+  uint64_t _high = 0;
+
+public:
+  size_t size() const { return _low.size(); }
+  void reserve(size_t count) { _low.reserve(count); }
+  void push(uint64_t offset) {
+    while ((offset >> 32) > _high) {
+      _wraps.push_back(_low.size());
+      _high++;
+    }
+    _low.push_back((uint32_t)offset);
+  }
+  uint64_t operator[](size_t index) const;
+  void append(const LineIndex &other);
+
+  // Scans data[0, size) and pushes base + offset for every byte after a
+  // '\n'.
+  void scan(const char *data, size_t size, uint64_t base);
+
+  // Full index of a buffer, line 0 starts at offset 0. Buffers larger than
+  // a few chunks are split across threads and merged in order.
+  static LineIndex build(const char *data, size_t size, unsigned threads = 0);
+};
@@ -0,0 +1,42 @@
+#include "line_snapshot.h"
+
+LineSnapshot::LineSnapshot(const LineBuffer &lines)
+    : LineSnapshot(lines, 0, lines.size()) {}
+
+LineSnapshot::LineSnapshot(const LineBuffer &lines, size_t from, size_t to)
+    : _source(lines.getSource()) {
+  size_t bytes = 0;
+  lines.forEachChunk(
+      from, to,
+      [&](const std::u16string *text, const char *raw, size_t length) {
+        if (text) {
+          // runs of decoded lines share a part
+          if (_parts.empty() || !_parts.back().decoded || bytes >= PART_BYTES) {
+            _parts.emplace_back();
+            bytes = 0;
+          }
+          _parts.back().lines.push_back(*text);
+          bytes += text->length() * sizeof(char16_t) + sizeof(std::u16string);
+          return true;
+        }
+        // a part ends at a newline, a single huge line stays whole
+        while (length > PART_BYTES) {
+          auto newline = (const char *)memchr(raw + PART_BYTES, '\n',
+                                              length - PART_BYTES);
+          if (!newline)
+            break;
+          addRaw(raw, newline - raw);
+          length -= newline + 1 - raw;
+          raw = newline + 1;
+        }
+        addRaw(raw, length);
+        return true;
+      });
+}
+
+void LineSnapshot::addRaw(const char *raw, size_t length) {
+  _parts.emplace_back();
+  _parts.back().decoded = false;
+  _parts.back().raw = raw;
+  _parts.back().rawLength = length;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "line_buffer.h"
+#include "u8String.h"
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+  The lines of a LineBuffer as they were at one point, for other threads to
+  read while the buffer goes on changing. Decoded lines are copied, spans of
+  untouched lines are only referenced: their bytes lie in the mapping of the
+  LineSource, which never changes and which the snapshot keeps alive, and
+  are decoded by whoever reads them. Taking one costs time in the decoded
+  lines and the number of nodes, not in the size of the file, and it never
+  reads the line index the loader keeps extending.
+  The lines are cut into parts of about PART_BYTES so a large buffer can be
+  read by several threads, a part only knows its own lines.
+*/
+class LineSnapshot {
+public:
+  struct Part {
+    // decoded lines, or the raw bytes of whole lines and the newlines
+    // between them
+    bool decoded = true;
+    std::vector<std::u16string> lines;
+    const char *raw = nullptr;
+    size_t rawLength = 0;
+
+    // Visits the lines in order with fn(index in the part, text), the
+    // callback returns false to stop.
+    template <typename F> void forEach(F &&fn) const {
+      if (decoded) {
+        for (size_t i = 0; i < lines.size(); i++) {
+          if (!fn(i, lines[i]))
+            return;
+        }
+        return;
+      }
+      std::u16string scratch;
+      const char *at = raw;
+      const char *end = raw + rawLength;
+      for (size_t i = 0;; i++) {
+        const char *newline =
+            at < end ? (const char *)memchr(at, '\n', end - at) : nullptr;
+        scratch.clear();
+        appendUtf16(scratch, at, (newline ? newline : end) - at);
+        if (!fn(i, static_cast<const std::u16string &>(scratch)) || !newline)
+          return;
+        at = newline + 1;
+      }
+    }
+  };
+
+  static const size_t PART_BYTES = 4 * 1024 * 1024;
+
+  explicit LineSnapshot(const LineBuffer &lines);
+  // only lines [from, to), which cost only what they hold
+  LineSnapshot(const LineBuffer &lines, size_t from, size_t to);
+
+  // the parts back to back hold every line
+  const std::vector<Part> &parts() const { return _parts; }
+
+private:
+  std::shared_ptr<LineSource> _source;
+  std::vector<Part> _parts;
+
+  void addRaw(const char *raw, size_t length);
+};
@@ -0,0 +1,56 @@
+#include "line_source.h"
+#include "u8String.h"
+
+std::shared_ptr<LineSource> LineSource::open(const std::string &path,
+                                             size_t scanLimit) {
+  auto file = MappedFile::open(path);
+  if (!file)
+    return nullptr;
+  auto source = std::shared_ptr<LineSource>(new LineSource);
+  source->_path = path;
+  source->_file = file;
+  source->_intact = file->size();
+  size_t scan = scanLimit < file->size() ? scanLimit : file->size();
+  source->_starts = LineIndex::build(file->data(), scan);
+  source->_scanned = scan;
+  source->_complete = scan == file->size();
+  if (!source->_complete && source->_starts.size() == 1) {
+    // not a single complete line yet, there would be nothing to show
+    LineIndex rest;
+    rest.scan(file->data() + scan, file->size() - scan, scan);
+    source->extend(rest, file->size());
+  }
+  return source;
+}
+
+void LineSource::extend(const LineIndex &more, size_t scanned) {
+  _starts.append(more);
+  _scanned = scanned;
+  _complete = scanned == byteSize();
+}
+
+bool LineSource::checkIntact() {
+  size_t intact = _file->intactSize();
+  if (intact < _intact)
+    _intact = intact;
+  return _intact == byteSize();
+}
+
+size_t LineSource::lineLength(size_t index) const {
+  size_t start = _starts[index];
+  size_t end =
+      index + 1 < _starts.size() ? _starts[index + 1] - 1 : byteSize();
+  size_t intact = _intact.load(std::memory_order_relaxed);
+  if (end > intact)
+    end = intact;
+  return end > start ? end - start : 0;
+}
+
+std::u16string LineSource::decode(size_t index) const {
+  return create(lineData(index), lineLength(index));
+}
+
+void LineSource::decodeInto(size_t index, std::u16string &out) const {
+  out.clear();
+  appendUtf16(out, lineData(index), lineLength(index));
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "mapped_file.h"
+#include "line_index.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <stdint.h>
+
+/*
+  The unmodified bytes of an opened file together with the offsets at which
+  its lines start. Lines are only decoded to UTF-16 once they are requested,
+  the file itself stays mapped read-only. Once the file was truncated on
+  disk the lines past its end decode cut short or empty rather than
+  touching pages no longer there.
+*/
+class LineSource {
+  std::string _path;
+  std::shared_ptr<MappedFile> _file;
+  LineIndex _starts;
+  size_t _scanned = 0;
+  bool _complete = false;
+  // the bytes lines are decoded from, set by checkIntact()
+  std::atomic<size_t> _intact{0};
+
+public:
+  // Indexes at most scanLimit bytes up front, the rest is added through
+  // extend(). Until the whole file is known only lines that already saw
+  // their '\n' are exposed.
+  static std::shared_ptr<LineSource> open(const std::string &path,
+                                          size_t scanLimit = (size_t)-1);
+
+  const std::string &getPath() const { return _path; }
+  size_t size() const {
+    return _complete ? _starts.size() : _starts.size() - 1;
+  }
+  bool isComplete() const { return _complete; }
+  size_t scannedBytes() const { return _scanned; }
+  void extend(const LineIndex &more, size_t scanned);
+  const char *data() const { return _file->data(); }
+  size_t byteSize() const { return _file->size(); }
+  const LineIndex &getIndex() const { return _starts; }
+  // Looks at the file again, false if it was truncated in place since it
+  // was opened. Only the raw bytes of an intact source may be used.
+  bool checkIntact();
+
+  // raw bytes of a line without its trailing '\n'
+  const char *lineData(size_t index) const { return data() + _starts[index]; }
+  size_t lineLength(size_t index) const;
+  std::u16string decode(size_t index) const;
+  // decodes into a buffer reused between calls
+  void decodeInto(size_t index, std::u16string &out) const;
+};
@@ -39,11 +39,17 @@ VertexLayout selVertexLayout[] = {
     {2, offsetof(SelectionEntry, size), 1},
 };
 
+// search matches highlighted on screen at once, the rest are not drawn
+static const size_t MAX_MATCH_ENTRIES = 4096;
+
 int main(int argc, char **argv) {
 #ifdef _WIN32
   ShowWindow(GetConsoleWindow(), SW_HIDE);
 #endif
-  std::string initialPath = argc >= 2 ? std::string(argv[1]) : "";
+  // -f follows the file like tail -f
+  bool follow = argc >= 3 && std::string(argv[1]) == "-f";
+  std::string initialPath =
+      argc >= 2 ? std::string(argv[follow ? 2 : 1]) : "";
 
   const std::string window_name =
       "ledit: " + (initialPath.length() ? initialPath : "New File");
@@ -62,7 +68,11 @@ int main(int argc, char **argv) {
     return 2;
   }
 
+  state.wakeUp = GlfwApp::postEmptyEvent;
+  state.highlighter.setNotify(state.wakeUp);
   state.addCursor(initialPath);
+  if (follow)
+    state.toggleFollow();
   // state.window = window;
 
   auto fontHeight = 30;
@@ -75,7 +85,8 @@ int main(int argc, char **argv) {
 
   auto selection = std::shared_ptr<Drawable>(new Drawable(
       Shader::createSelection(), sizeof(SelectionEntry), selVertexLayout,
-      _countof(selVertexLayout), sizeof(SelectionEntry) * 16));
+      _countof(selVertexLayout),
+      sizeof(SelectionEntry) * MAX_MATCH_ENTRIES));
 
   auto cursor_shader = Shader::createCursor();
 
@@ -90,8 +101,11 @@ int main(int argc, char **argv) {
   float WIDTH = 0;
   float HEIGHT = 0;
   Renderer r;
+  std::vector<SearchMatch> visibleMatches;
+  std::vector<SelectionEntry> matchEntries;
   auto maxRenderWidth = 0;
   while (app.isWindowAlive()) {
+    state.poll();
     if (state.cacheValid) {
       app.wait();
       continue;
@@ -99,7 +113,6 @@ int main(int argc, char **argv) {
 
     if (HEIGHT != state.HEIGHT || WIDTH != state.WIDTH) {
       WIDTH = state.WIDTH;
-      state.highlighter.wasCached = false;
       HEIGHT = state.HEIGHT;
     }
 
@@ -117,6 +130,11 @@ int main(int argc, char **argv) {
 
     gpu::clear(state.WIDTH, state.HEIGHT, &be_color.x);
 
+    // lays out the visible lines first, that can scroll the view
+    auto &entries =
+        r.render(WIDTH, HEIGHT, cursor, atlas, fontWidth, {1, 1, 1, 1},
+                 state.hasHighlighting ? &state.highlighter : nullptr);
+
     if (state.highlightLine) {
       selection->use();
       auto color = state.provider.colors.highlight_color;
@@ -129,6 +147,47 @@ int main(int argc, char **argv) {
       selection->drawUploadInstance(&entry, sizeof(SelectionEntry), 6, 1);
     }
 
+    if (state.searchIndex.isActive()) {
+      // every match on screen gets a box behind its text, one instance each
+      state.searchIndex.visible(cursor->_skip,
+                                cursor->_skip + cursor->_prepare.size(),
+                                visibleMatches);
+      matchEntries.clear();
+      float left = (-(int32_t)WIDTH / 2) + 20;
+      size_t shift = cursor->_xOffset;
+      for (auto &match : visibleMatches) {
+        if (matchEntries.size() == MAX_MATCH_ENTRIES)
+          break;
+        size_t end = match.column + match.length;
+        // scrolled out to the left, an empty match stays up to its column
+        if (end < shift || (end == shift && match.length))
+          continue;
+        size_t row = match.line - cursor->_skip;
+        auto &content = cursor->_prepare[row].second;
+        size_t from = match.column > shift ? match.column - shift : 0;
+        if (from > content.length())
+          continue;
+        float x = left + atlas->getAdvance(content.substr(0, from));
+        if (x > WIDTH / 2)
+          continue;
+        float width =
+            atlas->getAdvance(content.substr(from, end - shift - from));
+        matchEntries.push_back(
+            {vec2f(x, (float)HEIGHT / 2 - 5 - toOffset - (row * toOffset)),
+             vec2f(width > 2 ? width : 2, toOffset)});
+      }
+      if (matchEntries.size()) {
+        selection->use();
+        auto color = state.provider.colors.search_match_color;
+        selection->set("selection_color", color.x, color.y, color.z, color.w);
+        selection->set("resolution", WIDTH, HEIGHT);
+        selection->drawUploadInstance(&matchEntries[0],
+                                      sizeof(SelectionEntry) *
+                                          matchEntries.size(),
+                                      6, matchEntries.size());
+      }
+    }
+
     text->use();
     text->set("resolution", WIDTH, HEIGHT);
 
@@ -163,8 +222,6 @@ int main(int argc, char **argv) {
     //   }
     // }
 
-    auto &entries =
-        r.render(WIDTH, HEIGHT, cursor, atlas, fontWidth, {1, 1, 1, 1});
     text->drawUploadInstance(&entries[0], sizeof(RenderChar) * entries.size(),
                              6, entries.size());
 
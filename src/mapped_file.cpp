@@ -0,0 +1,99 @@
+#include "mapped_file.h"
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string &path) {
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return nullptr;
+  auto mapped = std::shared_ptr<MappedFile>(new MappedFile);
+  mapped->_file = file;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size))
+    return nullptr;
+  mapped->_size = (size_t)size.QuadPart;
+  if (mapped->_size == 0)
+    return mapped;
+  mapped->_mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!mapped->_mapping)
+    return nullptr;
+  mapped->_data = static_cast<const char *>(
+      MapViewOfFile(mapped->_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!mapped->_data)
+    return nullptr;
+  return mapped;
+}
+
+size_t MappedFile::intactSize() const { return _size; }
+
+void MappedFile::discard(size_t, size_t) const {
+  // the working set manager trims clean file pages on its own
+}
+
+MappedFile::~MappedFile() {
+  if (_data)
+    UnmapViewOfFile(_data);
+  if (_mapping)
+    CloseHandle(_mapping);
+  if (_file)
+    CloseHandle(_file);
+}
+
+#else
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+    close(fd);
+    return nullptr;
+  }
+  auto mapped = std::shared_ptr<MappedFile>(new MappedFile);
+  mapped->_fd = fd;
+  mapped->_size = info.st_size;
+  if (mapped->_size) {
+    void *data = mmap(nullptr, mapped->_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+      return nullptr;
+    madvise(data, mapped->_size, MADV_SEQUENTIAL);
+    mapped->_data = static_cast<const char *>(data);
+  }
+  return mapped;
+}
+
+size_t MappedFile::intactSize() const {
+  struct stat info;
+  if (fstat(_fd, &info) != 0 || (size_t)info.st_size >= _size)
+    return _size;
+  return info.st_size;
+}
+
+void MappedFile::discard(size_t offset, size_t length) const {
+  if (!_data || offset >= _size)
+    return;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t start = (offset + page - 1) / page * page;
+  size_t end = offset + length < _size ? (offset + length) / page * page : _size;
+  if (start < end)
+    madvise(const_cast<char *>(_data) + start, end - start, MADV_DONTNEED);
+}
+
+MappedFile::~MappedFile() {
+  if (_data)
+    munmap(const_cast<char *>(_data), _size);
+  if (_fd >= 0)
+    close(_fd);
+}
+
+#endif
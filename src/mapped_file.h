@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <stddef.h>
+
+/*
+  Read-only memory mapping of a whole file, unmapped on destruction.
+  The pages are read from the file as they are touched, not copied when it
+  is opened. A file replaced on disk, as by a rename, leaves the mapping
+  as it was, but one truncated in place makes touching the pages past its
+  new end raise SIGBUS. Users look at intactSize() before relying on the
+  whole mapping and stop reading from it once the file changed. What is
+  left is the time between looking and reading, and readers on other
+  threads such as the loader, they are not guarded against a truncation
+  in that moment. Windows refuses to truncate a mapped file.
+*/
+class MappedFile {
+  const char *_data = nullptr;
+  size_t _size = 0;
+#ifdef _WIN32
+  void *_file = nullptr;
+  void *_mapping = nullptr;
+#else
+  // kept open to see what became of the file mapped
+  int _fd = -1;
+#endif
+
+  MappedFile() = default;
+
+public:
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  static std::shared_ptr<MappedFile> open(const std::string &path);
+
+  const char *data() const { return _data; }
+  size_t size() const { return _size; }
+  // the bytes of the mapping the file still holds, less than size() once
+  // it was truncated in place
+  size_t intactSize() const;
+  // drops the resident pages of a range, they are read again when touched
+  void discard(size_t offset, size_t length) const;
+};
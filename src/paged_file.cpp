@@ -0,0 +1,133 @@
+#include "paged_file.h"
+#include "line_index.h"
+#include <algorithm>
+#include <functional>
+#include <string.h>
+
+static const size_t CHUNK_SIZE = 16 * 1024 * 1024;
+
+std::shared_ptr<PagedFile> PagedFile::open(const std::string &path,
+                                           std::function<void()> notify) {
+  auto file = MappedFile::open(path);
+  if (!file)
+    return nullptr;
+  auto paged = std::shared_ptr<PagedFile>(new PagedFile);
+  paged->_file = file;
+  paged->_path = path;
+  paged->_notify = notify;
+  paged->_checkpoints.push_back(0);
+  paged->_thread = std::thread(&PagedFile::run, paged.get());
+  return paged;
+}
+
+PagedFile::~PagedFile() {
+  _cancel = true;
+  if (_thread.joinable())
+    _thread.join();
+}
+
+void PagedFile::run() {
+  const char *data = _file->data();
+  uint64_t size = _file->size();
+  uint64_t offset = 0;
+  uint64_t line = 1;
+  std::vector<uint64_t> found;
+  while (offset < size && !_cancel) {
+    size_t length = size - offset < CHUNK_SIZE ? size - offset : CHUNK_SIZE;
+    LineIndex part;
+    part.scan(data + offset, length, offset);
+    found.clear();
+    for (size_t i = 0; i < part.size(); i++, line++) {
+      if (line % STRIDE == 0)
+        found.push_back(part[i]);
+    }
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _checkpoints.insert(_checkpoints.end(), found.begin(), found.end());
+      _indexed = offset + length;
+      _lines = line;
+    }
+    // keep the resident set from growing with the file
+    _file->discard(offset, length);
+    offset += length;
+    if (_notify)
+      _notify();
+  }
+}
+
+bool PagedFile::isIndexed() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _indexed == _file->size();
+}
+
+int PagedFile::getProgress() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _file->size() ? (int)(_indexed * 100 / _file->size()) : 100;
+}
+
+uint64_t PagedFile::lineCount() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _lines;
+}
+
+bool PagedFile::offsetOfLine(uint64_t line, uint64_t &offset) const {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (line >= _lines || line / STRIDE >= _checkpoints.size())
+      return false;
+    offset = _checkpoints[line / STRIDE];
+  }
+  for (uint64_t i = line % STRIDE; i > 0; i--)
+    offset = nextLine(offset);
+  return true;
+}
+
+bool PagedFile::lineOfOffset(uint64_t offset, uint64_t &line) const {
+  uint64_t start = lineStart(offset);
+  uint64_t checkpoint;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (start >= _indexed && _indexed != _file->size())
+      return false;
+    auto it = std::upper_bound(_checkpoints.begin(), _checkpoints.end(), start);
+    size_t index = it - _checkpoints.begin() - 1;
+    line = index * STRIDE;
+    checkpoint = _checkpoints[index];
+  }
+  line += std::count(data() + checkpoint, data() + start, '\n');
+  return true;
+}
+
+uint64_t PagedFile::lineStart(uint64_t offset) const {
+  const char *base = data();
+  while (offset > 0 && base[offset - 1] != '\n')
+    offset--;
+  return offset;
+}
+
+uint64_t PagedFile::nextLine(uint64_t offset) const {
+  uint64_t size = byteSize();
+  if (offset >= size)
+    return size;
+  const char *found =
+      static_cast<const char *>(memchr(data() + offset, '\n', size - offset));
+  return found ? found - data() + 1 : size;
+}
+
+uint64_t PagedFile::previousLine(uint64_t offset) const {
+  if (offset == 0)
+    return 0;
+  return lineStart(offset - 1);
+}
+
+uint64_t PagedFile::find(const std::string &needle, uint64_t from) const {
+  uint64_t size = byteSize();
+  if (!needle.length() || from >= size)
+    return size;
+  const char *end = data() + size;
+  const char *found =
+      std::search(data() + from, end,
+                  std::boyer_moore_horspool_searcher<std::string::const_iterator>(
+                      needle.begin(), needle.end()));
+  return found - data();
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "mapped_file.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+/*
+  Read-only access to a file too large to index every line of.
+  A worker thread records where every STRIDE-th line starts, any line is
+  then found by scanning at most STRIDE lines from the checkpoint before it.
+  The index costs 8 bytes per STRIDE lines and pages the worker is done with
+  are dropped from memory again, so the footprint stays bounded no matter
+  how large the file is.
+*/
+class PagedFile {
+  std::shared_ptr<MappedFile> _file;
+  std::string _path;
+  std::function<void()> _notify;
+  std::thread _thread;
+  std::atomic<bool> _cancel{false};
+
+  mutable std::mutex _mutex;
+  std::vector<uint64_t> _checkpoints;
+  uint64_t _indexed = 0;
+  uint64_t _lines = 1;
+
+  PagedFile() = default;
+
+public:
+  static const uint64_t STRIDE = 4096;
+
+  PagedFile(const PagedFile &) = delete;
+  PagedFile &operator=(const PagedFile &) = delete;
+  ~PagedFile();
+
+  // notify is called from the worker while the index grows
+  static std::shared_ptr<PagedFile> open(const std::string &path,
+                                         std::function<void()> notify);
+
+  const std::string &getPath() const { return _path; }
+  const char *data() const { return _file->data(); }
+  uint64_t byteSize() const { return _file->size(); }
+  bool isIndexed() const;
+  int getProgress() const;
+  // lines seen so far, the total once isIndexed()
+  uint64_t lineCount() const;
+
+  // Both return false if the index doesn't reach that far yet.
+  bool offsetOfLine(uint64_t line, uint64_t &offset) const;
+  bool lineOfOffset(uint64_t offset, uint64_t &line) const;
+
+  // start of the line offset falls in
+  uint64_t lineStart(uint64_t offset) const;
+  // start of the line after the one at offset, byteSize() for the last one
+  uint64_t nextLine(uint64_t offset) const;
+  // start of the line before the one starting at offset
+  uint64_t previousLine(uint64_t offset) const;
+  // first occurrence of needle in [from, byteSize()), byteSize() if none
+  uint64_t find(const std::string &needle, uint64_t from) const;
+
+private:
+  void run();
+};
@@ -0,0 +1,119 @@
+#include "project_grep.h"
+#include "buffer_search.h"
+#include "mapped_file.h"
+#include "project_walker.h"
+
+// a search stops once it found this many
+static const size_t MAX_MATCHES = 256 * 1024;
+
+ProjectGrep::ProjectGrep(const std::string &root, const std::u16string &term,
+                         SearchOptions options, std::function<void()> notify)
+    : _root(root), _notify(std::move(notify)) {
+  size_t threads = prepare(term, options);
+  _thread = std::thread([this, threads] {
+    ProjectWalker::walk(_root, threads, _cancel,
+                        [this](size_t thread, const std::string &path,
+                               const std::string &relative) {
+                          search(thread, path, relative);
+                        });
+    finish();
+  });
+}
+
+ProjectGrep::ProjectGrep(const std::string &root,
+                         std::vector<std::string> files,
+                         const std::u16string &term, SearchOptions options,
+                         std::function<void()> notify)
+    : _root(root), _list(std::move(files)), _notify(std::move(notify)) {
+  size_t threads = prepare(term, options);
+  _thread = std::thread([this, threads] {
+    std::vector<std::thread> helpers;
+    for (size_t thread = 1; thread < threads; thread++)
+      helpers.emplace_back(&ProjectGrep::searchList, this, thread);
+    searchList(0);
+    for (auto &helper : helpers)
+      helper.join();
+    finish();
+  });
+}
+
+size_t ProjectGrep::prepare(const std::u16string &term,
+                            SearchOptions options) {
+  size_t threads = std::thread::hardware_concurrency();
+  if (!threads)
+    threads = 1;
+  // the DFA cache of a regex is not shared between threads
+  _scanners.reserve(threads);
+  _scanners.emplace_back(term, options);
+  while (_scanners.size() < threads)
+    _scanners.push_back(_scanners[0]);
+  return threads;
+}
+
+void ProjectGrep::finish() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _done = true;
+  }
+  if (_notify)
+    _notify();
+}
+
+void ProjectGrep::searchList(size_t thread) {
+  for (size_t index = _next++; index < _list.size() && !_cancel;
+       index = _next++)
+    search(thread, _root + "/" + _list[index], _list[index]);
+}
+
+ProjectGrep::~ProjectGrep() {
+  _cancel = true;
+  _thread.join();
+}
+
+bool ProjectGrep::isFull() const { return _matches > MAX_MATCHES; }
+
+void ProjectGrep::search(size_t thread, const std::string &path,
+                         const std::string &relative) {
+  auto file = MappedFile::open(path);
+  if (!file || !file->size())
+    return;
+  _files++;
+  if (FileScanner::isBinary(file->data(), file->size())) {
+    _binary++;
+    return;
+  }
+  std::vector<GrepMatch> found;
+  _scanners[thread].scan(
+      file->data(), file->size(),
+      [&](size_t line, const std::u16string &text, size_t column,
+          size_t length) {
+        if (_matches++ >= MAX_MATCHES) {
+          _cancel = true;
+          return false;
+        }
+        found.push_back(
+            {relative, line, column, length, matchPreview(text, column)});
+        return true;
+      },
+      &_cancel);
+  if (found.empty())
+    return;
+  bool wasEmpty;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    wasEmpty = _found.empty();
+    _found.insert(_found.end(), std::make_move_iterator(found.begin()),
+                  std::make_move_iterator(found.end()));
+  }
+  // once is enough until take() picked them up
+  if (wasEmpty && _notify)
+    _notify();
+}
+
+bool ProjectGrep::take(std::vector<GrepMatch> &out) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  out.insert(out.end(), std::make_move_iterator(_found.begin()),
+             std::make_move_iterator(_found.end()));
+  _found.clear();
+  return _done;
+}
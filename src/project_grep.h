@@ -0,0 +1,71 @@
+#pragma once
+#include "file_scanner.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct GrepMatch {
+  // below the directory searched, separated by '/'
+  std::string path;
+  size_t line;
+  size_t column;
+  size_t length;
+  // the line around the match, cut to a few dozen characters
+  std::u16string preview;
+};
+
+/*
+  Searches every file below a directory on threads of its own. A
+  ProjectWalker lists the files and the thread that found one maps it and
+  runs a FileScanner over it, files that look binary are skipped. Results
+  come in file by file in no particular order, take() picks up what was
+  found since the last call. Given a list of files, as a TrigramIndex
+  narrows it down, only those are searched and nothing is walked.
+  Destroying the search cancels it and waits for its threads, which stop
+  at their next check.
+*/
+class ProjectGrep {
+  std::string _root;
+  std::vector<FileScanner> _scanners;
+  std::vector<std::string> _list;
+  std::atomic<size_t> _next{0};
+  std::atomic<bool> _cancel{false};
+  std::atomic<size_t> _files{0};
+  std::atomic<size_t> _binary{0};
+  std::atomic<size_t> _matches{0};
+  std::function<void()> _notify;
+  std::mutex _mutex;
+  std::vector<GrepMatch> _found;
+  bool _done = false;
+  std::thread _thread;
+
+public:
+  // the term has to be valid and a single line, see FileScanner
+  ProjectGrep(const std::string &root, const std::u16string &term,
+              SearchOptions options, std::function<void()> notify);
+  // searches files, paths below root
+  ProjectGrep(const std::string &root, std::vector<std::string> files,
+              const std::u16string &term, SearchOptions options,
+              std::function<void()> notify);
+  ProjectGrep(const ProjectGrep &) = delete;
+  ProjectGrep &operator=(const ProjectGrep &) = delete;
+  ~ProjectGrep();
+
+  // Appends what was found since the last call, true once all is there.
+  bool take(std::vector<GrepMatch> &out);
+  const std::string &root() const { return _root; }
+  size_t filesSearched() const { return _files; }
+  size_t binaryFiles() const { return _binary; }
+  // too many matches to keep, the search stopped early
+  bool isFull() const;
+
+private:
+  size_t prepare(const std::u16string &term, SearchOptions options);
+  void finish();
+  void searchList(size_t thread);
+  void search(size_t thread, const std::string &path,
+              const std::string &relative);
+};
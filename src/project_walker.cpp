@@ -0,0 +1,135 @@
+#include "project_walker.h"
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Directory {
+  std::string path;
+  // below the root, "" or ending in '/'
+  std::string relative;
+  std::shared_ptr<const IgnoreRules> rules;
+};
+
+struct Queue {
+  std::mutex mutex;
+  std::deque<Directory> directories;
+};
+
+struct Walk {
+  std::vector<Queue> queues;
+  // directories queued or being listed, the walk ends when none are left
+  std::atomic<size_t> pending{0};
+  const std::atomic<bool> &cancel;
+  const ProjectWalker::FileCallback &fn;
+
+  Walk(size_t threads, const std::atomic<bool> &cancel,
+       const ProjectWalker::FileCallback &fn)
+      : queues(threads), cancel(cancel), fn(fn) {}
+
+  void push(size_t thread, Directory directory) {
+    pending++;
+    std::lock_guard<std::mutex> lock(queues[thread].mutex);
+    queues[thread].directories.push_back(std::move(directory));
+  }
+
+  bool pop(size_t thread, Directory &out) {
+    {
+      Queue &own = queues[thread];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (own.directories.size()) {
+        out = std::move(own.directories.back());
+        own.directories.pop_back();
+        return true;
+      }
+    }
+    for (size_t i = 1; i < queues.size(); i++) {
+      Queue &other = queues[(thread + i) % queues.size()];
+      std::lock_guard<std::mutex> lock(other.mutex);
+      if (other.directories.size()) {
+        out = std::move(other.directories.front());
+        other.directories.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void run(size_t thread) {
+    Directory directory;
+    while (!cancel) {
+      if (pop(thread, directory)) {
+        list(thread, directory);
+        pending--;
+      } else if (!pending) {
+        return;
+      } else {
+        // another thread is still listing and may queue more
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+    }
+  }
+
+  void list(size_t thread, const Directory &directory) {
+    struct Entry {
+      std::string name;
+      bool isDirectory;
+    };
+    std::vector<Entry> entries;
+    bool hasIgnore = false;
+    std::error_code error;
+    std::filesystem::directory_iterator it(directory.path, error), end;
+    for (; !error && it != end; it.increment(error)) {
+      // the type comes from the listing itself, nothing is stat'ed here
+      std::error_code typeError;
+      if (it->is_symlink(typeError))
+        continue;
+      bool isDirectory = it->is_directory(typeError);
+      if (!isDirectory && !it->is_regular_file(typeError))
+        continue;
+      std::string name = it->path().filename().string();
+      if (isDirectory && name == ".git")
+        continue;
+      hasIgnore |= !isDirectory && name == ".gitignore";
+      entries.push_back({std::move(name), isDirectory});
+    }
+    auto rules = directory.rules;
+    if (hasIgnore)
+      rules = IgnoreRules::load(rules, directory.path, directory.relative);
+    for (auto &entry : entries) {
+      if (cancel)
+        return;
+      std::string relative = directory.relative + entry.name;
+      if (rules && rules->isIgnored(relative, entry.isDirectory))
+        continue;
+      std::string path = directory.path + "/" + entry.name;
+      if (entry.isDirectory)
+        push(thread, {std::move(path), relative + "/", rules});
+      else
+        fn(thread, path, relative);
+    }
+  }
+};
+
+} // namespace
+
+void ProjectWalker::walk(const std::string &root, size_t threads,
+                         const std::atomic<bool> &cancel,
+                         const FileCallback &fn) {
+  if (!threads)
+    threads = std::thread::hardware_concurrency();
+  if (!threads)
+    threads = 1;
+  Walk walk(threads, cancel, fn);
+  walk.push(0, {root, "", nullptr});
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < threads; i++)
+    workers.emplace_back(&Walk::run, &walk, i);
+  walk.run(0);
+  for (auto &worker : workers)
+    worker.join();
+}
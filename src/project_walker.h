@@ -0,0 +1,27 @@
+#pragma once
+#include "ignore_rules.h"
+#include <atomic>
+#include <functional>
+#include <string>
+
+/*
+  Walks a directory tree on several threads at once. Every thread keeps a
+  queue of directories of its own: it lists the newest one next, which keeps
+  it close to what it just read, and once its queue runs dry it steals the
+  oldest directory of another thread, which tends to be the largest part of
+  the tree left. Files go to the callback on the thread that listed them.
+  Files and directories matched by a .gitignore are left out, so are `.git`
+  directories and symbolic links, which could lead in circles.
+*/
+class ProjectWalker {
+public:
+  // fn(thread, path, relative) for every file, relative is the path below
+  // the root separated by '/', thread the index of the calling thread
+  using FileCallback = std::function<void(size_t, const std::string &,
+                                          const std::string &)>;
+
+  // Returns once the whole tree was walked or cancel was set, threads is
+  // one per core when 0.
+  static void walk(const std::string &root, size_t threads,
+                   const std::atomic<bool> &cancel, const FileCallback &fn);
+};
@@ -0,0 +1,1281 @@
+#include "regex_search.h"
+#include <algorithm>
+#include <unordered_map>
+
+static const size_t NOT_FOUND = std::u16string::npos;
+// limits keeping a pattern from compiling into something unreasonable
+static const int MAX_REPEAT = 1000;
+static const int MAX_DEPTH = 256;
+static const size_t MAX_INSTRUCTIONS = 100000;
+// memory the cached DFA states of one search may take
+static const size_t DFA_BUDGET = 8 * 1024 * 1024;
+// a DFA that has to be flushed before it scanned this many characters per
+// state it built gives up on the line
+static const size_t MIN_PROGRESS = 10;
+// transitions not computed yet and the one taken when a match completed
+static const int32_t UNKNOWN = -1;
+static const int32_t MATCHED = -2;
+static const uint32_t NO_SLOT = UINT32_MAX;
+
+namespace {
+
+typedef std::vector<std::pair<char16_t, char16_t>> Ranges;
+
+enum Assertion : uint32_t {
+  BEGIN_LINE,
+  END_LINE,
+  WORD_BOUNDARY,
+  NOT_WORD_BOUNDARY,
+  // the whole word option, the sides of a match have to be non word
+  NO_WORD_BEFORE,
+  NO_WORD_AFTER
+};
+
+// The context a position is in besides the character following it, a DFA
+// stops starting new matches once it saw one.
+enum Flags : uint8_t { AT_START = 1, PREV_WORD = 2, NO_RESTART = 4 };
+
+struct Node {
+  enum Kind {
+    EMPTY,
+    LITERAL,
+    CLASS,
+    ANY,
+    CONCAT,
+    ALTERNATE,
+    REPEAT,
+    GROUP,
+    ASSERT
+  } kind = EMPTY;
+  char16_t c = 0;
+  // the class, group or assertion
+  int index = 0;
+  // REPEAT bounds, max is -1 when unbounded
+  int min = 0;
+  int max = 0;
+  bool greedy = true;
+  std::vector<int> children;
+};
+
+void normalize(Ranges &ranges) {
+  std::sort(ranges.begin(), ranges.end());
+  Ranges merged;
+  for (auto &range : ranges) {
+    if (merged.size() && (int)range.first <= (int)merged.back().second + 1)
+      merged.back().second = std::max(merged.back().second, range.second);
+    else
+      merged.push_back(range);
+  }
+  ranges.swap(merged);
+}
+
+Ranges complement(const Ranges &ranges) {
+  Ranges result;
+  int next = 0;
+  for (auto &range : ranges) {
+    if (range.first > next)
+      result.emplace_back(next, range.first - 1);
+    next = range.second + 1;
+  }
+  if (next <= 0xFFFF)
+    result.emplace_back(next, 0xFFFF);
+  return result;
+}
+
+// the ranges of \d \w \s and their upper case negations
+void predefined(char16_t name, Ranges &out) {
+  Ranges ranges;
+  switch (name) {
+  case 'd':
+  case 'D':
+    ranges = {{'0', '9'}};
+    break;
+  case 'w':
+  case 'W':
+    // what TextSearch::isWordChar accepts, so that \w and \b agree
+    ranges = {{'0', '9'},   {'A', 'Z'},   {'_', '_'},     {'a', 'z'},
+              {0xC0, 0xD6}, {0xD8, 0xF6}, {0xF8, 0xFFFF}};
+    break;
+  default:
+    ranges = {{'\t', '\r'}, {' ', ' '}, {0xA0, 0xA0}};
+  }
+  if (name == 'D' || name == 'W' || name == 'S')
+    ranges = complement(ranges);
+  out.insert(out.end(), ranges.begin(), ranges.end());
+}
+
+bool isPredefined(char16_t c) {
+  return c == 'd' || c == 'D' || c == 'w' || c == 'W' || c == 's' ||
+         c == 'S';
+}
+
+int hexValue(char16_t c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+class Parser {
+  const std::u16string &_pattern;
+  bool _ignoreCase;
+  size_t _at = 0;
+  int _depth = 0;
+
+public:
+  std::vector<Node> nodes;
+  std::vector<Ranges> classes;
+  // classes written as [^...], complemented only after folding their
+  // members so that [^a] never matches A when ignoring case
+  std::vector<bool> negated;
+  size_t groups = 0;
+  std::u16string error;
+
+  Parser(const std::u16string &pattern, bool ignoreCase)
+      : _pattern(pattern), _ignoreCase(ignoreCase) {}
+
+  int parse() {
+    int root = alternation();
+    if (root >= 0 && more())
+      return fail(u"unmatched )");
+    return root;
+  }
+
+private:
+  bool more() const { return _at < _pattern.length(); }
+  char16_t peek() const { return _pattern[_at]; }
+  int fail(const std::u16string &message) {
+    if (error.empty())
+      error = message;
+    return -1;
+  }
+  int add(Node node) {
+    nodes.push_back(std::move(node));
+    return nodes.size() - 1;
+  }
+  int literal(char16_t c) {
+    Node node;
+    node.kind = Node::LITERAL;
+    node.c = _ignoreCase ? TextSearch::fold(c) : c;
+    return add(std::move(node));
+  }
+  int node(Node::Kind kind, int index) {
+    Node node;
+    node.kind = kind;
+    node.index = index;
+    return add(std::move(node));
+  }
+
+  int alternation() {
+    if (++_depth > MAX_DEPTH)
+      return fail(u"groups nested too deeply");
+    Node node;
+    node.kind = Node::ALTERNATE;
+    while (true) {
+      int branch = concat();
+      if (branch < 0)
+        return -1;
+      node.children.push_back(branch);
+      if (!more() || peek() != '|')
+        break;
+      _at++;
+    }
+    _depth--;
+    if (node.children.size() == 1)
+      return node.children[0];
+    return add(std::move(node));
+  }
+
+  int concat() {
+    Node node;
+    node.kind = Node::CONCAT;
+    while (more() && peek() != '|' && peek() != ')') {
+      int item = repeat();
+      if (item < 0)
+        return -1;
+      node.children.push_back(item);
+    }
+    if (node.children.empty())
+      return add(Node());
+    if (node.children.size() == 1)
+      return node.children[0];
+    return add(std::move(node));
+  }
+
+  bool isQuantifier() {
+    if (!more())
+      return false;
+    char16_t c = peek();
+    if (c == '*' || c == '+' || c == '?')
+      return true;
+    int min, max;
+    size_t at = _at;
+    bool result = c == '{' && bounds(min, max);
+    _at = at;
+    return result;
+  }
+
+  int repeat() {
+    int item = atom();
+    if (item < 0 || !more())
+      return item;
+    Node node;
+    node.kind = Node::REPEAT;
+    char16_t c = peek();
+    if (c == '*' || c == '+' || c == '?') {
+      node.min = c == '+' ? 1 : 0;
+      node.max = c == '?' ? 1 : -1;
+      _at++;
+    } else if (c != '{' || !bounds(node.min, node.max)) {
+      return item;
+    }
+    if (!error.empty())
+      return -1;
+    if (more() && peek() == '?') {
+      node.greedy = false;
+      _at++;
+    }
+    if (isQuantifier())
+      return fail(u"nothing to repeat");
+    node.children.push_back(item);
+    return add(std::move(node));
+  }
+
+  // {n}, {n,} or {n,m} at the cursor, false and the cursor left where it is
+  // if it is none of them
+  bool bounds(int &min, int &max) {
+    size_t at = _at + 1;
+    auto number = [&](int &value) {
+      size_t start = at;
+      value = 0;
+      while (at < _pattern.length() && _pattern[at] >= '0' &&
+             _pattern[at] <= '9') {
+        value = std::min(value * 10 + (_pattern[at] - '0'), MAX_REPEAT + 1);
+        at++;
+      }
+      return at > start;
+    };
+    if (!number(min))
+      return false;
+    max = min;
+    if (at < _pattern.length() && _pattern[at] == ',') {
+      at++;
+      if (!number(max))
+        max = -1;
+    }
+    if (at >= _pattern.length() || _pattern[at] != '}')
+      return false;
+    _at = at + 1;
+    if (min > MAX_REPEAT || max > MAX_REPEAT)
+      fail(u"repeat count above 1000");
+    else if (max != -1 && max < min)
+      fail(u"bad repeat range");
+    return true;
+  }
+
+  int atom() {
+    char16_t c = _pattern[_at++];
+    switch (c) {
+    case '(': {
+      bool capture = true;
+      if (more() && peek() == '?') {
+        if (_at + 1 >= _pattern.length() || _pattern[_at + 1] != ':')
+          return fail(u"unsupported group");
+        capture = false;
+        _at += 2;
+      }
+      int group = capture ? ++groups : 0;
+      int inner = alternation();
+      if (inner < 0)
+        return -1;
+      if (!more() || peek() != ')')
+        return fail(u"missing )");
+      _at++;
+      if (!capture)
+        return inner;
+      Node node;
+      node.kind = Node::GROUP;
+      node.index = group;
+      node.children.push_back(inner);
+      return add(std::move(node));
+    }
+    case '*':
+    case '+':
+    case '?':
+      return fail(u"nothing to repeat");
+    case '.':
+      return node(Node::ANY, 0);
+    case '^':
+      return node(Node::ASSERT, BEGIN_LINE);
+    case '$':
+      return node(Node::ASSERT, END_LINE);
+    case '[': {
+      Ranges ranges;
+      bool negate = more() && peek() == '^';
+      if (negate)
+        _at++;
+      if (!characterClass(ranges))
+        return -1;
+      classes.push_back(std::move(ranges));
+      negated.push_back(negate);
+      return node(Node::CLASS, classes.size() - 1);
+    }
+    case '\\': {
+      if (!more())
+        return fail(u"trailing \\");
+      char16_t name = _pattern[_at++];
+      if (name == 'b' || name == 'B')
+        return node(Node::ASSERT,
+                    name == 'b' ? WORD_BOUNDARY : NOT_WORD_BOUNDARY);
+      if (isPredefined(name)) {
+        Ranges ranges;
+        predefined(name, ranges);
+        classes.push_back(std::move(ranges));
+        negated.push_back(false);
+        return node(Node::CLASS, classes.size() - 1);
+      }
+      char16_t value;
+      if (!escaped(name, value))
+        return -1;
+      return literal(value);
+    }
+    default:
+      return literal(c);
+    }
+  }
+
+  // the character an escape other than a class stands for
+  bool escaped(char16_t name, char16_t &value) {
+    switch (name) {
+    case 't':
+      value = '\t';
+      return true;
+    case 'n':
+      value = '\n';
+      return true;
+    case 'r':
+      value = '\r';
+      return true;
+    case 'f':
+      value = '\f';
+      return true;
+    case 'v':
+      value = '\v';
+      return true;
+    case '0':
+      value = 0;
+      return true;
+    case 'x':
+    case 'u': {
+      size_t digits = name == 'x' ? 2 : 4;
+      value = 0;
+      for (size_t i = 0; i < digits; i++) {
+        int digit = more() ? hexValue(peek()) : -1;
+        if (digit < 0) {
+          fail(name == 'x' ? u"\\x needs 2 hex digits"
+                           : u"\\u needs 4 hex digits");
+          return false;
+        }
+        value = value * 16 + digit;
+        _at++;
+      }
+      return true;
+    }
+    }
+    if ((name >= 'a' && name <= 'z') || (name >= 'A' && name <= 'Z') ||
+        (name >= '0' && name <= '9')) {
+      fail(u"unknown escape \\" + std::u16string(1, name));
+      return false;
+    }
+    value = name;
+    return true;
+  }
+
+  // the members of [...] or [^...] up to the closing bracket
+  bool characterClass(Ranges &ranges) {
+    bool first = true;
+    while (true) {
+      if (!more()) {
+        fail(u"missing ]");
+        return false;
+      }
+      char16_t c = _pattern[_at++];
+      if (c == ']' && !first)
+        break;
+      first = false;
+      char16_t low = c;
+      if (c == '\\') {
+        if (!more()) {
+          fail(u"trailing \\");
+          return false;
+        }
+        char16_t name = _pattern[_at++];
+        if (isPredefined(name)) {
+          predefined(name, ranges);
+          continue;
+        }
+        if (!escaped(name, low))
+          return false;
+      }
+      char16_t high = low;
+      if (_at + 1 < _pattern.length() && peek() == '-' &&
+          _pattern[_at + 1] != ']') {
+        _at++;
+        high = _pattern[_at++];
+        if (high == '\\') {
+          if (!more()) {
+            fail(u"trailing \\");
+            return false;
+          }
+          if (!escaped(_pattern[_at++], high))
+            return false;
+        }
+        if (high < low) {
+          fail(u"bad class range");
+          return false;
+        }
+      }
+      ranges.emplace_back(low, high);
+    }
+    normalize(ranges);
+    return true;
+  }
+};
+
+// Literal text every match of node starts with appended to prefix, true if
+// that is all of the node so that what follows it may extend the prefix.
+bool extractPrefix(const std::vector<Node> &nodes, int index,
+                   std::u16string &prefix) {
+  const Node &node = nodes[index];
+  switch (node.kind) {
+  case Node::EMPTY:
+  case Node::ASSERT:
+    return true;
+  case Node::LITERAL:
+    prefix += node.c;
+    return true;
+  case Node::GROUP:
+    return extractPrefix(nodes, node.children[0], prefix);
+  case Node::CONCAT:
+    for (int child : node.children) {
+      if (!extractPrefix(nodes, child, prefix))
+        return false;
+    }
+    return true;
+  case Node::REPEAT:
+    if (node.min > 0)
+      extractPrefix(nodes, node.children[0], prefix);
+    return false;
+  default:
+    return false;
+  }
+}
+
+} // namespace
+
+struct RegexSearch::Program {
+  struct Inst {
+    enum Op : uint8_t { CHAR, CLASS, ANY, SPLIT, JUMP, SAVE, ASSERT, MATCH };
+    Op op;
+    char16_t c;
+    // CLASS: the class, SPLIT and JUMP: the preferred target,
+    // SAVE: the slot, ASSERT: what is asserted
+    uint32_t x;
+    // SPLIT: the other target
+    uint32_t y;
+  };
+  typedef std::vector<Inst> Insts;
+
+  Insts insts;
+  // the pattern read from its end, matched right to left by the reverse DFA
+  Insts reverse;
+  std::vector<Ranges> classes;
+  bool ignoreCase = false;
+  size_t groups = 0;
+  size_t slots = 2;
+  bool usesWord = false;
+  // no match can start after the first character of a line
+  bool anchored = false;
+  // literal text every match starts with
+  std::u16string prefix;
+  // character class of every UTF-16 unit, folded first when ignoring case
+  std::vector<uint16_t> classOf;
+  // a member of every class and whether it is a word character
+  std::vector<char16_t> representative;
+  std::vector<uint8_t> isWord;
+
+  bool compile(const std::vector<Node> &nodes, int index, Insts &out,
+               bool reversed);
+  bool buildClasses();
+
+  bool matches(const Inst &inst, char16_t c) const {
+    switch (inst.op) {
+    case Inst::CHAR:
+      return inst.c == c;
+    case Inst::ANY:
+      return true;
+    default: {
+      const Ranges &ranges = classes[inst.x];
+      auto it = std::lower_bound(
+          ranges.begin(), ranges.end(), c,
+          [](const std::pair<char16_t, char16_t> &range, char16_t c) {
+            return range.second < c;
+          });
+      return it != ranges.end() && it->first <= c;
+    }
+    }
+  }
+
+  static bool holds(uint32_t assertion, uint8_t flags, bool nextWord,
+                    bool atEnd) {
+    bool prevWord = flags & PREV_WORD;
+    switch (assertion) {
+    case BEGIN_LINE:
+      return flags & AT_START;
+    case END_LINE:
+      return atEnd;
+    case WORD_BOUNDARY:
+      return prevWord != nextWord;
+    case NOT_WORD_BOUNDARY:
+      return prevWord == nextWord;
+    case NO_WORD_BEFORE:
+      return !prevWord;
+    default:
+      return !nextWord;
+    }
+  }
+
+  // Follows the instructions of insts reachable from seeds without
+  // consuming a character, collecting the ones that consume one in priority
+  // order. True once a MATCH is reached, with firstOnly nothing of a lower
+  // priority than it is followed.
+  static bool closure(const Insts &insts, const std::vector<uint32_t> &seeds,
+                      uint8_t flags, bool nextWord, bool atEnd,
+                      bool firstOnly, std::vector<uint32_t> &consuming) {
+    std::vector<uint8_t> seen(insts.size());
+    std::vector<uint32_t> stack(seeds.rbegin(), seeds.rend());
+    consuming.clear();
+    bool matched = false;
+    while (stack.size()) {
+      uint32_t pc = stack.back();
+      stack.pop_back();
+      if (seen[pc])
+        continue;
+      seen[pc] = 1;
+      const Inst &inst = insts[pc];
+      switch (inst.op) {
+      case Inst::MATCH:
+        if (firstOnly)
+          return true;
+        matched = true;
+        break;
+      case Inst::SPLIT:
+        stack.push_back(inst.y);
+        stack.push_back(inst.x);
+        break;
+      case Inst::JUMP:
+        stack.push_back(inst.x);
+        break;
+      case Inst::SAVE:
+        stack.push_back(pc + 1);
+        break;
+      case Inst::ASSERT:
+        if (holds(inst.x, flags, nextWord, atEnd))
+          stack.push_back(pc + 1);
+        break;
+      default:
+        consuming.push_back(pc);
+      }
+    }
+    return matched;
+  }
+};
+
+bool RegexSearch::Program::compile(const std::vector<Node> &nodes, int index,
+                                   Insts &out, bool reversed) {
+  if (out.size() > MAX_INSTRUCTIONS)
+    return false;
+  const Node &node = nodes[index];
+  switch (node.kind) {
+  case Node::EMPTY:
+    return true;
+  case Node::LITERAL:
+    out.push_back({Inst::CHAR, node.c, 0, 0});
+    return true;
+  case Node::CLASS:
+    out.push_back({Inst::CLASS, 0, (uint32_t)node.index, 0});
+    return true;
+  case Node::ANY:
+    out.push_back({Inst::ANY, 0, 0, 0});
+    return true;
+  case Node::ASSERT: {
+    // read backwards what comes before a position comes after it
+    static const uint32_t mirrored[] = {END_LINE,          BEGIN_LINE,
+                                        WORD_BOUNDARY,     NOT_WORD_BOUNDARY,
+                                        NO_WORD_AFTER,     NO_WORD_BEFORE};
+    uint32_t assertion = reversed ? mirrored[node.index] : node.index;
+    out.push_back({Inst::ASSERT, 0, assertion, 0});
+    return true;
+  }
+  case Node::GROUP:
+    // only the forward program reports groups
+    if (!reversed)
+      out.push_back({Inst::SAVE, 0, (uint32_t)node.index * 2, 0});
+    if (!compile(nodes, node.children[0], out, reversed))
+      return false;
+    if (!reversed)
+      out.push_back({Inst::SAVE, 0, (uint32_t)node.index * 2 + 1, 0});
+    return true;
+  case Node::CONCAT:
+    for (size_t i = 0; i < node.children.size(); i++) {
+      size_t child = reversed ? node.children.size() - 1 - i : i;
+      if (!compile(nodes, node.children[child], out, reversed))
+        return false;
+    }
+    return true;
+  case Node::ALTERNATE: {
+    // every branch but the last is tried first and jumps past the others
+    std::vector<size_t> exits;
+    for (size_t i = 0; i + 1 < node.children.size(); i++) {
+      size_t split = out.size();
+      out.push_back({Inst::SPLIT, 0, (uint32_t)split + 1, 0});
+      if (!compile(nodes, node.children[i], out, reversed))
+        return false;
+      exits.push_back(out.size());
+      out.push_back({Inst::JUMP, 0, 0, 0});
+      out[split].y = out.size();
+    }
+    if (!compile(nodes, node.children.back(), out, reversed))
+      return false;
+    for (size_t exit : exits)
+      out[exit].x = out.size();
+    return true;
+  }
+  case Node::REPEAT: {
+    int child = node.children[0];
+    for (int i = 0; i < node.min; i++) {
+      if (!compile(nodes, child, out, reversed))
+        return false;
+    }
+    // the preferred branch of a split enters the body unless it is lazy
+    auto branch = [&](size_t split, size_t exit) {
+      uint32_t body = split + 1;
+      out[split].x = node.greedy ? body : exit;
+      out[split].y = node.greedy ? exit : body;
+    };
+    if (node.max == -1) {
+      size_t loop = out.size();
+      out.push_back({Inst::SPLIT, 0, 0, 0});
+      if (!compile(nodes, child, out, reversed))
+        return false;
+      out.push_back({Inst::JUMP, 0, (uint32_t)loop, 0});
+      branch(loop, out.size());
+      return true;
+    }
+    // x{0,3} as (x(x(x)?)?)?, every optional copy skips to the end
+    std::vector<size_t> splits;
+    for (int i = node.min; i < node.max; i++) {
+      splits.push_back(out.size());
+      out.push_back({Inst::SPLIT, 0, 0, 0});
+      if (!compile(nodes, child, out, reversed))
+        return false;
+    }
+    for (size_t split : splits)
+      branch(split, out.size());
+    return true;
+  }
+  }
+  return true;
+}
+
+// Splits the UTF-16 units into classes no instruction tells apart, so the
+// DFA needs a transition per class instead of one per unit.
+bool RegexSearch::Program::buildClasses() {
+  std::vector<uint32_t> id(0x10000, 0);
+  uint32_t count = 1;
+  auto refine = [&](const Ranges &set) {
+    std::vector<uint32_t> split(count, UINT32_MAX);
+    for (auto &range : set) {
+      for (uint32_t c = range.first; c <= range.second; c++) {
+        uint32_t &target = split[id[c]];
+        if (target == UINT32_MAX)
+          target = count++;
+        id[c] = target;
+      }
+    }
+  };
+  std::vector<char16_t> literals;
+  for (auto &inst : insts) {
+    if (inst.op == Inst::CHAR)
+      literals.push_back(inst.c);
+  }
+  std::sort(literals.begin(), literals.end());
+  literals.erase(std::unique(literals.begin(), literals.end()),
+                 literals.end());
+  for (char16_t c : literals)
+    id[c] = count++;
+  for (auto &ranges : classes)
+    refine(ranges);
+  if (usesWord) {
+    Ranges word;
+    predefined('w', word);
+    refine(word);
+  }
+  // number the classes in order of their first unit
+  std::vector<uint32_t> compact(count, UINT32_MAX);
+  std::vector<uint16_t> folded(0x10000);
+  for (uint32_t c = 0; c < 0x10000; c++) {
+    uint32_t &target = compact[id[c]];
+    if (target == UINT32_MAX) {
+      if (representative.size() > UINT16_MAX)
+        return false;
+      target = representative.size();
+      representative.push_back(c);
+      isWord.push_back(TextSearch::isWordChar(c));
+    }
+    folded[c] = target;
+  }
+  classOf.resize(0x10000);
+  for (uint32_t c = 0; c < 0x10000; c++)
+    classOf[c] = folded[ignoreCase ? TextSearch::fold(c) : c];
+  return true;
+}
+
+/*
+  A DFA whose states are sets of program instructions, built one transition
+  at a time as the text needs them. Forward it runs unanchored and stops
+  following a match's lower priority threads once it completed, so the last
+  match it sees ends the leftmost first match. Reverse it runs anchored at
+  that end and remembers the furthest a match reached, which is where the
+  leftmost match starts.
+*/
+class RegexSearch::Dfa {
+  struct State {
+    // instructions waiting for the next character, in priority order
+    // running forward and sorted running backwards
+    std::vector<uint32_t> kernel;
+    uint8_t flags;
+    // whether the end of the text completes a match, -1 while unknown
+    int8_t matchesAtEnd = -1;
+  };
+  struct KernelHash {
+    size_t operator()(const std::vector<uint32_t> &key) const {
+      size_t hash = key.size();
+      for (uint32_t value : key)
+        hash = hash * 31 + value;
+      return hash;
+    }
+  };
+  // Low bits of a transition, the row of the state it leads to is shifted
+  // above them. IDLE marks states without instructions in progress where
+  // the scan has something to do: stop, or skip ahead to the prefix.
+  enum Transition : int32_t { MATCH_BEFORE = 1, IDLE = 2, SHIFT = 2 };
+
+  const Program &_program;
+  const Program::Insts &_insts;
+  bool _reversed;
+  // whether states that only wait for a new match to start are IDLE
+  bool _skipsIdle;
+  // the transitions of every state a row after the other, a column per
+  // character class
+  std::vector<int32_t> _table;
+  size_t _stride;
+  std::vector<State> _states;
+  // kernel with the flags appended to state index
+  std::unordered_map<std::vector<uint32_t>, int32_t, KernelHash> _ids;
+  int32_t _starts[8];
+  size_t _memory = 0;
+
+public:
+  static const size_t GAVE_UP = NOT_FOUND - 1;
+
+  Dfa(const Program &program, bool reversed, bool skipsIdle)
+      : _program(program),
+        _insts(reversed ? program.reverse : program.insts),
+        _reversed(reversed), _skipsIdle(skipsIdle),
+        _stride(program.representative.size()) {
+    reset();
+  }
+
+  // End of the leftmost first match starting in [from, length), NOT_FOUND
+  // if there is none. Idle stretches are skipped to the next occurrence of
+  // prefix when there is one.
+  size_t forward(const char16_t *text, size_t length, size_t from,
+                 const TextSearch *prefix) {
+    auto contextAt = [&](size_t at) {
+      uint8_t flags = at == 0 ? AT_START : 0;
+      if (_program.usesWord && at > 0 && TextSearch::isWordChar(text[at - 1]))
+        flags |= PREV_WORD;
+      return flags;
+    };
+    const uint16_t *classOf = _program.classOf.data();
+    // states are named by their row in the table from here on
+    int32_t state = start(contextAt(from)) * _stride;
+    const int32_t *table = _table.data();
+    bool idle = _skipsIdle;
+    size_t end = NOT_FOUND;
+    size_t flushedAt = from;
+    for (size_t i = from;; i++) {
+      if (idle) {
+        // a match was seen and no thread that could replace it is left
+        if (_states[state / _stride].flags & NO_RESTART)
+          return end;
+        // nothing is in progress, only a new match could still start here
+        if (i > 0 && _program.anchored)
+          return NOT_FOUND;
+        if (prefix) {
+          size_t at = prefix->find(text, length, i);
+          if (at == NOT_FOUND)
+            return NOT_FOUND;
+          if (at > i) {
+            i = at;
+            state = start(contextAt(i)) * _stride;
+            table = _table.data();
+          }
+        }
+      }
+      if (i == length)
+        return matchesAtEnd(state / _stride) ? length : end;
+      uint16_t cls = classOf[text[i]];
+      int32_t next = table[state + cls];
+      if (next == UNKNOWN) {
+        bool flushed = false;
+        if (!advance(state, cls, i - flushedAt, next, flushed))
+          return GAVE_UP;
+        if (flushed)
+          flushedAt = i;
+        table = _table.data();
+      }
+      if (next & MATCH_BEFORE)
+        end = i;
+      idle = next & IDLE;
+      state = next >> SHIFT;
+    }
+  }
+
+  // Start of the longest match in [from, end) ending at end, NOT_FOUND if
+  // there is none.
+  size_t backward(const char16_t *text, size_t length, size_t end,
+                  size_t from) {
+    // the context of a position as seen coming from the end of the line
+    uint8_t flags = NO_RESTART | (end == length ? AT_START : 0);
+    if (_program.usesWord && end < length && TextSearch::isWordChar(text[end]))
+      flags |= PREV_WORD;
+    const uint16_t *classOf = _program.classOf.data();
+    int32_t state = start(flags) * _stride;
+    const int32_t *table = _table.data();
+    size_t begin = NOT_FOUND;
+    size_t flushedAt = end;
+    for (size_t i = end;; i--) {
+      if (i == 0)
+        return matchesAtEnd(state / _stride) ? 0 : begin;
+      uint16_t cls = classOf[text[i - 1]];
+      int32_t next = table[state + cls];
+      if (next == UNKNOWN) {
+        bool flushed = false;
+        if (!advance(state, cls, flushedAt - i, next, flushed))
+          return GAVE_UP;
+        if (flushed)
+          flushedAt = i;
+        table = _table.data();
+      }
+      if (next & MATCH_BEFORE)
+        begin = i;
+      if (i == from || next & IDLE)
+        return begin;
+      state = next >> SHIFT;
+    }
+  }
+
+private:
+  void reset() {
+    _table.clear();
+    _states.clear();
+    _ids.clear();
+    _memory = 0;
+    for (auto &state : _starts)
+      state = UNKNOWN;
+  }
+
+  // The transition of the state in row on cls into next, computed as it is
+  // not known yet. A full cache is flushed first, row is then moved into the
+  // fresh one and flushed set. False if the last flush was less than
+  // progress characters ago and that was too little for the states it built.
+  bool advance(int32_t &row, uint16_t cls, size_t progress, int32_t &next,
+               bool &flushed) {
+    int32_t state = row / _stride;
+    if (_memory > DFA_BUDGET) {
+      if (progress < MIN_PROGRESS * _states.size())
+        return false;
+      std::vector<uint32_t> kernel = _states[state].kernel;
+      uint8_t flags = _states[state].flags;
+      reset();
+      state = lookup(kernel, flags);
+      row = state * _stride;
+      flushed = true;
+    }
+    next = step(state, cls);
+    return true;
+  }
+
+  int32_t start(uint8_t flags) {
+    if (_starts[flags] == UNKNOWN) {
+      // running backwards the match is anchored at the end it was found at
+      std::vector<uint32_t> kernel;
+      if (_reversed)
+        kernel.push_back(0);
+      _starts[flags] = lookup(kernel, flags);
+    }
+    return _starts[flags];
+  }
+
+  int32_t lookup(std::vector<uint32_t> &kernel, uint8_t flags) {
+    kernel.push_back(flags);
+    auto it = _ids.find(kernel);
+    if (it != _ids.end()) {
+      kernel.pop_back();
+      return it->second;
+    }
+    int32_t id = _states.size();
+    _ids.emplace(kernel, id);
+    kernel.pop_back();
+    State state;
+    state.kernel = kernel;
+    state.flags = flags;
+    _states.push_back(std::move(state));
+    _table.resize(_table.size() + _stride, UNKNOWN);
+    _memory += sizeof(State) + 64 + kernel.size() * 2 * sizeof(uint32_t) +
+               _stride * sizeof(int32_t);
+    return id;
+  }
+
+  std::vector<uint32_t> seeds(const State &state) {
+    std::vector<uint32_t> seeds = state.kernel;
+    // until a match was seen every position may start one
+    if (!(state.flags & NO_RESTART))
+      seeds.push_back(0);
+    return seeds;
+  }
+
+  int32_t step(int32_t state, uint16_t cls) {
+    std::vector<uint32_t> consuming;
+    uint8_t flags = _states[state].flags;
+    bool matched =
+        Program::closure(_insts, seeds(_states[state]), flags,
+                         _program.isWord[cls], false, !_reversed, consuming);
+    char16_t c = _program.representative[cls];
+    std::vector<uint32_t> kernel;
+    for (uint32_t pc : consuming) {
+      if (_program.matches(_insts[pc], c))
+        kernel.push_back(pc + 1);
+    }
+    if (_reversed)
+      std::sort(kernel.begin(), kernel.end());
+    uint8_t next = flags & NO_RESTART;
+    if (matched)
+      next |= NO_RESTART;
+    if (_program.usesWord && _program.isWord[cls])
+      next |= PREV_WORD;
+    int32_t result = lookup(kernel, next) * _stride << SHIFT;
+    if (matched)
+      result |= MATCH_BEFORE;
+    if (kernel.empty() && (_skipsIdle || next & NO_RESTART))
+      result |= IDLE;
+    _table[state * _stride + cls] = result;
+    return result;
+  }
+
+  bool matchesAtEnd(int32_t state) {
+    State &current = _states[state];
+    if (current.matchesAtEnd < 0) {
+      std::vector<uint32_t> consuming;
+      current.matchesAtEnd =
+          Program::closure(_insts, seeds(current), current.flags, false, true,
+                           true, consuming);
+    }
+    return current.matchesAtEnd;
+  }
+};
+
+RegexSearch::RegexSearch(const std::u16string &pattern,
+                         SearchOptions options) {
+  Parser parser(pattern, options.ignoreCase);
+  int root = parser.parse();
+  if (root < 0) {
+    _error = parser.error;
+    return;
+  }
+  auto program = std::make_shared<Program>();
+  program->ignoreCase = options.ignoreCase;
+  program->groups = parser.groups;
+  program->slots = (parser.groups + 1) * 2;
+  program->classes = std::move(parser.classes);
+  for (size_t i = 0; i < program->classes.size(); i++) {
+    Ranges &ranges = program->classes[i];
+    // classes hold the folded forms of their members, like the literals
+    if (options.ignoreCase) {
+      std::vector<bool> members(0x10000);
+      for (auto &range : ranges) {
+        for (uint32_t c = range.first; c <= range.second; c++)
+          members[TextSearch::fold(c)] = true;
+      }
+      ranges.clear();
+      for (uint32_t c = 0; c < 0x10000; c++) {
+        if (!members[c])
+          continue;
+        if (ranges.size() && (uint32_t)ranges.back().second + 1 == c)
+          ranges.back().second = c;
+        else
+          ranges.emplace_back(c, c);
+      }
+    }
+    if (parser.negated[i])
+      ranges = complement(ranges);
+  }
+  typedef Program::Inst Inst;
+  for (bool reversed : {false, true}) {
+    auto &insts = reversed ? program->reverse : program->insts;
+    insts.push_back({Inst::SAVE, 0, 0, 0});
+    if (options.wholeWord)
+      insts.push_back({Inst::ASSERT, 0, NO_WORD_BEFORE, 0});
+    if (!program->compile(parser.nodes, root, insts, reversed)) {
+      _error = u"pattern too large";
+      return;
+    }
+    if (options.wholeWord)
+      insts.push_back({Inst::ASSERT, 0, NO_WORD_AFTER, 0});
+    insts.push_back({Inst::SAVE, 0, 1, 0});
+    insts.push_back({Inst::MATCH, 0, 0, 0});
+  }
+  for (auto &inst : program->insts) {
+    if (inst.op == Inst::ASSERT && inst.x >= WORD_BOUNDARY)
+      program->usesWord = true;
+  }
+  if (!program->buildClasses()) {
+    _error = u"pattern too large";
+    return;
+  }
+  // anchored if starting anywhere but the first character leads nowhere
+  program->anchored = true;
+  std::vector<uint32_t> consuming;
+  for (uint8_t flags = 0; flags <= PREV_WORD; flags += PREV_WORD) {
+    for (int context = 0; context < 4; context++) {
+      if (Program::closure(program->insts, {0}, flags, context & 1,
+                           context & 2, true, consuming) ||
+          consuming.size())
+        program->anchored = false;
+    }
+  }
+  std::u16string &prefix = program->prefix;
+  extractPrefix(parser.nodes, root, prefix);
+  if (prefix.length()) {
+    SearchOptions literal;
+    literal.ignoreCase = options.ignoreCase;
+    _prefix = std::make_unique<TextSearch>(prefix, literal);
+  }
+  _program = program;
+  bool skipsIdle = _prefix || program->anchored;
+  _forward = std::make_unique<Dfa>(*_program, false, skipsIdle);
+  _reverse = std::make_unique<Dfa>(*_program, true, false);
+}
+
+RegexSearch::RegexSearch(const RegexSearch &other)
+    : _program(other._program), _error(other._error) {
+  if (other._prefix)
+    _prefix = std::make_unique<TextSearch>(*other._prefix);
+  if (_program) {
+    bool skipsIdle = _prefix || _program->anchored;
+    _forward = std::make_unique<Dfa>(*_program, false, skipsIdle);
+    _reverse = std::make_unique<Dfa>(*_program, true, false);
+  }
+}
+
+RegexSearch::~RegexSearch() {}
+
+const std::u16string &RegexSearch::prefix() const {
+  static const std::u16string none;
+  return _program ? _program->prefix : none;
+}
+
+size_t RegexSearch::groupCount() const {
+  return _program ? _program->groups : 0;
+}
+
+void RegexSearch::addThread(ThreadList &list, uint32_t pc,
+                            const char16_t *text, size_t length, size_t at,
+                            size_t *slots) {
+  typedef Program::Inst Inst;
+  const Program &program = *_program;
+  uint8_t flags = at == 0 ? AT_START : 0;
+  if (at > 0 && TextSearch::isWordChar(text[at - 1]))
+    flags |= PREV_WORD;
+  bool nextWord = at < length && TextSearch::isWordChar(text[at]);
+  _stack.clear();
+  _stack.push_back({pc, NO_SLOT, 0});
+  while (_stack.size()) {
+    Frame frame = _stack.back();
+    _stack.pop_back();
+    if (frame.slot != NO_SLOT) {
+      slots[frame.slot] = frame.value;
+      continue;
+    }
+    uint32_t index = list.sparse[frame.pc];
+    if (index < list.size && list.dense[index] == frame.pc)
+      continue;
+    index = list.size++;
+    list.sparse[frame.pc] = index;
+    list.dense[index] = frame.pc;
+    const Inst &inst = program.insts[frame.pc];
+    switch (inst.op) {
+    case Inst::SPLIT:
+      _stack.push_back({inst.y, NO_SLOT, 0});
+      _stack.push_back({inst.x, NO_SLOT, 0});
+      break;
+    case Inst::JUMP:
+      _stack.push_back({inst.x, NO_SLOT, 0});
+      break;
+    case Inst::SAVE:
+      _stack.push_back({0, inst.x, slots[inst.x]});
+      slots[inst.x] = at;
+      _stack.push_back({frame.pc + 1, NO_SLOT, 0});
+      break;
+    case Inst::ASSERT:
+      if (Program::holds(inst.x, flags, nextWord, at == length))
+        _stack.push_back({frame.pc + 1, NO_SLOT, 0});
+      break;
+    default:
+      std::copy(slots, slots + program.slots,
+                list.slots.begin() + index * program.slots);
+    }
+  }
+}
+
+bool RegexSearch::simulate(const char16_t *text, size_t length, size_t from,
+                           bool anchored, RegexMatch &match) {
+  typedef Program::Inst Inst;
+  const Program &program = *_program;
+  size_t count = program.insts.size();
+  size_t slots = program.slots;
+  for (auto &list : _lists) {
+    if (list.sparse.size() != count) {
+      list.dense.assign(count, 0);
+      list.sparse.assign(count, 0);
+      list.slots.assign(count * slots, NOT_FOUND);
+    }
+    list.size = 0;
+  }
+  ThreadList *current = &_lists[0];
+  ThreadList *next = &_lists[1];
+  std::vector<size_t> scratch(slots);
+  bool matched = false;
+  for (size_t at = from;; at++) {
+    // a new match may start here at the lowest priority, until one was found
+    if (!matched && (at == from || !anchored) &&
+        (at == 0 || !program.anchored)) {
+      std::fill(scratch.begin(), scratch.end(), NOT_FOUND);
+      addThread(*current, 0, text, length, at, scratch.data());
+    }
+    if (!current->size)
+      break;
+    char16_t c = 0;
+    if (at < length)
+      c = program.ignoreCase ? TextSearch::fold(text[at]) : text[at];
+    for (size_t i = 0; i < current->size; i++) {
+      const Inst &inst = program.insts[current->dense[i]];
+      const size_t *threadSlots = &current->slots[i * slots];
+      if (inst.op == Inst::MATCH) {
+        // threads after this one have a lower priority
+        matched = true;
+        match.groups.assign(threadSlots, threadSlots + slots);
+        break;
+      }
+      if (inst.op > Inst::ANY || at == length || !program.matches(inst, c))
+        continue;
+      std::copy(threadSlots, threadSlots + slots, scratch.begin());
+      addThread(*next, current->dense[i] + 1, text, length, at + 1,
+                scratch.data());
+    }
+    std::swap(current, next);
+    next->size = 0;
+    if (at == length)
+      break;
+  }
+  return matched;
+}
+
+bool RegexSearch::find(const char16_t *text, size_t length, size_t from,
+                       RegexMatch &match) {
+  if (!_program || from > length)
+    return false;
+  if (_prefix) {
+    // every match starts at an occurrence of the prefix
+    from = _prefix->find(text, length, from);
+    if (from == NOT_FOUND)
+      return false;
+  }
+  size_t end = _forward->forward(text, length, from, _prefix.get());
+  if (end == NOT_FOUND)
+    return false;
+  size_t start = Dfa::GAVE_UP;
+  if (end != Dfa::GAVE_UP)
+    start = _reverse->backward(text, length, end, from);
+  if (start == Dfa::GAVE_UP)
+    return simulate(text, length, from, false, match);
+  if (!_program->groups) {
+    match.groups = {start, end};
+    return true;
+  }
+  return simulate(text, length, start, true, match);
+}
+
+bool RegexSearch::find(const LineBuffer &lines, size_t &line,
+                       size_t &column) {
+  RegexMatch match;
+  return find(lines, line, column, lines.size(), match);
+}
+
+bool RegexSearch::find(const LineBuffer &lines, size_t &line, size_t &column,
+                       size_t to, RegexMatch &match) {
+  if (!_program)
+    return false;
+  size_t first = line;
+  size_t start = column;
+  bool found = false;
+  lines.forEach(first, to, [&](size_t index, const std::u16string &text) {
+    size_t from = index == first ? start : 0;
+    if (!find(text.data(), text.length(), from, match))
+      return true;
+    line = index;
+    column = match.start();
+    found = true;
+    return false;
+  });
+  return found;
+}
+
+std::u16string RegexSearch::expand(const std::u16string &replacement,
+                                   const char16_t *text,
+                                   const RegexMatch &match) const {
+  std::u16string result;
+  for (size_t i = 0; i < replacement.length(); i++) {
+    char16_t c = replacement[i];
+    char16_t next = i + 1 < replacement.length() ? replacement[i + 1] : 0;
+    if ((c == '\\' || c == '$') && next == c) {
+      result += c;
+      i++;
+    } else if ((c == '\\' || c == '$') && next >= '0' && next <= '9') {
+      size_t group = next - '0';
+      // groups the pattern does not have or that did not match are empty
+      if (group <= groupCount() && match.groups[group * 2] != NOT_FOUND)
+        result.append(text + match.groups[group * 2],
+                      match.groups[group * 2 + 1] - match.groups[group * 2]);
+      i++;
+    } else {
+      result += c;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "line_buffer.h"
+#include "text_search.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Where a match and each of its groups start and end, two entries per group
+// with group 0 being the whole match. Groups that took no part are npos.
+struct RegexMatch {
+  std::vector<size_t> groups;
+
+  size_t start() const { return groups[0]; }
+  size_t end() const { return groups[1]; }
+};
+
+/*
+  Regular expression search over single lines, compiled once into a
+  Thompson program and its reverse. Lazy DFAs are built from both while
+  scanning: the forward one finds where the leftmost match ends, the reverse
+  one runs back from there to where it starts. Their states are cached
+  between lines up to a memory budget, a DFA that keeps flushing them gives
+  up on the line. Groups are filled in by a Pike VM over just the match, it
+  also searches the lines the DFAs gave up on. Neither backtracks or
+  recurses on the text, so the time per line is linear in its length.
+  When every match starts with the same literal text it is looked for with
+  TextSearch first and the DFA skips straight to its next occurrence.
+
+  Supported: literals, ., [classes] with ranges and negation, \d \w \s and
+  their negations, \b \B ^ $, groups, (?:...), |, * + ? {n} {n,} {n,m} and
+  their lazy forms. Ignoring case folds the letters TextSearch folds, whole
+  words put the match between non word characters.
+  The DFA cache makes find non const, use a copy per thread.
+*/
+class RegexSearch {
+public:
+  struct Program;
+  class Dfa;
+
+private:
+  // a set of instructions in the order they were added
+  struct ThreadList {
+    std::vector<uint32_t> dense;
+    std::vector<uint32_t> sparse;
+    size_t size = 0;
+    // the groups of every consuming thread, Program::slots per entry
+    std::vector<size_t> slots;
+  };
+  // an instruction to visit, or a group slot to restore once the
+  // instructions after a SAVE were visited
+  struct Frame {
+    uint32_t pc;
+    uint32_t slot;
+    size_t value;
+  };
+
+  std::shared_ptr<const Program> _program;
+  std::u16string _error;
+  std::unique_ptr<TextSearch> _prefix;
+  std::unique_ptr<Dfa> _forward;
+  std::unique_ptr<Dfa> _reverse;
+  ThreadList _lists[2];
+  std::vector<Frame> _stack;
+
+public:
+  RegexSearch(const std::u16string &pattern, SearchOptions options = {});
+  RegexSearch(const RegexSearch &other);
+  ~RegexSearch();
+
+  bool isValid() const { return _error.empty(); }
+  const std::u16string &error() const { return _error; }
+  // capturing groups in the pattern, not counting the whole match
+  size_t groupCount() const;
+  // literal text every match starts with, empty if there is none
+  const std::u16string &prefix() const;
+
+  // First match in text[from, length), false if there is none.
+  bool find(const char16_t *text, size_t length, size_t from,
+            RegexMatch &match);
+  // First match at or after column of line, both are set to where it
+  // starts. False if there is none up to the end of the buffer.
+  bool find(const LineBuffer &lines, size_t &line, size_t &column);
+  // Same, searching lines [line, to) only and filling in match.
+  bool find(const LineBuffer &lines, size_t &line, size_t &column, size_t to,
+            RegexMatch &match);
+
+  // The replacement for match in text: \0 to \9 or $0 to $9 insert a group,
+  // \\ and $$ a single backslash or dollar.
+  std::u16string expand(const std::u16string &replacement,
+                        const char16_t *text, const RegexMatch &match) const;
+
+private:
+  // Pike VM, anchored only tries a match starting at from
+  bool simulate(const char16_t *text, size_t length, size_t from,
+                bool anchored, RegexMatch &match);
+  void addThread(ThreadList &list, uint32_t pc, const char16_t *text,
+                 size_t length, size_t at, size_t *slots);
+};
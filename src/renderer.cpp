@@ -1,11 +1,12 @@
 #include "renderer.h"
 #include "document.h"
 #include "font_atlas.h"
+#include "highlighting.h"
 
 std::vector<RenderChar> &
 Renderer::render(int WIDTH, int HEIGHT, const std::shared_ptr<Document> &cursor,
                  const std::shared_ptr<FontAtlas> &atlas, int fontWidth,
-                 const Vec4f &color) {
+                 const Vec4f &color, Highlighter *highlighter) {
   entries.clear();
   float linesAdvance = 0;
   auto maxRenderWidth = (WIDTH / 2) - 20 - linesAdvance;
@@ -15,6 +16,10 @@ Renderer::render(int WIDTH, int HEIGHT, const std::shared_ptr<Document> &cursor,
   auto ypos = (-(HEIGHT / 2));
   auto xpos = -(int32_t)WIDTH / 2 + 20 + linesAdvance;
   cursor->setRenderStart(20 + linesAdvance, 15);
+  // the lines shown are known once the content is laid out
+  if (highlighter)
+    highlighter->highlight(*cursor, cursor->_skip,
+                           cursor->_skip + allLines->size());
   float toOffset = atlas->getHeight() * 1.15;
   // Vec4f color = state.provider.colors.default_color;
   // if (state.hasHighlighting) {
@@ -101,9 +106,22 @@ Renderer::render(int WIDTH, int HEIGHT, const std::shared_ptr<Document> &cursor,
   {
     for (size_t x = 0; x < allLines->size(); x++) {
       auto content = (*allLines)[x].second;
-      for (auto c = content.begin(); c != content.end(); c++) {
+      // the content starts _xOffset characters into the line
+      Vec4f current = color;
+      const std::vector<ColorSpan> *spans =
+          highlighter ? highlighter->spansOf(cursor->_skip + x) : nullptr;
+      size_t next = 0;
+      size_t column = cursor->_xOffset;
+      if (spans) {
+        current = highlighter->colorOf(COLOR_DEFAULT);
+        while (next < spans->size() && (*spans)[next].column <= column)
+          current = highlighter->colorOf((*spans)[next++].kind);
+      }
+      for (auto c = content.begin(); c != content.end(); c++, column++) {
+        if (spans && next < spans->size() && (*spans)[next].column <= column)
+          current = highlighter->colorOf((*spans)[next++].kind);
         if (*c != '\t')
-          entries.push_back(atlas->render(*c, xpos, ypos, color));
+          entries.push_back(atlas->render(*c, xpos, ypos, current));
         xpos += atlas->getAdvance(*c);
         if (xpos > maxRenderWidth + atlas->getAdvance(*c)) {
           break;
@@ -12,5 +12,6 @@ public:
   std::vector<RenderChar> &render(int width, int height,
                                   const std::shared_ptr<class Document> &cursor,
                                   const std::shared_ptr<class FontAtlas> &atlas,
-                                  int fontWidth, const Vec4f &color);
+                                  int fontWidth, const Vec4f &color,
+                                  class Highlighter *highlighter = nullptr);
 };
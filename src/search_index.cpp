@@ -0,0 +1,158 @@
+#include "search_index.h"
+#include <algorithm>
+
+// 16 bytes each, a scan stops once it found this many
+static const size_t MAX_MATCHES = 4 * 1024 * 1024;
+// the clock is read every this many lines
+static const size_t LINES_PER_CHECK = 64;
+
+void SearchIndex::reset(const LineBuffer &lines, const std::u16string &term,
+                        SearchOptions options, size_t viewFrom,
+                        size_t viewTo) {
+  clear();
+  _term = term;
+  _options = options;
+  _lines = lines.size();
+  if (term.empty())
+    return;
+  if (options.regex) {
+    _regex = std::make_unique<RegexSearch>(term, options);
+    if (!_regex->isValid()) {
+      _error = _regex->error();
+      _regex = nullptr;
+      return;
+    }
+  } else {
+    _literal = std::make_unique<TextSearch>(term, options);
+    if (_literal->isMultiLine()) {
+      _literal = nullptr;
+      return;
+    }
+  }
+  _first = _scanned = std::min(viewFrom, _lines);
+  size_t end = std::max(_first, std::min(viewTo, _lines));
+  scan(lines, _first, end, _matches, _scanned,
+       std::chrono::steady_clock::time_point::max());
+}
+
+void SearchIndex::clear() {
+  _term.clear();
+  _literal = nullptr;
+  _regex = nullptr;
+  _error.clear();
+  _first = _scanned = _wrapped = _lines = 0;
+  _matches.clear();
+  _before.clear();
+  _full = false;
+}
+
+bool SearchIndex::step(const LineBuffer &lines,
+                       std::chrono::microseconds budget) {
+  if (!isActive() || _full)
+    return true;
+  auto deadline = std::chrono::steady_clock::now() + budget;
+  if (_scanned < _lines)
+    scan(lines, _scanned, _lines, _matches, _scanned, deadline);
+  if (_scanned == _lines && _wrapped < _first && !_full)
+    scan(lines, _wrapped, _first, _before, _wrapped, deadline);
+  return isComplete() || _full;
+}
+
+void SearchIndex::scan(const LineBuffer &lines, size_t from, size_t to,
+                       std::deque<SearchMatch> &out, size_t &done,
+                       std::chrono::steady_clock::time_point deadline) {
+  size_t seen = 0;
+  lines.forEach(from, to, [&](size_t index, const std::u16string &text) {
+    // a line is scanned whole, however long it takes
+    if (_regex) {
+      RegexMatch match;
+      size_t column = 0;
+      while (!_full && column <= text.length() &&
+             _regex->find(text.data(), text.length(), column, match)) {
+        out.push_back({index, (uint32_t)match.start(),
+                       (uint32_t)(match.end() - match.start())});
+        column = match.start() + 1;
+        _full = count() >= MAX_MATCHES;
+      }
+    } else {
+      uint32_t length = _literal->length();
+      for (size_t at = _literal->find(text.data(), text.length(), 0);
+           !_full && at != std::u16string::npos;
+           at = _literal->find(text.data(), text.length(), at + 1)) {
+        out.push_back({index, (uint32_t)at, length});
+        _full = count() >= MAX_MATCHES;
+      }
+    }
+    if (_full)
+      return false;
+    done = index + 1;
+    return ++seen % LINES_PER_CHECK ||
+           std::chrono::steady_clock::now() < deadline;
+  });
+}
+
+bool SearchIndex::scanned(size_t from, size_t to) const {
+  if (from > to || isComplete())
+    return true;
+  return to < _wrapped || (from >= _first && to < _scanned);
+}
+
+static bool isBefore(const SearchMatch &match, size_t line, size_t column) {
+  return match.line < line || (match.line == line && match.column < column);
+}
+
+bool SearchIndex::find(size_t line, size_t column, bool forward,
+                       const SearchMatch *&match) const {
+  auto before = [&](const SearchMatch &m) {
+    return isBefore(m, line, column);
+  };
+  match = nullptr;
+  const SearchMatch *candidate = nullptr;
+  if (forward) {
+    auto it = std::partition_point(_before.begin(), _before.end(), before);
+    if (it != _before.end()) {
+      candidate = &*it;
+    } else {
+      it = std::partition_point(_matches.begin(), _matches.end(), before);
+      if (it != _matches.end())
+        candidate = &*it;
+    }
+    if (!scanned(line, candidate ? candidate->line : _lines - 1))
+      return false;
+  } else {
+    auto it = std::partition_point(_matches.begin(), _matches.end(), before);
+    if (it != _matches.begin()) {
+      candidate = &*(it - 1);
+    } else {
+      it = std::partition_point(_before.begin(), _before.end(), before);
+      if (it != _before.begin())
+        candidate = &*(it - 1);
+    }
+    if (!scanned(candidate ? candidate->line : 0, std::min(line, _lines - 1)))
+      return false;
+  }
+  match = candidate;
+  return true;
+}
+
+size_t SearchIndex::rank(size_t line, size_t column) const {
+  auto before = [&](const SearchMatch &m) {
+    return isBefore(m, line, column);
+  };
+  return (std::partition_point(_before.begin(), _before.end(), before) -
+          _before.begin()) +
+         (std::partition_point(_matches.begin(), _matches.end(), before) -
+          _matches.begin());
+}
+
+void SearchIndex::visible(size_t from, size_t to,
+                          std::vector<SearchMatch> &out) const {
+  out.clear();
+  for (auto *matches : {&_before, &_matches}) {
+    auto it = std::partition_point(
+        matches->begin(), matches->end(),
+        [&](const SearchMatch &m) { return m.line < from; });
+    for (; it != matches->end() && it->line < to; it++)
+      out.push_back(*it);
+  }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "line_buffer.h"
+#include "regex_search.h"
+#include "text_search.h"
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct SearchMatch {
+  size_t line;
+  uint32_t column;
+  uint32_t length;
+};
+
+/*
+  Every match of a search term in a buffer in sorted order, built while the
+  term is typed. reset() searches the lines on screen right away, step()
+  scans the rest in slices of a bounded time, which only a single very long
+  line overruns: from the end of the screen to the end of the buffer, then
+  from the start up to the screen. A new term replaces the scan between two
+  slices, nothing waits for the old one.
+  Matches start a character apart at the least, as repeated searches find
+  them, and never span lines. Multi line terms are not indexed. The buffer
+  must not change while a scan is in progress, reset() starts over.
+*/
+class SearchIndex {
+  std::u16string _term;
+  SearchOptions _options;
+  std::unique_ptr<TextSearch> _literal;
+  std::unique_ptr<RegexSearch> _regex;
+  std::u16string _error;
+  // lines [_first, _scanned) are in _matches, lines [0, _wrapped) in
+  // _before, both sorted
+  size_t _first = 0;
+  size_t _scanned = 0;
+  size_t _wrapped = 0;
+  size_t _lines = 0;
+  std::deque<SearchMatch> _matches;
+  std::deque<SearchMatch> _before;
+  bool _full = false;
+
+public:
+  // Starts over for term in lines, searching [viewFrom, viewTo) first.
+  void reset(const LineBuffer &lines, const std::u16string &term,
+             SearchOptions options, size_t viewFrom, size_t viewTo);
+  void clear();
+  // Scans on for about budget, true once there is nothing left to scan.
+  bool step(const LineBuffer &lines, std::chrono::microseconds budget);
+
+  const std::u16string &term() const { return _term; }
+  const SearchOptions &options() const { return _options; }
+  // false for an empty, invalid or multi line term
+  bool isActive() const { return _literal || _regex; }
+  bool isComplete() const { return _scanned == _lines && _wrapped == _first; }
+  // too many matches to keep, the scan stopped
+  bool isFull() const { return _full; }
+  // why a regex term is invalid
+  const std::u16string &error() const { return _error; }
+  size_t count() const { return _before.size() + _matches.size(); }
+
+  // The first match at or after line:column going forward, the last one
+  // before it going backward. False while the lines in between are not
+  // scanned yet, match is null then and when there is none.
+  bool find(size_t line, size_t column, bool forward,
+            const SearchMatch *&match) const;
+  // matches before line:column, exact once the scan is complete
+  size_t rank(size_t line, size_t column) const;
+  // the matches on lines [from, to) that are scanned
+  void visible(size_t from, size_t to, std::vector<SearchMatch> &out) const;
+
+private:
+  void scan(const LineBuffer &lines, size_t from, size_t to,
+            std::deque<SearchMatch> &out, size_t &done,
+            std::chrono::steady_clock::time_point deadline);
+  bool scanned(size_t from, size_t to) const;
+};
@@ -0,0 +1,84 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+  Small portability layer for the vectorized scanners.
+  SSE2 is part of every x86-64 target so it is used unconditionally there,
+  AVX2 kernels are compiled with a target attribute and picked at runtime.
+  Everything else runs the scalar fallback.
+*/
+#if defined(__x86_64__) || defined(_M_X64)
+#define LEDIT_SSE2 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(LEDIT_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define LEDIT_AVX2 1
+#define LEDIT_AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(LEDIT_SSE2) && defined(__AVX2__)
+#define LEDIT_AVX2 1
+#define LEDIT_AVX2_TARGET
+#endif
+
+namespace simd {
+
+inline bool hasAvx2() {
+#if defined(LEDIT_AVX2) && (defined(__GNUC__) || defined(__clang__))
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+#elif defined(LEDIT_AVX2)
+  return true;
+#else
+  return false;
+#endif
+}
+
+inline int ctz(uint32_t value) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, value);
+  return (int)index;
+#else
+  return __builtin_ctz(value);
+#endif
+}
+
+inline int clz(uint32_t value) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse(&index, value);
+  return 31 - (int)index;
+#else
+  return __builtin_clz(value);
+#endif
+}
+
+inline int popcount(uint32_t value) {
+#if defined(_MSC_VER)
+  return (int)__popcnt(value);
+#else
+  return __builtin_popcount(value);
+#endif
+}
+
+inline size_t countNewlines(const char *data, size_t size) {
+  size_t count = 0;
+  size_t i = 0;
+#ifdef LEDIT_SSE2
+  __m128i newline = _mm_set1_epi8('\n');
+  for (; i + 16 <= size; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+    count += popcount(
+        (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+  }
+#endif
+  for (; i < size; i++)
+    count += data[i] == '\n';
+  return count;
+}
+
+} // namespace simd
@@ -1,6 +1,21 @@
 #include "state.h"
 #include "languages.h"
+#include "regex_search.h"
 #include "utils.h"
+#include <algorithm>
+
+// the search index is built between events in slices this long, so a
+// keystroke waits for one at most
+static const auto SEARCH_SLICE = std::chrono::microseconds(1000);
+// and the match count is shown this often while it is
+static const auto COUNT_INTERVAL = std::chrono::milliseconds(100);
+
+static std::u16string getSaveStats(const FileWriter &writer) {
+  double mib = writer.lastBytes / (1024.0 * 1024.0);
+  int rate = writer.lastSeconds > 0 ? (int)(mib / writer.lastSeconds) : 0;
+  return u" [" + numberToString((int)(writer.lastBytes / 1024)) + u" KiB, " +
+         numberToString(rate) + u" MiB/s]";
+}
 
 void State::resize(float w, float h) {
   invalidateCache();
@@ -28,7 +43,7 @@ void State::startReplace() {
   if (mode != 0)
     return;
   mode = 30;
-  status = u"Search: ";
+  status = getSearchPrompt();
   miniBuf = replaceBuffer.search;
   active->bindTo(&miniBuf);
 }
@@ -42,13 +57,76 @@ void State::tryComment() {
 void State::checkChanged() {
   if (!path.length())
     return;
-  active->_branch = provider.getBranchName(path);
-  auto changed = active->didChange(path);
-  if (changed) {
-    miniBuf = u"";
-    mode = 36;
-    status = u"[" + create(path) + u"]: Changed on disk, reload?";
-    active->bindTo(&dummyBuf);
+  // without a monitor the file is looked at whenever it may have changed
+  if ((!changeMonitor || !changeMonitor->isActive()) &&
+      active->didChange(path)) {
+    active->_changedOnDisk = true;
+    active->detachFromDisk();
+  }
+  if (!active->_changedOnDisk || mode != 0)
+    return;
+  active->_changedOnDisk = false;
+  miniBuf = u"";
+  mode = 36;
+  status = u"[" + create(path) + u"]: Changed on disk, reload?";
+  active->bindTo(&dummyBuf);
+}
+
+void State::watchOpenFiles() {
+  std::vector<std::string> files;
+  for (auto &cursor : cursors) {
+    auto file = cursor->getPath();
+    if (!file.length() || file == "-")
+      continue;
+    files.push_back(file);
+    // a checkout changes the branch shown
+    auto head = provider.branches.headOf(file);
+    if (head.length())
+      files.push_back(head);
+  }
+  std::sort(files.begin(), files.end());
+  files.erase(std::unique(files.begin(), files.end()), files.end());
+  if (!changeMonitor) {
+    if (files.empty())
+      return;
+    changeMonitor = std::make_unique<ChangeMonitor>(wakeUp);
+  }
+  changeMonitor->setFiles(files);
+}
+
+void State::updateChanges() {
+  std::vector<std::string> changed;
+  if (changeMonitor && changeMonitor->take(changed)) {
+    for (auto &cursor : cursors) {
+      auto file = cursor->getPath();
+      if (!file.length() || file == "-")
+        continue;
+      auto head = provider.branches.headOf(file);
+      if (head.length() &&
+          std::find(changed.begin(), changed.end(), head) != changed.end()) {
+        cursor->_branch = provider.getBranchName(file);
+        if (cursor == active) {
+          invalidateCache();
+          renderCoords();
+        }
+      }
+      // a followed file changes all the time, that is shown as it happens
+      if (cursor->isFollowing() ||
+          std::find(changed.begin(), changed.end(), file) == changed.end())
+        continue;
+      // the editor's own saves leave the time known
+      if (cursor->didChange(file)) {
+        cursor->_changedOnDisk = true;
+        // the file may have been truncated under its mapped lines
+        cursor->detachFromDisk();
+        if (cursor == active)
+          invalidateCache();
+      }
+    }
+  }
+  if (active->_changedOnDisk && mode == 0) {
+    checkChanged();
+    invalidateCache();
   }
 }
 
@@ -160,8 +238,11 @@ void State::save() {
     saveNew();
     return;
   }
-  active->saveTo(path);
-  status = u"Saved: " + create(path);
+  if (active->saveTo(path, provider.syncOnSave))
+    status = u"Saved: " + create(path) + getSaveStats(active->_writer);
+  else
+    status = u"Failed to save: " + create(path) + u" [" +
+             create(active->_writer.lastError) + u"]";
 }
 
 void State::saveNew() {
@@ -187,15 +268,18 @@ void State::open() {
     return;
   miniBuf = u"";
   provider.lastProvidedFolder = "";
+  // relative paths start here
+  provider.directories.prefetch(".");
   active->bindTo(&miniBuf);
   mode = 4;
   status = u"Open [" + create(provider.getCwdFormatted()) + u"]: ";
 }
 
 void State::reHighlight() {
-  if (hasHighlighting)
-    highlighter.highlight(active->_lines, &provider.colors, active->_skip,
-                          active->_maxLines, active->_y);
+  if (!hasHighlighting)
+    return;
+  highlighter.highlight(*active, &provider.colors, active->_skip,
+                        active->_skip + active->_maxLines);
 }
 
 void State::undo() {
@@ -205,13 +289,458 @@ void State::undo() {
     reHighlight();
 }
 
+void State::redo() {
+  bool result = active->redo();
+  status = result ? u"Redo" : u"Nothing to redo";
+  if (result)
+    reHighlight();
+}
+
 void State::search() {
   if (mode != 0)
     return;
   miniBuf = u"";
   active->bindTo(&miniBuf, true);
   mode = 2;
-  status = u"Search: ";
+  status = getSearchPrompt();
+}
+
+void State::toggleSearchOption(bool SearchOptions::*option) {
+  searchOptions.*option = !(searchOptions.*option);
+  // shown right away, the prompt keeps its text while searching
+  if (mode == 6 || mode == 7)
+    mode = 2;
+  if (mode == 40)
+    status = u"Search all buffers" + getSearchFlags() + u": ";
+  else if (mode == 42)
+    status = u"Grep" + getSearchFlags() + u" in " +
+             create(provider.getCwdFormatted()) + u": ";
+  // the replacement prompts keep theirs, the options show on the next search
+  else if (mode != 31 && mode != 32 && mode != 41)
+    status = getSearchPrompt();
+}
+
+std::u16string State::getSearchFlags() {
+  std::u16string flags;
+  if (searchOptions.ignoreCase)
+    flags += u"ignore case";
+  if (searchOptions.wholeWord)
+    flags += std::u16string(flags.length() ? u", " : u"") + u"whole word";
+  if (searchOptions.regex)
+    flags += std::u16string(flags.length() ? u", " : u"") + u"regex";
+  return flags.length() ? u" [" + flags + u"]" : u"";
+}
+
+std::u16string State::getSearchPrompt() {
+  std::u16string prompt = u"Search" + getSearchFlags();
+  // the count of what was typed so far, + while it is still counting
+  if (mode == 2 && searchIndex.error().length())
+    prompt += u" (" + searchIndex.error() + u")";
+  else if (mode == 2 && searchIndex.isActive() && !searchIndex.isComplete())
+    prompt += u" (" + numberToString(searchIndex.count()) + u"+ matches)";
+  else if (mode == 2 && searchIndex.isActive())
+    prompt += searchIndex.count() == 1
+                  ? u" (1 match)"
+                  : u" (" + numberToString(searchIndex.count()) + u" matches)";
+  return prompt + u": ";
+}
+
+std::u16string State::getMatchStatus() {
+  std::u16string count =
+      searchIndex.isComplete()
+          ? numberToString(searchIndex.rank(active->_y, active->_xSave) + 1) +
+                u" of " + numberToString(searchIndex.count())
+          : numberToString(searchIndex.count()) + u"+ matches";
+  return u"[At: " + numberToString(active->_y + 1) + u":" +
+         numberToString(active->_xSave + 1) + u", " + count + u"]: ";
+}
+
+std::u16string State::findMatch(bool backward) {
+  updateSearchIndex();
+  // where Document::search continues from
+  size_t line = mode == 7 ? 0 : active->_y;
+  size_t column = mode == 6 ? active->_xSave + !backward : 0;
+  const SearchMatch *match = nullptr;
+  bool known = searchIndex.isActive() &&
+               searchIndex.find(line, column, !backward, match);
+  if (!known && backward && searchIndex.isActive()) {
+    // going back needs the lines before the screen, they are scanned now
+    searchIndex.step(active->_lines, std::chrono::hours(1));
+    known = searchIndex.find(line, column, false, match);
+  }
+  if (!known && backward)
+    return u"[Can't search back here]: ";
+  if (!known) {
+    auto result = active->search(miniBuf, mode == 6, mode != 7, searchOptions);
+    if (searchIndex.isActive() && result.rfind(u"[At: ", 0) == 0)
+      return getMatchStatus();
+    return result;
+  }
+  if (!match)
+    return backward    ? u"[No earlier matches]: "
+           : mode == 6 ? u"[No further matches]: "
+                       : u"[Not found]: ";
+  active->showMatch(match->line, match->column);
+  return getMatchStatus();
+}
+
+void State::updateSearchIndex() {
+  bool searching = mode == 2 || mode == 6 || mode == 7;
+  if (!searching || active->isPaged()) {
+    if (indexedDocument) {
+      searchIndex.clear();
+      indexedDocument = nullptr;
+      invalidateCache();
+    }
+    return;
+  }
+  const SearchOptions &options = searchIndex.options();
+  bool termChanged = !indexedDocument || miniBuf != searchIndex.term() ||
+                     options.ignoreCase != searchOptions.ignoreCase ||
+                     options.wholeWord != searchOptions.wholeWord ||
+                     options.regex != searchOptions.regex;
+  if (termChanged || indexedDocument != active.get() ||
+      indexedVersion != active->_version) {
+    searchIndex.reset(active->_lines, miniBuf, searchOptions, active->_skip,
+                      active->_skip + active->_maxLines);
+    indexedDocument = active.get();
+    indexedVersion = active->_version;
+    // a changed term is searched from the cursor line again
+    if (termChanged && (mode == 6 || mode == 7))
+      mode = 2;
+    if (mode == 2)
+      status = getSearchPrompt();
+    indexShown = std::chrono::steady_clock::now();
+    invalidateCache();
+  }
+  if (!searchIndex.isActive() || searchIndex.isComplete() ||
+      searchIndex.isFull())
+    return;
+  bool done = searchIndex.step(active->_lines, SEARCH_SLICE);
+  auto now = std::chrono::steady_clock::now();
+  if (done || now - indexShown >= COUNT_INTERVAL) {
+    indexShown = now;
+    if (mode == 2)
+      status = getSearchPrompt();
+    else if (mode == 6)
+      status = getMatchStatus();
+    invalidateCache();
+  }
+  if (!done && wakeUp)
+    wakeUp();
+}
+
+void State::searchBuffers() {
+  if (mode != 0)
+    return;
+  miniBuf = u"";
+  active->bindTo(&miniBuf);
+  mode = 40;
+  status = u"Search all buffers" + getSearchFlags() + u": ";
+}
+
+void State::showBufferMatches() {
+  if (mode != 0)
+    return;
+  if (!bufferSearch) {
+    status = u"No search through all buffers yet";
+    return;
+  }
+  active->bindTo(&dummyBuf);
+  mode = 41;
+  status = getBufferMatchStatus();
+}
+
+bool State::checkSearchTerm() {
+  if (searchOptions.regex) {
+    RegexSearch regex(miniBuf, searchOptions);
+    if (!regex.isValid()) {
+      status = u"[Invalid regex: " + regex.error() + u"]: ";
+      return false;
+    }
+  } else {
+    TextSearch literal(miniBuf, searchOptions);
+    if (literal.isEmpty())
+      return false;
+    if (literal.isMultiLine()) {
+      status = u"[Only single lines match here]: ";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool State::startBufferSearch() {
+  if (!checkSearchTerm())
+    return false;
+  // the snapshots are taken here, the pool only ever reads those
+  std::vector<std::shared_ptr<const LineSnapshot>> snapshots;
+  searchedBuffers.clear();
+  searchedNames.clear();
+  for (auto &cursor : cursors) {
+    // a paged view holds a window of its file only
+    if (cursor->isPaged())
+      continue;
+    snapshots.push_back(std::make_shared<LineSnapshot>(cursor->_lines));
+    searchedBuffers.push_back(cursor);
+    std::string name = cursor->getPath();
+    searchedNames.push_back(name.length() ? create(split(name, "/").back())
+                                          : u"New File");
+  }
+  // replacing the last search cancels it
+  bufferSearch = std::make_unique<BufferSearch>(
+      pool, std::move(snapshots), miniBuf, searchOptions, wakeUp);
+  bufferMatches.clear();
+  bufferMatchIndex = 0;
+  status = getBufferMatchStatus();
+  return true;
+}
+
+std::u16string State::getBufferMatchStatus() {
+  bool done = bufferSearch->isDone();
+  if (bufferMatches.empty()) {
+    miniBuf = u"";
+    return done ? u"[No matches]: " : u"[Searching all buffers]: ";
+  }
+  const BufferMatch &match = bufferMatches[bufferMatchIndex];
+  miniBuf = searchedNames[match.buffer] + u":" +
+            numberToString(match.line + 1) + u":" +
+            numberToString(match.column + 1) + u": " + match.preview;
+  std::u16string count = numberToString(bufferMatches.size());
+  if (bufferSearch->isFull())
+    count += u", more not shown";
+  else if (!done)
+    count += u"+";
+  return u"[" + numberToString(bufferMatchIndex + 1) + u" of " + count +
+         u"] ";
+}
+
+std::u16string State::gotoBufferMatch() {
+  const BufferMatch &match = bufferMatches[bufferMatchIndex];
+  auto target = searchedBuffers[match.buffer].lock();
+  size_t index = 0;
+  while (index < cursors.size() && cursors[index] != target)
+    index++;
+  if (!target || index == cursors.size())
+    return u"[Buffer closed]: ";
+  active->unbind();
+  if (target != active)
+    activateCursor(index);
+  showPosition(match.line, match.column);
+  return searchedNames[match.buffer] + u": " +
+         numberToString(active->_y + 1) + u":" + numberToString(active->_x + 1);
+}
+
+void State::showPosition(size_t line, size_t column) {
+  if (active->isPaged()) {
+    active->gotoLine(line + 1);
+    return;
+  }
+  // the buffer may have changed since it was searched
+  line = std::min(line, active->_lines.size() - 1);
+  column = std::min(column, active->_lines[line].length());
+  // showMatch leaves the column to unbind() like a search does
+  active->bindTo(&dummyBuf);
+  active->showMatch(line, column);
+  active->unbind();
+}
+
+void State::grepProject() {
+  if (mode != 0)
+    return;
+  miniBuf = u"";
+  active->bindTo(&miniBuf);
+  mode = 42;
+  status = u"Grep" + getSearchFlags() + u" in " +
+           create(provider.getCwdFormatted()) + u": ";
+}
+
+bool State::startProjectGrep() {
+  if (!checkSearchTerm())
+    return false;
+  std::error_code error;
+  grepRoot = std::filesystem::current_path(error).generic_string();
+  if (error) {
+    status = u"[No working directory]: ";
+    return false;
+  }
+  grepTerm = miniBuf;
+  grepMatches.clear();
+  // a new search reuses the buffer of the last one if it is still open
+  auto buffer = grepBuffer.lock();
+  if (!buffer) {
+    buffer = std::make_shared<Document>();
+    buffer->setReadOnly(true);
+    grepBuffer = buffer;
+    cursors.push_back(buffer);
+  }
+  buffer->setLines(
+      {u"Grep " + grepTerm + u" in " + create(grepRoot) + u": searching"});
+  buffer->_x = buffer->_y = buffer->_skip = 0;
+  // the last search stops before this one starts
+  projectGrep = nullptr;
+  std::vector<std::string> files;
+  grepIndexed = false;
+  std::string indexFolder = provider.getIndexFolder();
+  if (provider.trigramIndex && indexFolder.length()) {
+    if (!grepIndexer || grepIndexer->root() != grepRoot)
+      grepIndexer = std::make_unique<TrigramIndexer>(grepRoot, indexFolder);
+    auto index = grepIndexer->current();
+    grepIndexed = index && index->candidates(miniBuf, searchOptions, files);
+    // changes since the last update are picked up by the next search
+    grepIndexer->refresh(std::chrono::seconds(30));
+  }
+  if (grepIndexed)
+    projectGrep = std::make_unique<ProjectGrep>(
+        grepRoot, std::move(files), miniBuf, searchOptions, wakeUp);
+  else
+    projectGrep = std::make_unique<ProjectGrep>(grepRoot, miniBuf,
+                                                searchOptions, wakeUp);
+  active->unbind();
+  if (buffer != active)
+    activateCursor(std::find(cursors.begin(), cursors.end(), buffer) -
+                   cursors.begin());
+  status = u"Searching " + create(grepRoot) + u", enter on a match opens it";
+  return true;
+}
+
+std::u16string State::getGrepHeading() {
+  std::u16string heading = u"Grep " + grepTerm + u" in " + create(grepRoot);
+  std::u16string files = numberToString(projectGrep->filesSearched()) +
+                         (grepIndexed ? u" indexed files, " : u" files, ") +
+                         numberToString(projectGrep->binaryFiles()) +
+                         u" binary skipped";
+  if (projectGrep->isFull())
+    return heading + u": first " + numberToString(grepMatches.size()) +
+           u" matches in " + files;
+  return heading + u": " + numberToString(grepMatches.size()) +
+         u" matches in " + files;
+}
+
+void State::updateProjectGrep() {
+  if (!projectGrep)
+    return;
+  auto buffer = grepBuffer.lock();
+  if (!buffer) {
+    // the buffer was closed, nobody looks at the results
+    projectGrep = nullptr;
+    return;
+  }
+  size_t before = grepMatches.size();
+  bool done = projectGrep->take(grepMatches);
+  std::vector<std::u16string> lines;
+  for (size_t i = before; i < grepMatches.size(); i++) {
+    const GrepMatch &match = grepMatches[i];
+    lines.push_back(create(match.path) + u":" +
+                    numberToString(match.line + 1) + u":" +
+                    numberToString(match.column + 1) + u": " +
+                    match.preview);
+  }
+  buffer->appendLines(std::move(lines));
+  if (done) {
+    buffer->replaceLine(0, getGrepHeading());
+    projectGrep = nullptr;
+  }
+  if (buffer == active && (done || grepMatches.size() != before))
+    invalidateCache();
+}
+
+bool State::openGrepMatch() {
+  if (active != grepBuffer.lock())
+    return false;
+  size_t line = active->_y;
+  if (line == 0 || line > grepMatches.size()) {
+    status = u"Not a match";
+    return true;
+  }
+  GrepMatch match = grepMatches[line - 1];
+  std::string path = grepRoot + "/" + match.path;
+  size_t index = 0;
+  while (index < cursors.size() && cursors[index]->getPath() != path)
+    index++;
+  if (index == cursors.size())
+    addCursor(path);
+  else
+    activateCursor(index);
+  showPosition(match.line, match.column);
+  status = u"Opened: " + create(match.path) + u":" +
+           numberToString(active->_y + 1);
+  return true;
+}
+
+void State::findFile() {
+  if (mode != 0)
+    return;
+  std::error_code error;
+  std::string root = std::filesystem::current_path(error).generic_string();
+  if (error) {
+    status = u"[No working directory]";
+    return;
+  }
+  // the list of the last time is shown while it is crawled again
+  if (!fileList || fileList->root() != root)
+    fileList = std::make_unique<FileList>(root, wakeUp);
+  else
+    fileList->refresh(std::chrono::seconds(30));
+  miniBuf = u"";
+  active->bindTo(&miniBuf);
+  mode = 43;
+  fileFinderIndex = 0;
+  fileFinder.update(fileList->paths(), fileList->generation(), miniBuf);
+  status = getFileFinderStatus();
+}
+
+std::u16string State::getFileFinderStatus() {
+  const auto &ranked = fileFinder.ranked();
+  std::u16string more = fileList->isCrawling() ? u"+" : u"";
+  if (ranked.empty())
+    return u"Find file [no match" + more + u"]: ";
+  const std::string &path = fileList->paths()[ranked[fileFinderIndex].index];
+  return u"Find file [" + numberToString(fileFinderIndex + 1) + u" of " +
+         numberToString(fileFinder.count()) + more + u"] " + create(path) +
+         u": ";
+}
+
+void State::updateFileFinder() {
+  if (!fileList)
+    return;
+  bool crawled = fileList->update();
+  if (mode != 43)
+    return;
+  bool ranked =
+      fileFinder.update(fileList->paths(), fileList->generation(), miniBuf);
+  if (!ranked && !crawled)
+    return;
+  if (ranked)
+    fileFinderIndex = 0;
+  status = getFileFinderStatus();
+  invalidateCache();
+}
+
+void State::openFoundFile() {
+  const std::string &relative =
+      fileList->paths()[fileFinder.ranked()[fileFinderIndex].index];
+  std::string path = fileList->root() + "/" + relative;
+  active->unbind();
+  size_t index = 0;
+  while (index < cursors.size() && cursors[index]->getPath() != path)
+    index++;
+  if (index == cursors.size())
+    addCursor(path);
+  else if (index != getActiveIndex())
+    activateCursor(index);
+  status = u"Opened: " + create(relative);
+}
+
+void State::updateBufferSearch() {
+  if (!bufferSearch || bufferSearch->isDone())
+    return;
+  size_t before = bufferMatches.size();
+  bool done = bufferSearch->take(bufferMatches);
+  if (mode == 41 && (done || bufferMatches.size() != before)) {
+    status = getBufferMatchStatus();
+    invalidateCache();
+  }
 }
 
 void State::tryEnableHighlighting() {
@@ -221,8 +750,8 @@ void State::tryEnableHighlighting() {
       has_language(fileName == u"Dockerfile" ? "dockerfile" : ext);
   if (lang) {
     highlighter.setLanguage(*lang, lang->modeName);
-    highlighter.highlight(active->_lines, &provider.colors, active->_skip,
-                          active->_maxLines, active->_y);
+    highlighter.highlight(*active, &provider.colors, active->_skip,
+                          active->_skip + active->_maxLines);
     hasHighlighting = true;
   } else {
     hasHighlighting = false;
@@ -232,12 +761,14 @@ void State::tryEnableHighlighting() {
 void State::inform(bool success, bool shift_pressed) {
   if (success) {
     if (mode == 1) { // save to
-      bool result = active->saveTo(convert_str(miniBuf));
+      bool result = active->saveTo(convert_str(miniBuf), provider.syncOnSave);
       if (result) {
-        status = u"Saved to: " + miniBuf;
+        status = u"Saved to: " + miniBuf + getSaveStats(active->_writer);
         if (!path.length()) {
           path = convert_str(miniBuf);
           active->setPath(path);
+          active->_branch = provider.getBranchName(path);
+          watchOpenFiles();
           auto splited = split(path, "/");
           std::string fName = splited.back();
           fileName = create(fName);
@@ -248,23 +779,27 @@ void State::inform(bool success, bool shift_pressed) {
       } else {
         status = u"Failed to save to: " + miniBuf;
       }
-    } else if (mode == 2 || mode == 7) { // search
-      status = active->search(miniBuf, false, mode != 7);
-      if (mode == 7)
-        mode = 2;
+    } else if (mode == 2 || mode == 6 || mode == 7) { // search
+      // shift goes back to the previous match
+      status = findMatch(shift_pressed && mode == 6);
       // hacky shit
-      if (status != u"[Not found]: ")
+      if (mode != 6 && status.rfind(u"[At: ", 0) == 0)
         mode = 6;
-      return;
-    } else if (mode == 6) { // search
-      status = active->search(miniBuf, true);
-      if (status == u"[No further matches]: ") {
+      else if (mode == 7)
+        mode = 2;
+      else if (status == u"[No further matches]: ")
         mode = 7;
-      }
       return;
     } else if (mode == 3) { // gotoline
       auto line_str = convert_str(miniBuf);
-      if (isSafeNumber(line_str)) {
+      // "50%" jumps by position in the file
+      std::string percent_str =
+          hasEnding(line_str, "%") ? line_str.substr(0, line_str.length() - 1)
+                                   : "";
+      if (percent_str.length() && isSafeNumber(percent_str)) {
+        active->gotoPercent(std::stoi(percent_str));
+        status = u"Jump to: " + miniBuf;
+      } else if (isSafeNumber(line_str)) {
         active->gotoLine(std::stoi(line_str));
         status = u"Jump to: " + miniBuf;
       } else {
@@ -310,9 +845,17 @@ void State::inform(bool success, bool shift_pressed) {
         auto lang = getLanguage(round - 1);
         highlighter.setLanguage(lang, lang.modeName);
         hasHighlighting = true;
+        reHighlight();
         status = u"Mode: " + miniBuf;
       }
     } else if (mode == 30) {
+      if (searchOptions.regex) {
+        RegexSearch regex(miniBuf, searchOptions);
+        if (!regex.isValid()) {
+          status = u"[Invalid regex: " + regex.error() + u"]: ";
+          return;
+        }
+      }
       replaceBuffer.search = miniBuf;
       miniBuf = replaceBuffer.replace;
       active->unbind();
@@ -328,26 +871,58 @@ void State::inform(bool success, bool shift_pressed) {
       return;
     } else if (mode == 32) {
       if (shift_pressed) {
-        auto count =
-            active->replaceAll(replaceBuffer.search, replaceBuffer.replace);
+        auto count = active->replaceAll(replaceBuffer.search,
+                                        replaceBuffer.replace, searchOptions);
         if (count)
           status = u"Replaced " + numberToString(count) + u" matches";
         else
           status = u"[No match]: " + replaceBuffer.search + u" => " +
                    replaceBuffer.replace;
       } else {
-        auto result = active->replaceOne(replaceBuffer.search,
-                                         replaceBuffer.replace, true);
+        auto result =
+            active->replaceOne(replaceBuffer.search, replaceBuffer.replace,
+                               true, true, searchOptions);
         status =
             result + replaceBuffer.search + u" => " + replaceBuffer.replace;
         return;
       }
+    } else if (mode == 40) {
+      if (!startBufferSearch())
+        return;
+      active->unbind();
+      active->bindTo(&dummyBuf);
+      mode = 41;
+      return;
+    } else if (mode == 42) {
+      if (!startProjectGrep())
+        return;
+      mode = 0;
+      return;
+    } else if (mode == 41) {
+      if (bufferMatches.empty() && !bufferSearch->isDone())
+        return;
+      if (bufferMatches.size()) {
+        std::u16string result = gotoBufferMatch();
+        if (result == u"[Buffer closed]: ") {
+          status = result;
+          return;
+        }
+        status = u"Jumped to: " + result;
+      } else {
+        status = u"No matches";
+      }
+    } else if (mode == 43) {
+      // the prompt says there is no match already
+      if (fileFinder.ranked().empty())
+        return;
+      openFoundFile();
     } else if (mode == 36) {
       active->reloadFile(path);
       status = u"Reloaded";
     }
   } else {
-    status = u"Aborted";
+    // the results stay around for C-x-j
+    status = mode == 41 ? u"Closed the matches" : u"Aborted";
   }
   active->unbind();
   mode = 0;
@@ -379,7 +954,41 @@ void State::provideComplete(bool reverse) {
       miniBuf = u"Text";
     else
       miniBuf = create(getLanguage(round - 1).modeName);
+  } else if (mode == 41 && bufferMatches.size()) {
+    if (reverse)
+      bufferMatchIndex = bufferMatchIndex ? bufferMatchIndex - 1
+                                          : bufferMatches.size() - 1;
+    else if (++bufferMatchIndex == bufferMatches.size())
+      bufferMatchIndex = 0;
+    status = getBufferMatchStatus();
+  } else if (mode == 43 && fileFinder.ranked().size()) {
+    size_t count = fileFinder.ranked().size();
+    if (reverse)
+      fileFinderIndex = fileFinderIndex ? fileFinderIndex - 1 : count - 1;
+    else if (++fileFinderIndex == count)
+      fileFinderIndex = 0;
+    status = getFileFinderStatus();
+  }
+}
+
+void State::poll() {
+  for (auto &cursor : cursors) {
+    bool loaded = cursor->pollLoader();
+    bool followed = cursor->pollFollower();
+    if ((!loaded && !followed) || cursor != active)
+      continue;
+    invalidateCache();
+    renderCoords();
   }
+  // the search index scans on between events
+  updateSearchIndex();
+  updateBufferSearch();
+  updateProjectGrep();
+  updateFileFinder();
+  updateChanges();
+  // lines the highlighting thread got to show up with the next frame
+  if (hasHighlighting && highlighter.isBehind())
+    invalidateCache();
 }
 
 void State::renderCoords() {
@@ -392,13 +1001,41 @@ void State::renderCoords() {
   if (active->_branch.length()) {
     branch = u" [git: " + create(active->_branch) + u"]";
   }
-  status = numberToString(active->_y + 1) + u":" +
+  int64_t line = active->getLineNumber();
+  status = (line < 0 ? u"?" : create(std::to_string(line + 1))) + u":" +
            numberToString(active->_x + 1) + branch + u" [" + fileName + u": " +
            (hasHighlighting ? highlighter.languageName : u"Text") +
-           u"] History Size: " + numberToString(active->_history.size());
+           u"] History Size: " + numberToString(active->_history.size()) +
+           u" (" +
+           numberToString((active->_history.memoryUsage() + 1023) / 1024) +
+           u" KiB)";
   if (active->_selection.active)
     status +=
         u" Selected: [" + numberToString(active->getSelectionSize()) + u"]";
+  if (active->isLoading())
+    status += u" [loading " + numberToString(active->getLoadProgress()) +
+              u"%, read only]";
+  else if (active->isPaged())
+    status += u" [paged, read only" +
+              (active->getIndexProgress() < 100
+                   ? u", indexing " +
+                         numberToString(active->getIndexProgress()) + u"%"
+                   : u"") +
+              u"]";
+  else if (active->isFollowing())
+    status += u" [following, " + numberToString(active->_lines.size()) +
+              u" lines]";
+}
+
+void State::toggleFollow() {
+  if (mode != 0)
+    return;
+  bool enable = !active->isFollowing();
+  if (!active->follow(enable, provider.followMaxLines)) {
+    status = u"Can't follow: " + (path.length() ? create(path) : u"New File");
+    return;
+  }
+  renderCoords();
 }
 
 void State::gotoLine() {
@@ -434,6 +1071,7 @@ void State::deleteCursor(const std::shared_ptr<Document> &cursor) {
   for (auto it = cursors.begin(); it != cursors.end(); ++it, ++i) {
     if (*it == cursor) {
       cursors.erase(it);
+      watchOpenFiles();
       if (cursor == active) {
         if (i + 1 < cursors.size()) {
           activateCursor(i + 1);
@@ -462,7 +1100,7 @@ void State::activateCursor(size_t cursorIndex) {
       checkChanged();
     }
   } else {
-    fileName = u"New File";
+    fileName = active == grepBuffer.lock() ? u"Grep" : u"New File";
     hasHighlighting = false;
     renderCoords();
   }
@@ -475,10 +1113,13 @@ void State::addCursor(std::string path) {
     path = "";
   }
 
-  auto newCursor = Document::open(path);
+  auto newCursor = Document::open(
+      path, wakeUp, (uint64_t)provider.pagedThresholdMb * 1024 * 1024);
+  newCursor->_history.setBudget(provider.undoMemoryMb * 1024 * 1024);
   if (path.length()) {
     newCursor->_branch = provider.getBranchName(path);
   }
   cursors.push_back(newCursor);
+  watchOpenFiles();
   activateCursor(cursors.size() - 1);
 }
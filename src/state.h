@@ -2,10 +2,20 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <functional>
 #include <stdint.h>
 #include "highlighting.h"
 #include "config_provider.h"
 #include "document.h"
+#include "search_index.h"
+#include "buffer_search.h"
+#include "project_grep.h"
+#include "trigram_index.h"
+#include "file_list.h"
+#include "fuzzy_finder.h"
+#include "change_monitor.h"
+#include "thread_pool.h"
+#include <chrono>
 
 struct ReplaceBuffer {
   std::u16string search = u"";
@@ -23,6 +33,36 @@ public:
   Highlighter highlighter;
   Provider provider;
   ReplaceBuffer replaceBuffer;
+  SearchOptions searchOptions;
+  // matches of miniBuf in the active buffer while searching
+  SearchIndex searchIndex;
+  const Document *indexedDocument = nullptr;
+  size_t indexedVersion = 0;
+  std::chrono::steady_clock::time_point indexShown;
+  // search through every buffer and its results, C-x-f
+  ThreadPool pool;
+  std::unique_ptr<BufferSearch> bufferSearch;
+  std::vector<std::weak_ptr<Document>> searchedBuffers;
+  std::vector<std::u16string> searchedNames;
+  std::vector<BufferMatch> bufferMatches;
+  size_t bufferMatchIndex = 0;
+  // search through the files below the working directory, C-x-p, and the
+  // buffer listing its matches one per line after a heading
+  std::unique_ptr<ProjectGrep> projectGrep;
+  std::weak_ptr<Document> grepBuffer;
+  std::vector<GrepMatch> grepMatches;
+  std::string grepRoot;
+  std::u16string grepTerm;
+  // the trigram index of grepRoot if enabled, whether it picked the files
+  std::unique_ptr<TrigramIndexer> grepIndexer;
+  bool grepIndexed = false;
+  // the files below the working directory and their ranking for miniBuf,
+  // C-x-d
+  std::unique_ptr<FileList> fileList;
+  FuzzyFinder fileFinder{pool};
+  size_t fileFinderIndex = 0;
+  // reports changes to the files of the open buffers
+  std::unique_ptr<ChangeMonitor> changeMonitor;
   float WIDTH, HEIGHT;
   bool hasHighlighting;
   bool ctrlPressed = false;
@@ -35,6 +75,8 @@ public:
   bool highlightLine = true;
   int mode = 0;
   int round = 0;
+  // wakes the event loop up, safe to call from any thread
+  std::function<void()> wakeUp;
 
   State() {}
   State(float w, float h) {
@@ -45,11 +87,15 @@ public:
   void resize(float w, float h);
   void focus(bool focused);
   void invalidateCache() { cacheValid = false; }
+  // collects the results of background work, called once per frame
+  void poll();
 
   std::shared_ptr<Document> hasEditedBuffer() const;
   void startReplace();
   void tryComment();
   void checkChanged();
+  void watchOpenFiles();
+  void updateChanges();
   void switchMode();
   void increaseFontSize(int value);
   void toggleSelection();
@@ -63,12 +109,37 @@ public:
   void open();
   void reHighlight();
   void undo();
+  void redo();
   void search();
+  void toggleSearchOption(bool SearchOptions::*option);
+  std::u16string getSearchFlags();
+  std::u16string getSearchPrompt();
+  std::u16string getMatchStatus();
+  std::u16string findMatch(bool backward);
+  void updateSearchIndex();
+  void searchBuffers();
+  void showBufferMatches();
+  bool checkSearchTerm();
+  bool startBufferSearch();
+  std::u16string getBufferMatchStatus();
+  std::u16string gotoBufferMatch();
+  void updateBufferSearch();
+  void grepProject();
+  bool startProjectGrep();
+  std::u16string getGrepHeading();
+  void updateProjectGrep();
+  bool openGrepMatch();
+  void findFile();
+  std::u16string getFileFinderStatus();
+  void updateFileFinder();
+  void openFoundFile();
+  void showPosition(size_t line, size_t column);
   void tryEnableHighlighting();
   void inform(bool success, bool shift_pressed);
   void provideComplete(bool reverse);
   void renderCoords();
   void gotoLine();
+  void toggleFollow();
   std::u16string getTabInfo();
 
   size_t getActiveIndex() const {
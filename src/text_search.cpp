@@ -0,0 +1,350 @@
+#include "text_search.h"
+#include "simd.h"
+#include "u8String.h"
+#include <algorithm>
+#include <deque>
+#include <string.h>
+
+static const size_t NOT_FOUND = std::u16string::npos;
+// bytes of a span decoded and searched at once, doubled for every piece
+// without a match up to the most
+static const size_t FIRST_PIECE = 256;
+static const size_t MAX_PIECE = 64 * 1024;
+
+// the character folding to c, c itself if there is none
+static char16_t otherCase(char16_t c) {
+  static const char16_t deltas[] = {32, 80, 1};
+  for (char16_t delta : deltas) {
+    if (c >= delta && TextSearch::fold(c - delta) == c)
+      return c - delta;
+  }
+  return c;
+}
+
+#ifdef LEDIT_SSE2
+template <typename F>
+static size_t filterSse2(const char16_t *text, size_t from, size_t last,
+                         size_t length, const char16_t *first,
+                         const char16_t *final, F &verify, size_t &match) {
+  __m128i first0 = _mm_set1_epi16(first[0]);
+  __m128i first1 = _mm_set1_epi16(first[1]);
+  __m128i final0 = _mm_set1_epi16(final[0]);
+  __m128i final1 = _mm_set1_epi16(final[1]);
+  size_t i = from;
+  for (; i + 8 <= last + 1; i += 8) {
+    __m128i head = _mm_loadu_si128((const __m128i *)(text + i));
+    __m128i tail = _mm_loadu_si128((const __m128i *)(text + i + length - 1));
+    __m128i hit = _mm_and_si128(
+        _mm_or_si128(_mm_cmpeq_epi16(head, first0),
+                     _mm_cmpeq_epi16(head, first1)),
+        _mm_or_si128(_mm_cmpeq_epi16(tail, final0),
+                     _mm_cmpeq_epi16(tail, final1)));
+    // two mask bits per character
+    uint32_t mask = _mm_movemask_epi8(hit);
+    while (mask) {
+      int bit = simd::ctz(mask);
+      if (verify(i + bit / 2)) {
+        match = i + bit / 2;
+        return i;
+      }
+      mask &= ~(3u << bit);
+    }
+  }
+  return i;
+}
+#endif
+
+#ifdef LEDIT_AVX2
+template <typename F>
+LEDIT_AVX2_TARGET static size_t
+filterAvx2(const char16_t *text, size_t from, size_t last, size_t length,
+           const char16_t *first, const char16_t *final, F &verify,
+           size_t &match) {
+  __m256i first0 = _mm256_set1_epi16(first[0]);
+  __m256i first1 = _mm256_set1_epi16(first[1]);
+  __m256i final0 = _mm256_set1_epi16(final[0]);
+  __m256i final1 = _mm256_set1_epi16(final[1]);
+  size_t i = from;
+  for (; i + 16 <= last + 1; i += 16) {
+    __m256i head = _mm256_loadu_si256((const __m256i *)(text + i));
+    __m256i tail =
+        _mm256_loadu_si256((const __m256i *)(text + i + length - 1));
+    __m256i hit = _mm256_and_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi16(head, first0),
+                        _mm256_cmpeq_epi16(head, first1)),
+        _mm256_or_si256(_mm256_cmpeq_epi16(tail, final0),
+                        _mm256_cmpeq_epi16(tail, final1)));
+    uint32_t mask = _mm256_movemask_epi8(hit);
+    while (mask) {
+      int bit = simd::ctz(mask);
+      if (verify(i + bit / 2)) {
+        match = i + bit / 2;
+        return i;
+      }
+      mask &= ~(3u << bit);
+    }
+  }
+  // the rest of a short line a half vector at once, staying in AVX encoding
+  // as mixing it with the SSE2 filter costs more than the compare itself
+  if (i + 8 <= last + 1) {
+    __m128i head = _mm_loadu_si128((const __m128i *)(text + i));
+    __m128i tail = _mm_loadu_si128((const __m128i *)(text + i + length - 1));
+    __m128i hit = _mm_and_si128(
+        _mm_or_si128(_mm_cmpeq_epi16(head, _mm256_castsi256_si128(first0)),
+                     _mm_cmpeq_epi16(head, _mm256_castsi256_si128(first1))),
+        _mm_or_si128(_mm_cmpeq_epi16(tail, _mm256_castsi256_si128(final0)),
+                     _mm_cmpeq_epi16(tail, _mm256_castsi256_si128(final1))));
+    uint32_t mask = _mm_movemask_epi8(hit);
+    while (mask) {
+      int bit = simd::ctz(mask);
+      if (verify(i + bit / 2)) {
+        match = i + bit / 2;
+        return i;
+      }
+      mask &= ~(3u << bit);
+    }
+    i += 8;
+  }
+  return i;
+}
+#endif
+
+TextSearch::TextSearch(const std::u16string &needle, SearchOptions options)
+    : _options(options) {
+  size_t start = 0;
+  while (true) {
+    size_t end = needle.find(u'\n', start);
+    _parts.push_back(needle.substr(start, end - start));
+    if (end == std::u16string::npos)
+      break;
+    start = end + 1;
+  }
+  if (_options.ignoreCase) {
+    for (auto &part : _parts) {
+      for (auto &c : part)
+        c = fold(c);
+    }
+  }
+  const std::u16string &single = _parts[0];
+  if (single.empty())
+    return;
+  _first[0] = _first[1] = single.front();
+  _last[0] = _last[1] = single.back();
+  if (_options.ignoreCase) {
+    _first[1] = otherCase(_first[0]);
+    _last[1] = otherCase(_last[0]);
+  }
+}
+
+size_t TextSearch::length() const {
+  size_t total = _parts.size() - 1;
+  for (auto &part : _parts)
+    total += part.length();
+  return total;
+}
+
+char16_t TextSearch::fold(char16_t c) {
+  if (c < 0x80)
+    return c >= 'A' && c <= 'Z' ? c + 32 : c;
+  if (c >= 0xC0 && c <= 0xDE && c != 0xD7)
+    return c + 32;
+  if (c >= 0x100 && c <= 0x17F) {
+    // Latin Extended-A pairs upper and lower case next to each other
+    if ((c <= 0x137) || (c >= 0x14A && c <= 0x177))
+      return c | 1;
+    if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E))
+      return c & 1 ? c + 1 : c;
+    return c;
+  }
+  if (c >= 0x391 && c <= 0x3A9 && c != 0x3A2)
+    return c + 32;
+  if (c >= 0x410 && c <= 0x42F)
+    return c + 32;
+  if (c >= 0x400 && c <= 0x40F)
+    return c + 80;
+  return c;
+}
+
+bool TextSearch::isWordChar(char16_t c) {
+  if (c < 0x80)
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_';
+  return c >= 0xC0 && c != 0xD7 && c != 0xF7;
+}
+
+bool TextSearch::equals(const char16_t *text,
+                        const std::u16string &part) const {
+  if (!_options.ignoreCase)
+    return !memcmp(text, part.data(), part.length() * sizeof(char16_t));
+  for (size_t i = 0; i < part.length(); i++) {
+    if (fold(text[i]) != part[i])
+      return false;
+  }
+  return true;
+}
+
+bool TextSearch::boundaryBefore(const char16_t *text, size_t at) const {
+  return !_options.wholeWord || !at || !isWordChar(text[at - 1]);
+}
+
+bool TextSearch::boundaryAfter(const char16_t *text, size_t length,
+                               size_t at) const {
+  return !_options.wholeWord || at >= length || !isWordChar(text[at]);
+}
+
+size_t TextSearch::find(const char16_t *text, size_t length,
+                        size_t from) const {
+  const std::u16string &needle = _parts[0];
+  size_t size = needle.length();
+  if (!size || length < size || from > length - size)
+    return NOT_FOUND;
+  size_t last = length - size;
+  auto verify = [&](size_t at) {
+    return equals(text + at, needle) && boundaryBefore(text, at) &&
+           boundaryAfter(text, length, at + size);
+  };
+  size_t i = from;
+  size_t match = NOT_FOUND;
+  bool filtered = false;
+#ifdef LEDIT_AVX2
+  if (simd::hasAvx2()) {
+    i = filterAvx2(text, i, last, size, _first, _last, verify, match);
+    filtered = true;
+  }
+#endif
+#ifdef LEDIT_SSE2
+  if (!filtered)
+    i = filterSse2(text, i, last, size, _first, _last, verify, match);
+#endif
+  if (match != NOT_FOUND)
+    return match;
+  for (; i <= last; i++) {
+    char16_t head = text[i];
+    char16_t tail = text[i + size - 1];
+    if ((head == _first[0] || head == _first[1]) &&
+        (tail == _last[0] || tail == _last[1]) && verify(i))
+      return i;
+  }
+  return NOT_FOUND;
+}
+
+bool TextSearch::find(const LineBuffer &lines, size_t &line,
+                      size_t &column) const {
+  return find(lines, line, column, lines.size());
+}
+
+bool TextSearch::find(const LineBuffer &lines, size_t &line, size_t &column,
+                      size_t to) const {
+  if (isEmpty())
+    return false;
+  if (isMultiLine())
+    return findMultiLine(lines, line, column, to);
+  if (line >= to)
+    return false;
+  // The buffer is walked a chunk at a time: decoded lines are searched
+  // where they are, untouched spans are decoded a piece of many lines at
+  // once and the piece searched in one go, the newlines between its lines
+  // match no single line needle and make word boundaries. Pieces start
+  // small as the next match is often close.
+  std::u16string block;
+  size_t piece = FIRST_PIECE;
+  size_t from = column;
+  size_t index = line;
+  bool found = false;
+  auto search = [&](const char16_t *data, size_t size) {
+    size_t start = from;
+    if (from) {
+      // a column past the end of the first line goes on with the next
+      size_t firstLength = std::find(data, data + size, u'\n') - data;
+      if (start > firstLength)
+        start = firstLength + 1;
+      from = 0;
+    }
+    size_t at = find(data, size, start);
+    if (at == NOT_FOUND)
+      return false;
+    const char16_t *match = data + at;
+    const char16_t *lineStart = match;
+    while (lineStart > data && lineStart[-1] != u'\n')
+      lineStart--;
+    line = index + std::count(data, lineStart, u'\n');
+    column = match - lineStart;
+    found = true;
+    return true;
+  };
+  lines.forEachChunk(line, to, [&](const std::u16string *text,
+                                   const char *raw, size_t length) {
+    if (text) {
+      if (search(text->data(), text->length()))
+        return false;
+      index++;
+      return true;
+    }
+    const char *end = raw + length;
+    while (true) {
+      // a piece ends with a line
+      const char *stop = raw + std::min<size_t>(piece, end - raw);
+      if (stop < end) {
+        auto newline = (const char *)memchr(stop, '\n', end - stop);
+        stop = newline ? newline : end;
+      }
+      size_t bytes = stop - raw;
+      // the block only grows, filling what it gains costs as much as
+      // decoding into it
+      if (block.length() < bytes)
+        block.resize(bytes);
+      if (search(block.data(), decodeUtf16(raw, bytes, &block[0])))
+        return false;
+      index += simd::countNewlines(raw, bytes) + 1;
+      piece = std::min(MAX_PIECE, piece * 2);
+      if (stop == end)
+        return true;
+      raw = stop + 1;
+    }
+  });
+  return found;
+}
+
+bool TextSearch::findMultiLine(const LineBuffer &lines, size_t &line,
+                               size_t &column, size_t to) const {
+  size_t first = line;
+  size_t start = column;
+  size_t count = _parts.size();
+  // lines ending in the first part with the column the match starts at,
+  // line index - start line is the part the next line has to match
+  std::deque<std::pair<size_t, size_t>> open;
+  bool found = false;
+  lines.forEach(first, to, [&](size_t index, const std::u16string &text) {
+    for (auto it = open.begin(); it != open.end();) {
+      size_t part = index - it->first;
+      const std::u16string &expected = _parts[part];
+      if (part + 1 < count) {
+        if (text.length() == expected.length() &&
+            equals(text.data(), expected))
+          it++;
+        else
+          it = open.erase(it);
+        continue;
+      }
+      // the oldest open candidate is the first to complete
+      if (text.length() >= expected.length() &&
+          equals(text.data(), expected) &&
+          boundaryAfter(text.data(), text.length(), expected.length())) {
+        line = it->first;
+        column = it->second;
+        found = true;
+        return false;
+      }
+      it = open.erase(it);
+    }
+    const std::u16string &head = _parts[0];
+    if (text.length() >= head.length()) {
+      size_t at = text.length() - head.length();
+      if ((index != first || at >= start) && equals(text.data() + at, head) &&
+          boundaryBefore(text.data(), at))
+        open.emplace_back(index, at);
+    }
+    return true;
+  });
+  return found;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "line_buffer.h"
+#include <string>
+#include <vector>
+
+struct SearchOptions {
+  bool ignoreCase = false;
+  // matches have to start and end at word boundaries
+  bool wholeWord = false;
+  // the needle is a regular expression, see RegexSearch
+  bool regex = false;
+};
+
+/*
+  Literal search for a needle compiled once and run over many lines.
+  Candidates are found a vector at a time by comparing the first and the
+  last character of the needle at once, only positions where both agree are
+  compared in full, so the text is never copied.
+  Ignoring case folds ASCII, Latin-1, Latin Extended-A, Greek and Cyrillic
+  letters. A needle containing newlines matches across lines: its first line
+  has to end a line, the ones in between have to be whole lines and its last
+  line has to start one.
+*/
+class TextSearch {
+  SearchOptions _options;
+  // the needle split at newlines, folded when ignoring case
+  std::vector<std::u16string> _parts;
+  // both cases of the first and last character of a single line needle
+  char16_t _first[2];
+  char16_t _last[2];
+
+public:
+  TextSearch(const std::u16string &needle, SearchOptions options = {});
+
+  bool isEmpty() const { return _parts.size() == 1 && _parts[0].empty(); }
+  bool isMultiLine() const { return _parts.size() > 1; }
+  // length of a match in characters, newlines count one
+  size_t length() const;
+
+  // First match in text[from, length) of a single line needle, npos if
+  // there is none.
+  size_t find(const char16_t *text, size_t length, size_t from) const;
+  // First match at or after column of line, both are set to where it
+  // starts. False if there is none up to the end of the buffer.
+  bool find(const LineBuffer &lines, size_t &line, size_t &column) const;
+  // Same, searching lines [line, to) only.
+  bool find(const LineBuffer &lines, size_t &line, size_t &column,
+            size_t to) const;
+
+  static char16_t fold(char16_t c);
+  static bool isWordChar(char16_t c);
+
+private:
+  bool equals(const char16_t *text, const std::u16string &part) const;
+  bool boundaryBefore(const char16_t *text, size_t at) const;
+  bool boundaryAfter(const char16_t *text, size_t length, size_t at) const;
+  bool findMultiLine(const LineBuffer &lines, size_t &line, size_t &column,
+                     size_t to) const;
+};
@@ -0,0 +1,81 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(size_t threads) : _size(threads) {
+  if (!_size)
+    _size = std::thread::hardware_concurrency();
+  if (!_size)
+    _size = 1;
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+    _tasks.clear();
+  }
+  _wake.notify_all();
+  for (auto &thread : _threads)
+    thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tasks.push_back(std::move(task));
+    if (_threads.empty()) {
+      for (size_t i = 0; i < _size; i++)
+        _threads.emplace_back(&ThreadPool::work, this);
+    }
+  }
+  _wake.notify_one();
+}
+
+void ThreadPool::forEach(size_t count,
+                         const std::function<void(size_t)> &fn) {
+  // a worker may only start after the call returned, it must not touch fn
+  // then, only the counters which it shares
+  struct Shared {
+    std::atomic<size_t> next{0};
+    size_t count;
+    const std::function<void(size_t)> *fn;
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t done = 0;
+  };
+  auto shared = std::make_shared<Shared>();
+  shared->count = count;
+  shared->fn = &fn;
+  auto run = [shared] {
+    for (size_t index = shared->next++; index < shared->count;
+         index = shared->next++) {
+      (*shared->fn)(index);
+      std::lock_guard<std::mutex> lock(shared->mutex);
+      if (++shared->done == shared->count)
+        shared->finished.notify_all();
+    }
+  };
+  for (size_t i = 1; i < std::min(count, _size + 1); i++)
+    submit(run);
+  run();
+  std::unique_lock<std::mutex> lock(shared->mutex);
+  shared->finished.wait(lock,
+                        [&] { return shared->done == shared->count; });
+}
+
+void ThreadPool::work() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wake.wait(lock, [this] { return _stop || !_tasks.empty(); });
+      if (_stop)
+        return;
+      task = std::move(_tasks.front());
+      _tasks.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+  A fixed set of worker threads running queued tasks in the order they were
+  submitted. The threads start with the first task, a pool nobody uses
+  costs nothing. Tasks still queued when the pool is destroyed are dropped
+  and the running ones waited for, they must not wait on the thread that
+  owns the pool.
+*/
+class ThreadPool {
+  size_t _size;
+  std::vector<std::thread> _threads;
+  std::deque<std::function<void()>> _tasks;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  bool _stop = false;
+
+public:
+  // one thread per core when threads is 0
+  explicit ThreadPool(size_t threads = 0);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ~ThreadPool();
+
+  size_t size() const { return _size; }
+  void submit(std::function<void()> task);
+  // Runs fn(0) to fn(count - 1) on the pool and the calling thread and
+  // returns once all have run. Indexes no worker got to yet run on the
+  // caller, a busy pool only makes it slower.
+  void forEach(size_t count, const std::function<void(size_t)> &fn);
+
+private:
+  void work();
+};
@@ -0,0 +1,450 @@
+#include "trigram_index.h"
+#include "file_scanner.h"
+#include "mapped_file.h"
+#include "project_walker.h"
+#include "regex_search.h"
+#include "u8String.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+
+static const char MAGIC[8] = {'L', 'E', 'D', 'I', 'T', 'T', 'R', 'I'};
+static const uint32_t VERSION = 1;
+static const uint32_t NEWLINE = '\n';
+
+static inline unsigned char foldByte(unsigned char c) {
+  return c >= 'A' && c <= 'Z' ? c + 32 : c;
+}
+
+static void putVarint(std::string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out += (char)(value | 0x80);
+    value >>= 7;
+  }
+  out += (char)value;
+}
+
+static bool getVarint(const char *&at, const char *end, uint64_t &value) {
+  value = 0;
+  for (int shift = 0; at < end && shift < 64; shift += 7) {
+    unsigned char c = *at++;
+    value |= (uint64_t)(c & 0x7F) << shift;
+    if (!(c & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static void decodeList(const char *at, const char *end,
+                       std::vector<uint32_t> &out) {
+  uint64_t id = 0, delta;
+  out.clear();
+  while (at < end && getVarint(at, end, delta)) {
+    id += delta;
+    out.push_back((uint32_t)id);
+  }
+}
+
+// ids appended in increasing order as varint deltas
+struct ListBuilder {
+  std::string bytes;
+  uint32_t last = 0;
+
+  void add(uint32_t id) {
+    putVarint(bytes, id - last);
+    last = id;
+  }
+};
+
+// the distinct trigrams of data, a bit set per thread removes the repeats
+struct TrigramSet {
+  std::vector<uint64_t> seen = std::vector<uint64_t>((1 << 24) / 64);
+  std::vector<uint32_t> found;
+
+  void collect(const unsigned char *data, size_t size) {
+    found.clear();
+    if (size < 3)
+      return;
+    uint32_t trigram = foldByte(data[0]) << 8 | foldByte(data[1]);
+    for (size_t i = 2; i < size; i++) {
+      trigram = (trigram << 8 | foldByte(data[i])) & 0xFFFFFF;
+      if (data[i] == NEWLINE || data[i - 1] == NEWLINE ||
+          data[i - 2] == NEWLINE)
+        continue;
+      uint64_t bit = 1ull << (trigram & 63);
+      if (seen[trigram >> 6] & bit)
+        continue;
+      seen[trigram >> 6] |= bit;
+      found.push_back(trigram);
+    }
+    for (uint32_t t : found)
+      seen[t >> 6] = 0;
+    std::sort(found.begin(), found.end());
+  }
+};
+
+static uint64_t hashPath(const std::string &path) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (unsigned char c : path) {
+    hash ^= c;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+std::string TrigramIndex::pathFor(const std::string &directory,
+                                  const std::string &root) {
+  static const char digits[] = "0123456789abcdef";
+  uint64_t hash = hashPath(root);
+  std::string name;
+  for (int shift = 60; shift >= 0; shift -= 4)
+    name += digits[(hash >> shift) & 15];
+  return directory + "/" + name + ".idx";
+}
+
+std::shared_ptr<TrigramIndex>
+TrigramIndex::build(const std::string &root, const TrigramIndex *previous,
+                    const std::atomic<bool> &cancel) {
+  // too many stale ids left, everything is read again
+  if (previous && previous->_files.size() > 2 * previous->_alive)
+    previous = nullptr;
+  auto index = std::make_shared<TrigramIndex>();
+  index->_root = root;
+  std::unordered_map<std::string, uint32_t> known;
+  std::vector<uint8_t> keep;
+  if (previous) {
+    index->_files = previous->_files;
+    keep.resize(previous->_files.size());
+    for (size_t id = 0; id < previous->_files.size(); id++) {
+      if (previous->_files[id].path.length())
+        known.emplace(previous->_files[id].path, (uint32_t)id);
+    }
+  }
+  size_t threads = std::thread::hardware_concurrency();
+  if (!threads)
+    threads = 1;
+  std::vector<TrigramSet> sets(threads);
+  std::mutex mutex;
+  std::unordered_map<uint32_t, ListBuilder> added;
+  ProjectWalker::walk(
+      root, threads, cancel,
+      [&](size_t thread, const std::string &path,
+          const std::string &relative) {
+        std::error_code error;
+        uint64_t size = std::filesystem::file_size(path, error);
+        if (error)
+          return;
+        int64_t mtime = std::filesystem::last_write_time(path, error)
+                            .time_since_epoch()
+                            .count();
+        if (error)
+          return;
+        auto it = known.find(relative);
+        if (it != known.end()) {
+          const File &old = previous->_files[it->second];
+          if (old.size == size && old.mtime == mtime) {
+            keep[it->second] = 1;
+            return;
+          }
+        }
+        File file{relative, size, mtime,
+                  size > MAX_INDEXED_BYTES ? LARGE : INDEXED};
+        TrigramSet &set = sets[thread];
+        set.found.clear();
+        if (file.kind == INDEXED && size) {
+          auto mapped = MappedFile::open(path);
+          if (!mapped)
+            return;
+          if (FileScanner::isBinary(mapped->data(), mapped->size()))
+            file.kind = BINARY;
+          else
+            set.collect((const unsigned char *)mapped->data(),
+                        mapped->size());
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t id = (uint32_t)index->_files.size();
+        index->_files.push_back(std::move(file));
+        for (uint32_t trigram : set.found)
+          added[trigram].add(id);
+      });
+  if (cancel)
+    return nullptr;
+  // files not seen again are gone, changed ones were added anew
+  for (size_t id = 0; id < keep.size(); id++) {
+    if (!keep[id])
+      index->_files[id].path.clear();
+  }
+  for (auto &file : index->_files)
+    index->_alive += file.path.length() > 0;
+  std::vector<uint32_t> trigrams;
+  for (auto &entry : added)
+    trigrams.push_back(entry.first);
+  if (previous) {
+    for (auto &list : previous->_lists)
+      trigrams.push_back(list.trigram);
+  }
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                 trigrams.end());
+  std::vector<uint32_t> ids;
+  for (uint32_t trigram : trigrams) {
+    ListBuilder list;
+    if (previous) {
+      auto it = std::lower_bound(
+          previous->_lists.begin(), previous->_lists.end(), trigram,
+          [](const List &l, uint32_t t) { return l.trigram < t; });
+      if (it != previous->_lists.end() && it->trigram == trigram) {
+        const char *at = previous->_postings.data() + it->offset;
+        decodeList(at, at + it->length, ids);
+        for (uint32_t id : ids) {
+          if (keep[id])
+            list.add(id);
+        }
+      }
+    }
+    auto it = added.find(trigram);
+    if (it != added.end()) {
+      const std::string &bytes = it->second.bytes;
+      decodeList(bytes.data(), bytes.data() + bytes.length(), ids);
+      for (uint32_t id : ids)
+        list.add(id);
+      added.erase(it);
+    }
+    if (list.bytes.empty())
+      continue;
+    index->_lists.push_back({trigram, index->_postings.length(),
+                             (uint32_t)list.bytes.length()});
+    index->_postings += list.bytes;
+  }
+  return index;
+}
+
+bool TrigramIndex::candidates(const std::u16string &term,
+                              SearchOptions options,
+                              std::vector<std::string> &out) const {
+  std::u16string literal = term;
+  if (options.regex) {
+    RegexSearch regex(term, options);
+    literal = regex.prefix();
+  }
+  std::string bytes = convert_str(literal);
+  std::vector<uint32_t> trigrams;
+  for (size_t i = 0; i + 3 <= bytes.length(); i++) {
+    auto *at = (const unsigned char *)bytes.data() + i;
+    // the other case of a non ASCII letter is made of other bytes
+    if (options.ignoreCase && (at[0] >= 0x80 || at[1] >= 0x80 ||
+                               at[2] >= 0x80))
+      continue;
+    if (at[0] == NEWLINE || at[1] == NEWLINE || at[2] == NEWLINE)
+      continue;
+    trigrams.push_back(foldByte(at[0]) << 16 | foldByte(at[1]) << 8 |
+                       foldByte(at[2]));
+  }
+  if (trigrams.empty())
+    return false;
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                 trigrams.end());
+  std::vector<const List *> lists;
+  for (uint32_t trigram : trigrams) {
+    auto it = std::lower_bound(
+        _lists.begin(), _lists.end(), trigram,
+        [](const List &l, uint32_t t) { return l.trigram < t; });
+    lists.push_back(it != _lists.end() && it->trigram == trigram ? &*it
+                                                                 : nullptr);
+  }
+  std::vector<uint32_t> ids, next, both;
+  if (std::find(lists.begin(), lists.end(), nullptr) == lists.end()) {
+    // the shortest list first keeps the intersection small
+    std::sort(lists.begin(), lists.end(), [](const List *a, const List *b) {
+      return a->length < b->length;
+    });
+    for (size_t i = 0; i < lists.size(); i++) {
+      const char *at = _postings.data() + lists[i]->offset;
+      decodeList(at, at + lists[i]->length, i ? next : ids);
+      if (!i)
+        continue;
+      both.clear();
+      std::set_intersection(ids.begin(), ids.end(), next.begin(), next.end(),
+                            std::back_inserter(both));
+      ids.swap(both);
+      if (ids.empty())
+        break;
+    }
+  }
+  for (uint32_t id : ids) {
+    if (_files[id].path.length())
+      out.push_back(_files[id].path);
+  }
+  for (auto &file : _files) {
+    if (file.kind == LARGE && file.path.length())
+      out.push_back(file.path);
+  }
+  return true;
+}
+
+static void putU32(std::string &out, uint32_t value) {
+  out.append((const char *)&value, sizeof(value));
+}
+
+static void putU64(std::string &out, uint64_t value) {
+  out.append((const char *)&value, sizeof(value));
+}
+
+bool TrigramIndex::save(const std::string &path) const {
+  std::string data(MAGIC, sizeof(MAGIC));
+  putU32(data, VERSION);
+  putU32(data, (uint32_t)_root.length());
+  data += _root;
+  putU32(data, (uint32_t)_files.size());
+  for (auto &file : _files) {
+    putU32(data, (uint32_t)file.path.length());
+    data += file.path;
+    putU64(data, file.size);
+    putU64(data, (uint64_t)file.mtime);
+    data += (char)file.kind;
+  }
+  putU32(data, (uint32_t)_lists.size());
+  for (auto &list : _lists) {
+    putU32(data, list.trigram);
+    putU64(data, list.offset);
+    putU32(data, list.length);
+  }
+  putU64(data, _postings.length());
+  data += _postings;
+  std::error_code error;
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path(), error);
+  // written aside first, a reader never sees half an index
+  std::string temporary = path + ".tmp";
+  {
+    std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+    stream.write(data.data(), data.length());
+    if (!stream)
+      return false;
+  }
+  std::filesystem::rename(temporary, path, error);
+  return !error;
+}
+
+namespace {
+
+// reads the fields of a stored index, every read checks the bounds
+struct Reader {
+  const char *at;
+  const char *end;
+
+  bool read(void *out, size_t size) {
+    if ((size_t)(end - at) < size)
+      return false;
+    memcpy(out, at, size);
+    at += size;
+    return true;
+  }
+  bool read(std::string &out, size_t size) {
+    if ((size_t)(end - at) < size)
+      return false;
+    out.assign(at, size);
+    at += size;
+    return true;
+  }
+};
+
+} // namespace
+
+std::shared_ptr<TrigramIndex> TrigramIndex::load(const std::string &path,
+                                                 const std::string &root) {
+  auto file = MappedFile::open(path);
+  if (!file)
+    return nullptr;
+  Reader reader{file->data(), file->data() + file->size()};
+  char magic[sizeof(MAGIC)];
+  uint32_t version, length, count;
+  std::string storedRoot;
+  if (!reader.read(magic, sizeof(magic)) ||
+      memcmp(magic, MAGIC, sizeof(MAGIC)) || !reader.read(&version, 4) ||
+      version != VERSION || !reader.read(&length, 4) ||
+      !reader.read(storedRoot, length) || storedRoot != root ||
+      !reader.read(&count, 4))
+    return nullptr;
+  auto index = std::make_shared<TrigramIndex>();
+  index->_root = root;
+  for (uint32_t i = 0; i < count; i++) {
+    File entry;
+    uint8_t kind;
+    if (!reader.read(&length, 4) || !reader.read(entry.path, length) ||
+        !reader.read(&entry.size, 8) || !reader.read(&entry.mtime, 8) ||
+        !reader.read(&kind, 1) || kind > BINARY)
+      return nullptr;
+    entry.kind = (Kind)kind;
+    index->_alive += entry.path.length() > 0;
+    index->_files.push_back(std::move(entry));
+  }
+  if (!reader.read(&count, 4))
+    return nullptr;
+  index->_lists.resize(count);
+  for (auto &list : index->_lists) {
+    if (!reader.read(&list.trigram, 4) || !reader.read(&list.offset, 8) ||
+        !reader.read(&list.length, 4))
+      return nullptr;
+  }
+  uint64_t size;
+  if (!reader.read(&size, 8) || !reader.read(index->_postings, size))
+    return nullptr;
+  for (auto &list : index->_lists) {
+    if (list.offset + list.length > size)
+      return nullptr;
+  }
+  return index;
+}
+
+TrigramIndexer::TrigramIndexer(const std::string &root,
+                               const std::string &directory)
+    : _root(root), _path(TrigramIndex::pathFor(directory, root)) {
+  _running = true;
+  _thread = std::thread(&TrigramIndexer::run, this, true);
+}
+
+TrigramIndexer::~TrigramIndexer() {
+  _cancel = true;
+  if (_thread.joinable())
+    _thread.join();
+}
+
+std::shared_ptr<const TrigramIndex> TrigramIndexer::current() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _index;
+}
+
+void TrigramIndexer::refresh(std::chrono::steady_clock::duration interval) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_running || std::chrono::steady_clock::now() - _updated < interval)
+    return;
+  if (_thread.joinable())
+    _thread.join();
+  _running = true;
+  _thread = std::thread(&TrigramIndexer::run, this, false);
+}
+
+void TrigramIndexer::run(bool load) {
+  std::shared_ptr<const TrigramIndex> previous;
+  if (load) {
+    previous = TrigramIndex::load(_path, _root);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _index = previous;
+  } else {
+    previous = current();
+  }
+  auto index = TrigramIndex::build(_root, previous.get(), _cancel);
+  if (index)
+    index->save(_path);
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (index)
+      _index = index;
+    _running = false;
+    _updated = std::chrono::steady_clock::now();
+  }
+}
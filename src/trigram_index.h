@@ -0,0 +1,103 @@
+#pragma once
+#include "text_search.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+  The files below a project root that hold each trigram, three bytes in a
+  row, to narrow a search down to the files that can match before they are
+  scanned. ASCII letters are folded and trigrams holding a newline are left
+  out, a term is looked up the same way. Binary files are never candidates,
+  files larger than MAX_INDEXED_BYTES always are.
+  Each trigram has a list of file ids stored as varint deltas. An update
+  walks the tree again and only reads files whose size or mtime changed:
+  their old ids are dropped from the lists and they are added under new
+  ones, so the lists of unchanged files are copied without decoding a file.
+  Once more ids are dropped than in use the index is built from scratch.
+  An index never changes once made, threads can share it.
+*/
+class TrigramIndex {
+  enum Kind : uint8_t { INDEXED, LARGE, BINARY };
+  struct File {
+    // below the root, empty once the file is gone or changed
+    std::string path;
+    uint64_t size;
+    int64_t mtime;
+    Kind kind;
+  };
+  struct List {
+    uint32_t trigram;
+    uint64_t offset;
+    uint32_t length;
+  };
+
+  std::string _root;
+  std::vector<File> _files;
+  size_t _alive = 0;
+  // sorted by trigram, the bytes of each list are in _postings
+  std::vector<List> _lists;
+  std::string _postings;
+
+public:
+  static const uint64_t MAX_INDEXED_BYTES = 16 * 1024 * 1024;
+
+  // the file the index of root is stored in below directory
+  static std::string pathFor(const std::string &directory,
+                             const std::string &root);
+  // The index stored at path, null if there is none, it can't be read or
+  // belongs to another root.
+  static std::shared_ptr<TrigramIndex> load(const std::string &path,
+                                            const std::string &root);
+  // Indexes the files below root, reusing what previous knows about the
+  // ones that did not change, previous may be null. Null once cancelled.
+  static std::shared_ptr<TrigramIndex>
+  build(const std::string &root, const TrigramIndex *previous,
+        const std::atomic<bool> &cancel);
+  bool save(const std::string &path) const;
+
+  const std::string &root() const { return _root; }
+  size_t fileCount() const { return _alive; }
+  // Paths below the root of the files that may hold a match of term, false
+  // if the term has no trigram to tell them apart.
+  bool candidates(const std::u16string &term, SearchOptions options,
+                  std::vector<std::string> &out) const;
+};
+
+/*
+  Keeps the index of one root current on a thread of its own. It starts
+  with the stored index, then updates it, stores the result and swaps it
+  in. refresh() updates it again, searches meanwhile use the last complete
+  index, so files changed since are only found once an update saw them.
+*/
+class TrigramIndexer {
+  std::string _root;
+  std::string _path;
+  std::mutex _mutex;
+  std::shared_ptr<const TrigramIndex> _index;
+  bool _running = false;
+  std::chrono::steady_clock::time_point _updated;
+  std::atomic<bool> _cancel{false};
+  std::thread _thread;
+
+public:
+  // the index is stored below directory
+  TrigramIndexer(const std::string &root, const std::string &directory);
+  TrigramIndexer(const TrigramIndexer &) = delete;
+  TrigramIndexer &operator=(const TrigramIndexer &) = delete;
+  ~TrigramIndexer();
+
+  const std::string &root() const { return _root; }
+  // the newest complete index, null until one was loaded or built
+  std::shared_ptr<const TrigramIndex> current();
+  // Updates the index unless that is going on or the last update ended
+  // less than interval ago.
+  void refresh(std::chrono::steady_clock::duration interval);
+
+private:
+  void run(bool load);
+};
@@ -1,29 +1,241 @@
 #include "u8String.h"
+#include "simd.h"
 
-std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> utfConverter;
+static const char16_t REPLACEMENT = 0xFFFD;
 
-std::string convert_str(std::u16string data) {
-  std::string b = utfConverter.to_bytes(data);
-  return b;
+static inline bool isContinuation(unsigned char c) { return (c & 0xC0) == 0x80; }
+
+// Decodes one non ASCII sequence at data[i], returns the bytes consumed.
+// Malformed input consumes its maximal valid prefix and yields U+FFFD.
+static size_t decodeSequence(const unsigned char *data, size_t i, size_t length,
+                             char16_t *&out) {
+  unsigned char c = data[i];
+  size_t need;
+  unsigned char low = 0x80, high = 0xBF;
+  uint32_t cp;
+  if (c >= 0xC2 && c < 0xE0) {
+    need = 1;
+    cp = c & 0x1F;
+  } else if (c >= 0xE0 && c < 0xF0) {
+    need = 2;
+    cp = c & 0x0F;
+    if (c == 0xE0)
+      low = 0xA0;
+    else if (c == 0xED)
+      high = 0x9F;
+  } else if (c >= 0xF0 && c < 0xF5) {
+    need = 3;
+    cp = c & 0x07;
+    if (c == 0xF0)
+      low = 0x90;
+    else if (c == 0xF4)
+      high = 0x8F;
+  } else {
+    *out++ = REPLACEMENT;
+    return 1;
+  }
+  size_t used = 1;
+  for (size_t k = 0; k < need; k++, used++) {
+    if (i + used >= length) {
+      *out++ = REPLACEMENT;
+      return used;
+    }
+    unsigned char next = data[i + used];
+    if (k == 0 ? (next < low || next > high) : !isContinuation(next)) {
+      *out++ = REPLACEMENT;
+      return used;
+    }
+    cp = (cp << 6) | (next & 0x3F);
+  }
+  if (cp >= 0x10000) {
+    cp -= 0x10000;
+    *out++ = (char16_t)(0xD800 + (cp >> 10));
+    *out++ = (char16_t)(0xDC00 + (cp & 0x3FF));
+  } else {
+    *out++ = (char16_t)cp;
+  }
+  return used;
 }
 
-std::u16string create(std::string container) {
-  try {
-    std::u16string b = utfConverter.from_bytes(container);
-    return b;
-  } catch (std::exception e) {
-    // failed to convert treat at ascii to display something at least
-    std::u16string target = u"";
-    std::string::const_iterator c;
-    for (c = container.begin(); c != container.end(); c++) {
-      target += (char16_t)*c;
+#ifdef LEDIT_AVX2
+LEDIT_AVX2_TARGET static size_t widenAsciiAvx2(const unsigned char *data,
+                                               size_t length, char16_t *out) {
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(data + i));
+    if (_mm256_movemask_epi8(block))
+      break;
+    _mm256_storeu_si256(
+        (__m256i *)(out + i),
+        _mm256_cvtepu8_epi16(_mm256_castsi256_si128(block)));
+    _mm256_storeu_si256(
+        (__m256i *)(out + i + 16),
+        _mm256_cvtepu8_epi16(_mm256_extracti128_si256(block, 1)));
+  }
+  return i;
+}
+#endif
+
+// Widens the leading ASCII run of data, returns how many bytes it covered.
+static size_t widenAscii(const unsigned char *data, size_t length,
+                         char16_t *out, bool avx2) {
+  size_t i = 0;
+#ifdef LEDIT_AVX2
+  if (avx2)
+    i = widenAsciiAvx2(data, length, out);
+#endif
+#ifdef LEDIT_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= length; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+    int mask = _mm_movemask_epi8(block);
+    if (mask) {
+      int ascii = simd::ctz((uint32_t)mask);
+      for (int k = 0; k < ascii; k++)
+        out[i + k] = data[i + k];
+      return i + ascii;
+    }
+    _mm_storeu_si128((__m128i *)(out + i), _mm_unpacklo_epi8(block, zero));
+    _mm_storeu_si128((__m128i *)(out + i + 8), _mm_unpackhi_epi8(block, zero));
+  }
+#endif
+  for (; i < length && data[i] < 0x80; i++)
+    out[i] = data[i];
+  return i;
+}
+
+size_t decodeUtf16(const char *data, size_t length, char16_t *out) {
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+  char16_t *start = out;
+  bool avx2 = simd::hasAvx2();
+  size_t i = 0;
+  while (i < length) {
+    size_t ascii = widenAscii(bytes + i, length - i, out, avx2);
+    i += ascii;
+    out += ascii;
+    if (i < length)
+      i += decodeSequence(bytes, i, length, out);
+  }
+  return out - start;
+}
+
+void appendUtf16(std::u16string &target, const char *data, size_t length) {
+  size_t start = target.size();
+  // every byte yields at most one UTF-16 unit
+  target.resize(start + length);
+  target.resize(start + decodeUtf16(data, length, &target[0] + start));
+}
+
+// Length of the leading ASCII run of data.
+static size_t asciiRun(const unsigned char *data, size_t length) {
+  size_t i = 0;
+#ifdef LEDIT_SSE2
+  for (; i + 16 <= length; i += 16) {
+    int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(data + i)));
+    if (mask)
+      return i + simd::ctz((uint32_t)mask);
+  }
+#endif
+  for (; i < length && data[i] < 0x80; i++)
+    ;
+  return i;
+}
+
+size_t utf16Length(const char *data, size_t length) {
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+  size_t units = 0;
+  size_t i = 0;
+  char16_t scratch[2];
+  while (i < length) {
+    size_t ascii = asciiRun(bytes + i, length - i);
+    i += ascii;
+    units += ascii;
+    if (i < length) {
+      // same decoder as appendUtf16, so the count always matches it
+      char16_t *out = scratch;
+      i += decodeSequence(bytes, i, length, out);
+      units += out - scratch;
     }
-    return target;
   }
+  return units;
+}
+
+// Narrows the leading ASCII run of data, returns how many units it covered.
+static size_t narrowAscii(const char16_t *data, size_t length, char *out) {
+  size_t i = 0;
+#ifdef LEDIT_SSE2
+  const __m128i high = _mm_set1_epi16((short)0xFF80);
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= length; i += 8) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(block, high), zero)) !=
+        0xFFFF)
+      break;
+    _mm_storel_epi64((__m128i *)(out + i), _mm_packus_epi16(block, block));
+  }
+#endif
+  for (; i < length && data[i] < 0x80; i++)
+    out[i] = (char)data[i];
+  return i;
+}
+
+void appendUtf8(std::string &target, const char16_t *data, size_t length) {
+  size_t start = target.size();
+  // worst case is three bytes for every unit of the BMP
+  target.resize(start + length * 3);
+  char *out = &target[0] + start;
+  size_t i = 0;
+  while (i < length) {
+    size_t ascii = narrowAscii(data + i, length - i, out);
+    i += ascii;
+    out += ascii;
+    if (i == length)
+      break;
+    uint32_t cp = data[i++];
+    if (cp >= 0xD800 && cp < 0xDC00 && i < length && data[i] >= 0xDC00 &&
+        data[i] < 0xE000) {
+      cp = 0x10000 + ((cp - 0xD800) << 10) + (data[i++] - 0xDC00);
+    } else if (cp >= 0xD800 && cp < 0xE000) {
+      cp = REPLACEMENT;
+    }
+    if (cp < 0x800) {
+      *out++ = (char)(0xC0 | (cp >> 6));
+      *out++ = (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+      *out++ = (char)(0xE0 | (cp >> 12));
+      *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+      *out++ = (char)(0x80 | (cp & 0x3F));
+    } else {
+      *out++ = (char)(0xF0 | (cp >> 18));
+      *out++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+      *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+      *out++ = (char)(0x80 | (cp & 0x3F));
+    }
+  }
+  target.resize(out - target.data());
+}
+
+std::string convert_str(const char16_t *data, size_t length) {
+  std::string result;
+  appendUtf8(result, data, length);
+  return result;
+}
+
+std::string convert_str(std::u16string data) {
+  return convert_str(data.data(), data.length());
+}
+
+std::u16string create(const char *data, size_t length) {
+  std::u16string result;
+  appendUtf16(result, data, length);
+  return result;
+}
+
+std::u16string create(std::string container) {
+  return create(container.data(), container.length());
 }
 
 std::u16string numberToString(int value) {
   std::string val = std::to_string(value);
-  return create(val);
+  return std::u16string(val.begin(), val.end());
 }
-
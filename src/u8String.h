@@ -1,14 +1,30 @@
 #pragma once
 #include <string>
-#include <codecvt>
-#ifdef __linux__
-#include <locale>
-#endif
+#include <stdint.h>
+#include <stddef.h>
 typedef union char_s {
   char16_t value;
   uint8_t arr[2];
 } char_t;
 
+/*
+  UTF-8 <-> UTF-16 conversion.
+  Runs of ASCII are checked and widened/narrowed a vector at a time, code
+  points above the BMP become surrogate pairs. Invalid input never throws:
+  every malformed sequence or lone surrogate turns into U+FFFD. The functions
+  keep no state and can be used from any thread.
+*/
 std::string convert_str(std::u16string data);
+std::string convert_str(const char16_t *data, size_t length);
 std::u16string create(std::string container);
+std::u16string create(const char *data, size_t length);
 std::u16string numberToString(int value);
+
+// appending variants, used where the output buffer is reused between calls
+void appendUtf8(std::string &target, const char16_t *data, size_t length);
+void appendUtf16(std::u16string &target, const char *data, size_t length);
+// decodes into out, which has room for length units, and returns how many
+// it wrote, for buffers kept large enough instead of resized every call
+size_t decodeUtf16(const char *data, size_t length, char16_t *out);
+// UTF-16 units create(data, length) would produce, without decoding
+size_t utf16Length(const char *data, size_t length);
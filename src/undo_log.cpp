@@ -0,0 +1,199 @@
+#include "undo_log.h"
+#include <algorithm>
+
+// keystrokes merged into one edit at most
+static const size_t MAX_RUN = 256;
+
+static bool isBlank(char16_t c) { return c == ' ' || c == '\t'; }
+
+void UndoLog::record(int y, int x, int cursorY, int cursorX,
+                     const std::u16string &removed,
+                     const std::u16string &inserted, bool joined) {
+  // whatever was undone can't be redone after a new edit, its texts go too
+  _records.resize(_head);
+  if (_records.empty()) {
+    _arena.clear();
+    _base = 0;
+    joined = false;
+  } else {
+    _arena.resize(end() - _base);
+  }
+  if (_arena.capacity() > 2 * _arena.size() + 1024)
+    _arena.shrink_to_fit();
+  Record record;
+  if (joined) {
+    // repeated edits of a transaction, like the matches of a replace, keep
+    // one copy of their texts
+    const Record &last = _records.back();
+    const char16_t *text = _arena.data() + (last.offset - _base);
+    if (last.removedLength == removed.length() &&
+        last.insertedLength == inserted.length() &&
+        std::equal(removed.begin(), removed.end(), text) &&
+        std::equal(inserted.begin(), inserted.end(),
+                   text + removed.length())) {
+      record = last;
+      record.y = y;
+      record.x = x;
+      record.cursorY = cursorY;
+      record.cursorX = cursorX;
+      record.joined = true;
+      _records.push_back(record);
+      _head = _records.size();
+      trim();
+      return;
+    }
+  }
+  record.y = y;
+  record.x = x;
+  record.cursorY = cursorY;
+  record.cursorX = cursorX;
+  record.offset = end();
+  record.removedLength = removed.length();
+  record.insertedLength = inserted.length();
+  record.joined = joined;
+  record.sealed = false;
+  _arena.insert(_arena.end(), removed.begin(), removed.end());
+  _arena.insert(_arena.end(), inserted.begin(), inserted.end());
+  _records.push_back(record);
+  _head = _records.size();
+  if (!joined)
+    _steps++;
+  trim();
+}
+
+bool UndoLog::extend(int y, int x, const std::u16string &removed,
+                     const std::u16string &inserted) {
+  if (!_head || _head != _records.size())
+    return false;
+  Record &last = _records.back();
+  // only a step of its own has its texts at the end of the arena
+  if (last.joined || last.sealed || last.y != y ||
+      last.removedLength + last.insertedLength >= MAX_RUN ||
+      removed.find(u'\n') != std::u16string::npos ||
+      inserted.find(u'\n') != std::u16string::npos)
+    return false;
+  if (inserted.length() && !removed.length() && last.insertedLength &&
+      !last.removedLength) {
+    if (x != last.x + (int)last.insertedLength)
+      return false;
+    // a new word starts a new step
+    if (isBlank(_arena.back()) && !isBlank(inserted[0]))
+      return false;
+    _arena.insert(_arena.end(), inserted.begin(), inserted.end());
+    last.insertedLength += inserted.length();
+    trim();
+    return true;
+  }
+  if (removed.length() && !inserted.length() && last.removedLength &&
+      !last.insertedLength) {
+    if (x + (int)removed.length() == last.x) {
+      // backspace, the text goes in front of what was removed before
+      _arena.insert(_arena.begin() + (last.offset - _base), removed.begin(),
+                    removed.end());
+      last.x = x;
+    } else if (x == last.x) {
+      _arena.insert(_arena.end(), removed.begin(), removed.end());
+    } else {
+      return false;
+    }
+    last.removedLength += removed.length();
+    trim();
+    return true;
+  }
+  return false;
+}
+
+void UndoLog::seal() {
+  if (_head)
+    _records[_head - 1].sealed = true;
+}
+
+bool UndoLog::undo(Edit &edit) {
+  if (!_head)
+    return false;
+  edit = load(_records[--_head]);
+  if (!edit.joined)
+    _steps--;
+  return true;
+}
+
+bool UndoLog::redo(Edit &edit) {
+  if (_head == _records.size())
+    return false;
+  edit = load(_records[_head++]);
+  if (!edit.joined)
+    _steps++;
+  return true;
+}
+
+bool UndoLog::redoJoined() const {
+  return _head < _records.size() && _records[_head].joined;
+}
+
+void UndoLog::clear() {
+  _records.clear();
+  _head = 0;
+  _steps = 0;
+  _base += _arena.size();
+  std::vector<char16_t>().swap(_arena);
+}
+
+void UndoLog::setBudget(size_t budget) {
+  _budget = budget;
+  trim();
+}
+
+size_t UndoLog::memoryUsage() const {
+  return _records.size() * sizeof(Record) +
+         _arena.capacity() * sizeof(char16_t);
+}
+
+UndoLog::Edit UndoLog::load(const Record &record) const {
+  Edit edit;
+  edit.y = record.y;
+  edit.x = record.x;
+  edit.cursorY = record.cursorY;
+  edit.cursorX = record.cursorX;
+  const char16_t *text = _arena.data() + (record.offset - _base);
+  edit.removed.assign(text, record.removedLength);
+  edit.inserted.assign(text + record.removedLength, record.insertedLength);
+  edit.joined = record.joined;
+  return edit;
+}
+
+size_t UndoLog::end() const {
+  if (_records.empty())
+    return _base + _arena.size();
+  const Record &last = _records.back();
+  return last.offset + last.removedLength + last.insertedLength;
+}
+
+void UndoLog::trim() {
+  auto used = [this]() {
+    return _records.size() * sizeof(Record) +
+           (end() - _records.front().offset) * sizeof(char16_t);
+  };
+  // Whole steps are dropped from the front, the one at the head survives.
+  size_t dropped = 0;
+  while (_records.size() && used() > _budget) {
+    size_t step = 1;
+    while (step < _records.size() && _records[step].joined)
+      step++;
+    if (step >= _head)
+      break;
+    _records.erase(_records.begin(), _records.begin() + step);
+    _head -= step;
+    _steps--;
+    dropped += step;
+  }
+  if (!dropped)
+    return;
+  // the arena is compacted once its dead front outweighs the live part
+  size_t start = _records.front().offset - _base;
+  if (start > _arena.size() / 2) {
+    _arena.erase(_arena.begin(), _arena.begin() + start);
+    _base += start;
+    if (_arena.capacity() > 2 * _arena.size() + 1024)
+      _arena.shrink_to_fit();
+  }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <deque>
+#include <string>
+#include <vector>
+
+/*
+  Undo and redo history of a Document. Every edit is kept as a delta: at
+  line y, column x the text removed was replaced by the text inserted,
+  either of which may span lines. The texts of all edits live back to back
+  in one arena, so an edit costs its two texts and a small record instead
+  of copies of the lines it touched.
+
+  Edits left of the head can be undone, the ones right of it redone, a new
+  edit drops the redo side. Once the log needs more than its budget the
+  oldest steps are dropped, the newest one is always kept.
+  Keystrokes are merged into the newest edit while they continue it, an edit
+  joined to one with the same texts shares them, so a replace over the whole
+  buffer costs a record per match.
+*/
+class UndoLog {
+public:
+  struct Edit {
+    int y, x;
+    // where the cursor was before the edit
+    int cursorY, cursorX;
+    std::u16string removed;
+    std::u16string inserted;
+    // undone and redone together with the edit recorded before it
+    bool joined;
+  };
+
+private:
+  struct Record {
+    int y, x;
+    int cursorY, cursorX;
+    // position of removed in the arena, inserted follows it
+    size_t offset;
+    size_t removedLength;
+    size_t insertedLength;
+    bool joined;
+    // no longer extended by keystrokes
+    bool sealed;
+  };
+
+  std::deque<Record> _records;
+  size_t _head = 0;
+  // steps left of the head
+  size_t _steps = 0;
+  std::vector<char16_t> _arena;
+  // arena offset of _arena[0], offsets stay valid when the front is trimmed
+  size_t _base = 0;
+  size_t _budget;
+
+public:
+  explicit UndoLog(size_t budget = 64 * 1024 * 1024) : _budget(budget) {}
+
+  void record(int y, int x, int cursorY, int cursorX,
+              const std::u16string &removed, const std::u16string &inserted,
+              bool joined = false);
+  // Merges a keystroke into the newest edit if it continues it on the same
+  // line, false if it has to be recorded on its own.
+  bool extend(int y, int x, const std::u16string &removed,
+              const std::u16string &inserted);
+  // ends the run of keystrokes the newest edit collects
+  void seal();
+  // Moves the head back over one edit, false if there is none. The edits of
+  // a step come out newest first, edit.joined tells if more follow.
+  bool undo(Edit &edit);
+  // Moves the head forward over one edit, false if there is none.
+  bool redo(Edit &edit);
+  // true if the next redo() continues the step just redone
+  bool redoJoined() const;
+  bool canUndo() const { return _head > 0; }
+  bool canRedo() const { return _head < _records.size(); }
+  void clear();
+  void setBudget(size_t budget);
+  // undo steps, edits joined to another one don't count
+  size_t size() const { return _steps; }
+  size_t memoryUsage() const;
+
+private:
+  Edit load(const Record &record) const;
+  size_t end() const;
+  void trim();
+};
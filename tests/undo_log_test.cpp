@@ -0,0 +1,46 @@
+// The undo log keeps no more than the edits it can still undo or redo.
+#include "../src/undo_log.h"
+#include <iostream>
+#include <string>
+
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+  if (condition)
+    return;
+  std::cerr << "failed: " << what << "\n";
+  failures++;
+}
+
+int main() {
+  UndoLog log;
+  size_t empty = log.memoryUsage();
+  std::u16string paste(8 * 1024 * 1024, u'x');
+  log.record(0, 0, 0, 0, u"", paste);
+  log.record(0, 0, 0, 0, u"", u"line");
+  expect(log.memoryUsage() >= paste.size() * sizeof(char16_t),
+         "the paste is kept while it can be undone");
+
+  UndoLog::Edit edit;
+  while (log.undo(edit))
+    ;
+  expect(edit.inserted == paste, "undo gives the paste back");
+  log.record(0, 0, 0, 0, u"", u"a");
+  expect(log.memoryUsage() < empty + 4096,
+         "a new edit after undoing everything drops the undone texts");
+  expect(log.undo(edit) && edit.inserted == u"a" && !log.undo(edit),
+         "only the new edit is left");
+
+  // undoing part of the log keeps the edits before the head
+  log.clear();
+  log.record(0, 0, 0, 0, u"", u"kept");
+  log.record(0, 4, 0, 4, u"", paste);
+  log.undo(edit);
+  log.record(0, 4, 0, 4, u"", u"b");
+  expect(log.memoryUsage() < empty + 4096,
+         "a new edit after an undo drops the undone texts");
+  expect(log.undo(edit) && edit.inserted == u"b", "the new edit is undone");
+  expect(log.undo(edit) && edit.inserted == u"kept",
+         "the edit before it is kept");
+  return failures ? 1 : 0;
+}